@@ -0,0 +1,254 @@
+
+#include "binaryprotocol.h"
+
+#include "goldmine/exceptions.h"
+
+namespace goldmine
+{
+
+template<typename T>
+static T getStruct(const cppio::Message& msg)
+{
+	if((msg.size() < 2) || (msg.frame(1).size() != sizeof(T)))
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Malformed binary message"));
+	return msg.get<T>(1);
+}
+
+static std::string optionalString(const cppio::Message& msg, size_t frame)
+{
+	if(msg.size() > frame)
+		return msg.get<std::string>(frame);
+	return std::string();
+}
+
+static Order::Operation decodeOperation(uint8_t operation)
+{
+	if(operation == 0)
+		return Order::Operation::Buy;
+	else if(operation == 1)
+		return Order::Operation::Sell;
+	BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unknown operation specified: " + std::to_string(operation)));
+}
+
+static uint8_t encodeOperation(Order::Operation operation)
+{
+	return operation == Order::Operation::Buy ? 0 : 1;
+}
+
+void BinaryEncoder::newOrder(const Order& order, std::vector<cppio::Message>& out)
+{
+	BinaryNewOrder packet;
+	packet.messageId = (uint32_t)BinaryMessageId::NewOrder;
+	packet.id = order.clientAssignedId();
+	packet.account = symbol(order.account(), out);
+	packet.security = symbol(order.security(), out);
+	packet.price = order.price();
+	packet.quantity = order.quantity();
+	packet.operation = encodeOperation(order.operation());
+	packet.type = order.type() == Order::OrderType::Limit ? 1 : 0;
+
+	auto signalId = order.signalId();
+	packet.strategy = symbol(signalId.strategyId, out);
+
+	cppio::Message msg;
+	msg << (uint32_t)MessageType::Binary;
+	msg << packet;
+	if(!signalId.signalId.empty() || !signalId.comment.empty())
+	{
+		msg << signalId.signalId;
+		msg << signalId.comment;
+	}
+	out.push_back(std::move(msg));
+}
+
+void BinaryEncoder::cancelOrder(const Order& order, std::vector<cppio::Message>& out)
+{
+	BinaryCancelOrder packet;
+	packet.messageId = (uint32_t)BinaryMessageId::CancelOrder;
+	packet.id = order.clientAssignedId();
+	packet.account = symbol(order.account(), out);
+
+	cppio::Message msg;
+	msg << (uint32_t)MessageType::Binary;
+	msg << packet;
+	out.push_back(std::move(msg));
+}
+
+void BinaryEncoder::result(bool success, const std::string& reason, std::vector<cppio::Message>& out)
+{
+	BinaryResult packet;
+	packet.messageId = (uint32_t)BinaryMessageId::Result;
+	packet.success = success ? 1 : 0;
+
+	cppio::Message msg;
+	msg << (uint32_t)MessageType::Binary;
+	msg << packet;
+	if(!reason.empty())
+		msg << reason;
+	out.push_back(std::move(msg));
+}
+
+void BinaryEncoder::orderState(int id, Order::State state, std::vector<cppio::Message>& out)
+{
+	BinaryOrderState packet;
+	packet.messageId = (uint32_t)BinaryMessageId::OrderState;
+	packet.id = id;
+	packet.state = (uint32_t)state;
+
+	cppio::Message msg;
+	msg << (uint32_t)MessageType::Binary;
+	msg << packet;
+	out.push_back(std::move(msg));
+}
+
+void BinaryEncoder::trade(const Trade& trade, std::vector<cppio::Message>& out)
+{
+	BinaryTrade packet;
+	packet.messageId = (uint32_t)BinaryMessageId::Trade;
+	packet.orderId = trade.orderId;
+	packet.price = trade.price;
+	packet.quantity = trade.quantity;
+	packet.volume = trade.volume;
+	packet.volumeCurrency = symbol(trade.volumeCurrency, out);
+	packet.operation = encodeOperation(trade.operation);
+	packet.account = symbol(trade.account, out);
+	packet.security = symbol(trade.security, out);
+	packet.timestamp = trade.timestamp;
+	packet.useconds = trade.useconds;
+	packet.strategy = symbol(trade.signalId.strategyId, out);
+
+	cppio::Message msg;
+	msg << (uint32_t)MessageType::Binary;
+	msg << packet;
+	if(!trade.signalId.signalId.empty() || !trade.signalId.comment.empty())
+	{
+		msg << trade.signalId.signalId;
+		msg << trade.signalId.comment;
+	}
+	out.push_back(std::move(msg));
+}
+
+void BinaryEncoder::reset()
+{
+	m_symbols.clear();
+}
+
+uint32_t BinaryEncoder::symbol(const std::string& str, std::vector<cppio::Message>& out)
+{
+	if(str.empty())
+		return 0;
+
+	auto it = m_symbols.find(str);
+	if(it != m_symbols.end())
+		return it->second;
+
+	uint32_t id = m_symbols.size() + 1;
+	m_symbols.emplace(str, id);
+
+	BinaryDefineSymbol packet;
+	packet.messageId = (uint32_t)BinaryMessageId::DefineSymbol;
+	packet.symbol = id;
+
+	cppio::Message msg;
+	msg << (uint32_t)MessageType::Binary;
+	msg << packet;
+	msg << str;
+	out.push_back(std::move(msg));
+	return id;
+}
+
+BinaryDecoder::BinaryDecoder()
+{
+	reset();
+}
+
+BinaryMessageId BinaryDecoder::messageId(const cppio::Message& msg)
+{
+	if((msg.size() < 2) || (msg.frame(1).size() < sizeof(uint32_t)))
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Malformed binary message"));
+
+	uint32_t id;
+	memcpy(&id, msg.frame(1).data(), sizeof(id));
+	return (BinaryMessageId)id;
+}
+
+void BinaryDecoder::defineSymbol(const cppio::Message& msg)
+{
+	auto packet = getStruct<BinaryDefineSymbol>(msg);
+	if((packet.symbol != m_symbols.size()) || (msg.size() < 3))
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid symbol definition: " + std::to_string(packet.symbol)));
+	m_symbols.push_back(msg.get<std::string>(2));
+}
+
+Order::Ptr BinaryDecoder::newOrder(const cppio::Message& msg)
+{
+	auto packet = getStruct<BinaryNewOrder>(msg);
+
+	Order::OrderType type;
+	if(packet.type == 0)
+		type = Order::OrderType::Market;
+	else if(packet.type == 1)
+		type = Order::OrderType::Limit;
+	else
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unknown order type specified: " + std::to_string(packet.type)));
+
+	auto order = std::make_shared<Order>(packet.id, lookup(packet.account), lookup(packet.security), packet.price,
+			packet.quantity, decodeOperation(packet.operation), type);
+	order->setSignalId(SignalId(lookup(packet.strategy), optionalString(msg, 2), optionalString(msg, 3)));
+	return order;
+}
+
+int BinaryDecoder::cancelOrder(const cppio::Message& msg)
+{
+	return getStruct<BinaryCancelOrder>(msg).id;
+}
+
+bool BinaryDecoder::result(const cppio::Message& msg, std::string& reason)
+{
+	auto packet = getStruct<BinaryResult>(msg);
+	reason = optionalString(msg, 2);
+	return packet.success != 0;
+}
+
+void BinaryDecoder::orderState(const cppio::Message& msg, int& id, Order::State& state)
+{
+	auto packet = getStruct<BinaryOrderState>(msg);
+	if(packet.state > (uint32_t)Order::State::Error)
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid order state: " + std::to_string(packet.state)));
+	id = packet.id;
+	state = (Order::State)packet.state;
+}
+
+Trade BinaryDecoder::trade(const cppio::Message& msg)
+{
+	auto packet = getStruct<BinaryTrade>(msg);
+
+	Trade trade;
+	trade.orderId = packet.orderId;
+	trade.price = packet.price;
+	trade.quantity = packet.quantity;
+	trade.volume = packet.volume;
+	trade.volumeCurrency = lookup(packet.volumeCurrency);
+	trade.operation = decodeOperation(packet.operation);
+	trade.account = lookup(packet.account);
+	trade.security = lookup(packet.security);
+	trade.timestamp = packet.timestamp;
+	trade.useconds = packet.useconds;
+	trade.signalId = SignalId(lookup(packet.strategy), optionalString(msg, 2), optionalString(msg, 3));
+	return trade;
+}
+
+void BinaryDecoder::reset()
+{
+	m_symbols.clear();
+	m_symbols.push_back(std::string());
+}
+
+const std::string& BinaryDecoder::lookup(uint32_t symbol) const
+{
+	if(symbol >= m_symbols.size())
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Unknown symbol: " + std::to_string(symbol)));
+	return m_symbols[symbol];
+}
+
+}
@@ -0,0 +1,148 @@
+
+#ifndef BROKER_BINARYPROTOCOL_H_
+#define BROKER_BINARYPROTOCOL_H_
+
+#include "broker.h"
+
+#include "cppio/message.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace goldmine
+{
+
+/*
+ * Binary encoding of broker messages, negotiated at get-identity (see doc/goldmine-protocol.md).
+ *
+ * A message is [MessageType::Binary][fixed-layout struct][optional string frames]. Strings that repeat
+ * (accounts, securities, strategies, currencies) are interned: every side assigns ids to the strings it
+ * sends and defines each id with a DefineSymbol message before its first use. Symbol 0 is the empty string.
+ */
+
+enum class BinaryMessageId : uint32_t
+{
+	DefineSymbol = 0x01,
+	NewOrder = 0x02,
+	CancelOrder = 0x03,
+	Result = 0x04,
+	OrderState = 0x05,
+	Trade = 0x06
+};
+
+#pragma pack(push, 1)
+// Frame 2: symbol string
+struct BinaryDefineSymbol
+{
+	uint32_t messageId;
+	uint32_t symbol;
+};
+
+// Frames 2 and 3: signal id and comment, both optional
+struct BinaryNewOrder
+{
+	uint32_t messageId;
+	int32_t id;
+	uint32_t account;
+	uint32_t security;
+	double price;
+	int32_t quantity;
+	uint8_t operation; // 0 - buy, 1 - sell
+	uint8_t type; // 0 - market, 1 - limit
+	uint32_t strategy;
+};
+
+struct BinaryCancelOrder
+{
+	uint32_t messageId;
+	int32_t id;
+	uint32_t account;
+};
+
+// Frame 2: error reason, optional
+struct BinaryResult
+{
+	uint32_t messageId;
+	uint32_t success;
+};
+
+struct BinaryOrderState
+{
+	uint32_t messageId;
+	int32_t id;
+	uint32_t state; // Order::State
+};
+
+// Frames 2 and 3: signal id and comment, both optional
+struct BinaryTrade
+{
+	uint32_t messageId;
+	int32_t orderId;
+	double price;
+	int32_t quantity;
+	double volume;
+	uint32_t volumeCurrency;
+	uint8_t operation;
+	uint32_t account;
+	uint32_t security;
+	uint64_t timestamp;
+	uint32_t useconds;
+	uint32_t strategy;
+};
+#pragma pack(pop)
+
+// Name of the encoding in the get-identity negotiation
+static const char* const BinaryEncodingName = "binary";
+
+class BinaryEncoder
+{
+public:
+	/*
+	 * Every call appends the message to `out`, preceded by definitions of symbols
+	 * that have not been sent on this connection yet.
+	 */
+	void newOrder(const Order& order, std::vector<cppio::Message>& out);
+	void cancelOrder(const Order& order, std::vector<cppio::Message>& out);
+	void result(bool success, const std::string& reason, std::vector<cppio::Message>& out);
+	void orderState(int id, Order::State state, std::vector<cppio::Message>& out);
+	void trade(const Trade& trade, std::vector<cppio::Message>& out);
+
+	// Should be called for a new connection
+	void reset();
+
+private:
+	uint32_t symbol(const std::string& str, std::vector<cppio::Message>& out);
+
+	std::unordered_map<std::string, uint32_t> m_symbols;
+};
+
+/*
+ * Decoding functions throw ProtocolError on malformed messages and on unknown symbols.
+ */
+class BinaryDecoder
+{
+public:
+	BinaryDecoder();
+
+	static BinaryMessageId messageId(const cppio::Message& msg);
+
+	void defineSymbol(const cppio::Message& msg);
+	Order::Ptr newOrder(const cppio::Message& msg);
+	int cancelOrder(const cppio::Message& msg);
+	bool result(const cppio::Message& msg, std::string& reason);
+	void orderState(const cppio::Message& msg, int& id, Order::State& state);
+	Trade trade(const cppio::Message& msg);
+
+	// Should be called for a new connection
+	void reset();
+
+private:
+	const std::string& lookup(uint32_t symbol) const;
+
+	std::vector<std::string> m_symbols;
+};
+
+}
+
+#endif /* BROKER_BINARYPROTOCOL_H_ */
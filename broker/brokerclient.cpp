@@ -1,4 +1,7 @@
 #include "brokerclient.h"
+#include "orderarchive.h"
+#include "binaryprotocol.h"
+#include "jsoncodec.h"
 
 #include "goldmine/data.h"
 
@@ -11,65 +14,19 @@
 #include "json/json.h"
 
 #include <boost/thread.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <unordered_map>
 
 namespace goldmine
 {
 
-using namespace boost::posix_time;
-using namespace boost::gregorian;
-
-static Order::State deserializeOrderState(const std::string& str)
-{
-	if(str == "cancelled")
-		return Order::State::Cancelled;
-	else if(str == "executed")
-		return Order::State::Executed;
-	else if(str == "partially-executed")
-		return Order::State::PartiallyExecuted;
-	else if(str == "rejected")
-		return Order::State::Rejected;
-	else if(str == "submitted")
-		return Order::State::Submitted;
-	else if(str == "unsubmitted")
-		return Order::State::Unsubmitted;
-	else if(str == "error")
-		return Order::State::Error;
-	else
-		return (Order::State)(-1);
-}
-
-std::string serializeOrderType(Order::OrderType t)
-{
-	switch(t)
-	{
-	case Order::OrderType::Limit:
-		return "limit";
-	case Order::OrderType::Market:
-		return "market";
-	default:
-		return "unknown";
-	}
-}
-
-std::string serializeOperation(Order::Operation op)
-{
-	switch(op)
-	{
-	case Order::Operation::Buy:
-		return "buy";
-	case Order::Operation::Sell:
-		return "sell";
-	default:
-		return "unknown";
-	}
-}
-
 struct BrokerClient::Impl
 {
 	Impl(const std::shared_ptr<cppio::IoLineManager> man, const std::string& addr) : manager(man),
 	address(addr),
-	run(false)
+	run(false),
+	binaryProtocol(true),
+	binary(false)
 	{
 	}
 
@@ -105,58 +62,73 @@ struct BrokerClient::Impl
 
 	void submitOrder(const Order::Ptr& order)
 	{
-		Json::Value root;
-		Json::Value ord;
-		ord["id"] = order->clientAssignedId();
-		ord["account"] = order->account();
-		ord["security"] = order->security();
-		ord["type"] = serializeOrderType(order->type());
-		ord["operation"] = serializeOperation(order->operation());
-		ord["quantity"] = order->quantity();
-		ord["price"] = order->price();
-		if(!order->signalId().strategyId.empty())
-			ord["strategy"] = order->signalId().strategyId;
-		if(!order->signalId().signalId.empty())
-			ord["signal-id"] = order->signalId().signalId;
-		if(!order->signalId().comment.empty())
-			ord["comment"] = order->signalId().comment;
-		root["order"] = ord;
-
-		Json::FastWriter writer;
-		cppio::Message msg;
-		msg << (uint32_t)MessageType::Control;
-		msg << writer.write(root);
-
-		cppio::MessageProtocol proto(line.get());
-		size_t retcode;
-		do
+		// State updates may come before sendMessage returns
 		{
-			retcode = proto.sendMessage(msg);
-			if(retcode != 1)
-				boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
-		} while(retcode != 1); // Wait until event thread reconnects
+			boost::unique_lock<boost::mutex> lock(ordersMutex);
+			orders[order->clientAssignedId()] = order;
+		}
 
+		while(true)
 		{
-			boost::unique_lock<boost::mutex> lock(ordersMutex);
-			orders.push_back(order);
+			{
+				boost::unique_lock<boost::mutex> lock(sendMutex);
+				outgoing.clear();
+				if(binary)
+					encoder.newOrder(*order, outgoing);
+				else
+					outgoing.push_back(serializeOrder(order));
+
+				if(sendOutgoing())
+					break;
+			}
+			boost::this_thread::sleep_for(boost::chrono::milliseconds(100)); // Wait until event thread reconnects
 		}
 	}
 
-	void cancelOrder(const Order::Ptr& order)
+	// Should be called with sendMutex held
+	cppio::Message serializeOrder(const Order::Ptr& order)
 	{
-		Json::Value root;
-		Json::Value ord;
-		ord["id"] = order->clientAssignedId();
-		ord["account"] = order->account();
-		root["cancel-order"] = ord;
+		writeOrder(writer, *order);
 
-		Json::FastWriter writer;
 		cppio::Message msg;
 		msg << (uint32_t)MessageType::Control;
-		msg << writer.write(root);
+		msg << writer.str();
+		return msg;
+	}
+
+	void cancelOrder(const Order::Ptr& order)
+	{
+		boost::unique_lock<boost::mutex> lock(sendMutex);
+		outgoing.clear();
+		if(binary)
+		{
+			encoder.cancelOrder(*order, outgoing);
+		}
+		else
+		{
+			writeCancelOrder(writer, *order);
+
+			cppio::Message msg;
+			msg << (uint32_t)MessageType::Control;
+			msg << writer.str();
+			outgoing.push_back(msg);
+		}
+		sendOutgoing();
+	}
+
+	// Should be called with sendMutex held
+	bool sendOutgoing()
+	{
+		if(!line)
+			return false;
 
 		cppio::MessageProtocol proto(line.get());
-		proto.sendMessage(msg);
+		for(const auto& msg : outgoing)
+		{
+			if(proto.sendMessage(msg) != 1)
+				return false;
+		}
+		return true;
 	}
 
 	void setIdentity(const std::string& identity)
@@ -183,9 +155,16 @@ struct BrokerClient::Impl
 
 				if(id.empty())
 				{
+					{
+						boost::unique_lock<boost::mutex> lock(sendMutex);
+						binary = false;
+					}
+
 					{
 						Json::Value request;
 						request["command"] = "get-identity";
+						if(binaryProtocol)
+							request["encodings"].append(BinaryEncodingName);
 
 						Json::FastWriter writer;
 						cppio::Message msg;
@@ -206,6 +185,16 @@ struct BrokerClient::Impl
 						reader.parse(json, root);
 
 						id = root["identity"].asString();
+						{
+							boost::unique_lock<boost::mutex> lock(sendMutex);
+							binary = root["encoding"].asString() == BinaryEncodingName;
+							encoder.reset();
+							decoder.reset();
+						}
+						{
+							boost::unique_lock<boost::mutex> lock(ordersMutex);
+							retiredOrders.setArchive(orderArchive, id);
+						}
 						while(run)
 						{
 							cppio::Message inMessage;
@@ -213,12 +202,25 @@ struct BrokerClient::Impl
 
 							if(rc > 0)
 							{
-								handleMessage(inMessage);
+								try
+								{
+									handleMessage(inMessage);
+								}
+								catch(const LibGoldmineException& e)
+								{
+									// Malformed message or unknown symbol: the message is dropped
+								}
 							}
 							else if(rc != cppio::eTimeout)
 							{
 								break;
 							}
+
+							if(retention.maxAge.count() > 0)
+							{
+								boost::unique_lock<boost::mutex> lock(ordersMutex);
+								retiredOrders.expire();
+							}
 						}
 					}
 				}
@@ -229,86 +231,98 @@ struct BrokerClient::Impl
 
 	void handleMessage(const cppio::Message& msg)
 	{
-		auto json = msg.get<std::string>(1);
-		Json::Reader reader;
-		Json::Value root;
-		reader.parse(json, root);
-		if(!root["order"].isNull())
+		if(msg.get<uint32_t>(0) == (uint32_t)MessageType::Binary)
 		{
-			int id = root["order"]["id"].asInt();
+			handleBinaryMessage(msg);
+			return;
+		}
 
-			std::vector<Order::Ptr>::iterator it;
-			std::vector<Order::Ptr>::iterator endIt;
-			{
-				endIt = orders.end();
-				boost::unique_lock<boost::mutex> lock(ordersMutex);
-				it = std::find_if(orders.begin(), orders.end(), [&](const Order::Ptr& order) { return order->clientAssignedId() == id; } );
-			}
-			if(it != endIt)
-			{
-				(*it)->updateState(deserializeOrderState(root["order"]["new-state"].asString()));
-				auto msg = root["order"]["message"].asString();
-				if(!msg.empty())
-					(*it)->setMessage(msg);
-				for(const auto& reactor : reactors)
-				{
-					reactor->orderCallback(*it);
-				}
+		const auto& frame = msg.frame(1);
+		JsonReader reader((const char*)frame.data(), frame.size());
+		if((reader.next() != JsonReader::Token::BeginObject) || (reader.next() != JsonReader::Token::Key))
+			return;
 
-				for(const auto& reactor : boostReactors)
-				{
-					reactor->orderCallback(*it);
-				}
-			}
+		if(reader.string() == "order")
+		{
+			int orderId;
+			Order::State state;
+			readOrderState(reader, orderId, state, incomingMessage);
+			orderStateChanged(orderId, state, incomingMessage);
 		}
-		else if(!root["trade"].isNull())
+		else if(reader.string() == "trade")
 		{
-			auto trade = deserializeTrade(root["trade"]);
-			for(const auto& reactor : reactors)
-			{
-				reactor->tradeCallback(trade);
-			}
-			for(const auto& reactor : boostReactors)
-			{
-				reactor->tradeCallback(trade);
-			}
+			readTrade(reader, incomingTrade);
+			tradeReceived(incomingTrade);
 		}
 	}
 
-	Trade deserializeTrade(const Json::Value& json)
+	void handleBinaryMessage(const cppio::Message& msg)
 	{
-		Trade trade;
-		trade.orderId = json["order-id"].asInt();
-		trade.price = json["price"].asDouble();
-		trade.quantity = json["quantity"].asInt();
-
-		trade.signalId.strategyId = json["strategy"].asString();
-		trade.signalId.signalId = json["signal-id"].asString();
-		trade.signalId.comment= json["order-comment"].asString();
-
-		auto opString = json["operation"].asString();
-		if(opString == "buy")
-			trade.operation = Order::Operation::Buy;
-		else if(opString == "sell")
-			trade.operation = Order::Operation::Sell;
-		else
-			BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid operation specified: " + opString));
-
-		trade.account = json["account"].asString();
-		trade.security = json["security"].asString();
+		switch(BinaryDecoder::messageId(msg))
+		{
+		case BinaryMessageId::DefineSymbol:
+			decoder.defineSymbol(msg);
+			break;
+		case BinaryMessageId::OrderState:
+		{
+			int orderId;
+			Order::State state;
+			decoder.orderState(msg, orderId, state);
+			orderStateChanged(orderId, state, std::string());
+			break;
+		}
+		case BinaryMessageId::Trade:
+			tradeReceived(decoder.trade(msg));
+			break;
+		default:
+			break;
+		}
+	}
 
-		int year, month, day, hour, minute, second, msec;
+	void orderStateChanged(int orderId, Order::State state, const std::string& message)
+	{
+		Order::Ptr order;
+		{
+			boost::unique_lock<boost::mutex> lock(ordersMutex);
+			auto it = orders.find(orderId);
+			if(it != orders.end())
+				order = it->second;
+		}
+		if(!order)
+			return;
 
-		sscanf(json["execution-time"].asString().c_str(), "%d-%d-%d %d:%d:%d.%d",
-				&year, &month, &day,
-				&hour, &minute, &second, &msec);
+		order->updateState(state);
+		if(!message.empty())
+			order->setMessage(message);
+		for(const auto& reactor : reactors)
+		{
+			reactor->orderCallback(order);
+		}
 
-		ptime t(date(year, month, day), time_duration(hour, minute, second));
+		for(const auto& reactor : boostReactors)
+		{
+			reactor->orderCallback(order);
+		}
 
-		trade.timestamp = (t - ptime(date(1970, 1, 1), time_duration(0, 0, 0, 0))).total_seconds();
-		trade.useconds = msec * 1000;
+		if((state == Order::State::Executed) || (state == Order::State::Cancelled) ||
+				(state == Order::State::Rejected) || (state == Order::State::Error))
+		{
+			boost::unique_lock<boost::mutex> lock(ordersMutex);
+			orders.erase(orderId);
+			retiredOrders.add(order);
+		}
+	}
 
-		return trade;
+	void tradeReceived(const Trade& trade)
+	{
+		for(const auto& reactor : reactors)
+		{
+			reactor->tradeCallback(trade);
+		}
+		for(const auto& reactor : boostReactors)
+		{
+			reactor->tradeCallback(trade);
+		}
 	}
 
 	std::string id;
@@ -319,8 +333,23 @@ struct BrokerClient::Impl
 	std::shared_ptr<cppio::IoLine> line;
 	std::vector<Reactor::Ptr> reactors;
 	std::vector<boost::shared_ptr<Reactor>> boostReactors;
-	std::vector<Order::Ptr> orders;
+	std::unordered_map<int, Order::Ptr> orders; // working orders by client-assigned id
+	RetiredOrders retiredOrders;
+	RetentionPolicy retention;
+	OrderArchive::Ptr orderArchive;
 	boost::mutex ordersMutex;
+
+	bool binaryProtocol;
+	bool binary; // negotiated for the current connection
+	BinaryEncoder encoder;
+	BinaryDecoder decoder; // used by the event thread only
+	std::vector<cppio::Message> outgoing;
+	JsonWriter writer;
+	boost::mutex sendMutex;
+
+	// Reused by the event thread
+	std::string incomingMessage;
+	Trade incomingTrade;
 };
 
 BrokerClient::BrokerClient(const std::shared_ptr<cppio::IoLineManager>& manager, const std::string& address) :
@@ -382,5 +411,25 @@ std::string BrokerClient::identity() const
 	return m_impl->identity();
 }
 
+void BrokerClient::setBinaryProtocol(bool enabled)
+{
+	m_impl->binaryProtocol = enabled;
+}
+
+void BrokerClient::setRetention(const RetentionPolicy& policy)
+{
+	boost::unique_lock<boost::mutex> lock(m_impl->ordersMutex);
+	m_impl->retention = policy;
+	m_impl->retiredOrders.setPolicy(policy);
+}
+
+void BrokerClient::setOrderArchive(const std::string& path)
+{
+	auto archive = std::make_shared<OrderArchive>(path);
+	boost::unique_lock<boost::mutex> lock(m_impl->ordersMutex);
+	m_impl->orderArchive = archive;
+	m_impl->retiredOrders.setArchive(archive, m_impl->id);
+}
+
 }
 
@@ -3,6 +3,7 @@
 #define BROKERCLIENT_H
 
 #include "broker.h"
+#include "orderarchive.h"
 
 #include "cppio/iolinemanager.h"
 
@@ -44,6 +45,19 @@ public:
 	void setIdentity(const std::string& id);
 	std::string identity() const;
 
+	/*
+	 * Should be called before start. Binary encoding is offered to the server by default,
+	 * JSON is used if the server does not support it.
+	 */
+	void setBinaryProtocol(bool enabled);
+
+	/*
+	 * Should be called before start. Orders in a final state are kept according to `policy`,
+	 * evicted ones are written to the archive at `path`, if it is set.
+	 */
+	void setRetention(const RetentionPolicy& policy);
+	void setOrderArchive(const std::string& path);
+
 private:
 	struct Impl;
 	std::unique_ptr<Impl> m_impl;
@@ -1,5 +1,8 @@
 
 #include "brokerserver.h"
+#include "orderarchive.h"
+#include "binaryprotocol.h"
+#include "jsoncodec.h"
 
 #include "cppio/iolinemanager.h"
 #include "cppio/message.h"
@@ -7,132 +10,176 @@
 #include "json/json.h"
 
 #include "goldmine/exceptions.h"
+#include "goldmine/busypoll.h"
+#include "goldmine/nonblockingread.h"
 
-#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
+#include <algorithm>
 #include <array>
-#include <queue>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
 
 namespace goldmine
 {
 
-static std::string serializeOrderState(Order::State state)
+static const size_t DefaultWorkerThreads = 2;
+
+static const size_t DefaultWriterThreads = 2;
+
+// Messages read from one client per pass of a worker, so that a busy client does not starve others
+static const size_t MaxMessagesPerPass = 16;
+
+// Read timeout of client reader threads, which bounds the time it takes one to stop
+static const int ReaderReceiveTimeout = 100; // ms
+
+// Messages a client reader thread reads ahead of the worker
+static const size_t MaxReadAhead = 4 * MaxMessagesPerPass;
+
+// Orders in a final state that are still routed to their clients, waiting for late trades
+static const size_t MaxRetiredRoutes = 65536;
+
+// Batches sent to the trade sink and not acknowledged yet; more trades wait in the queue
+static const size_t MaxTradeBatchesInFlight = 4;
+static const size_t MaxTradesPerBatch = 1024;
+
+// The trade sink is sent a heartbeat only if it has been idle for that long
+static const boost::chrono::milliseconds TradeSinkHeartbeatInterval(1000);
+
+// Unacknowledged batches or an unanswered heartbeat make the sink connection be reestablished after that time
+static const boost::chrono::milliseconds TradeSinkReplyTimeout(10000);
+
+static const boost::chrono::milliseconds TradeSinkReconnectInterval(10000);
+
+// Acknowledgements are polled for between batches, so that new trades are not held up by them
+static const int TradeSinkAckPollInterval = 10; // ms
+
+// Unless busy-poll is configured, an idle worker spins for a while and then sleeps between passes
+static BusyPollPolicy workerIdlePolicy()
 {
-	switch(state)
-	{
-	case Order::State::Cancelled:
-		return "cancelled";
-	case Order::State::Executed:
-		return "executed";
-	case Order::State::PartiallyExecuted:
-		return "partially-executed";
-	case Order::State::Rejected:
-		return "rejected";
-	case Order::State::Submitted:
-		return "submitted";
-	case Order::State::Unsubmitted:
-		return "unsubmitted";
-	case Order::State::Error:
-		return "error";
-	}
-	return "unknown";
+	BusyPollPolicy policy;
+	policy.spinRounds = 100;
+	policy.yieldRounds = 0;
+	policy.sleepInterval = boost::chrono::microseconds(1000);
+	return policy;
 }
 
-static std::string serializeExecutionTime(time_t timestamp, int useconds)
+static bool isFinalState(Order::State state)
 {
-	using namespace boost::posix_time;
-	using namespace boost::gregorian;
-	auto timePoint = from_time_t(timestamp) + microseconds(useconds);
-	std::array<char, 256> buf;
-	snprintf(buf.data(), 256, "%d-%02d-%02d %02d:%02d:%02d.%03d",
-			(int)timePoint.date().year(),
-			(int)timePoint.date().month(),
-			(int)timePoint.date().day(),
-			(int)timePoint.time_of_day().hours(),
-			(int)timePoint.time_of_day().minutes(),
-			(int)timePoint.time_of_day().seconds(),
-			(int)(1000ull * (double)timePoint.time_of_day().fractional_seconds() / timePoint.time_of_day().ticks_per_second()));
-
-	return std::string(buf.data());
+	return (state == Order::State::Executed) || (state == Order::State::Cancelled) ||
+			(state == Order::State::Rejected) || (state == Order::State::Error);
 }
 
-
 struct BrokerServer::Impl : public Broker::Reactor
 {
-	class Client
+	class Writer;
+
+	class Client : public std::enable_shared_from_this<Client>
 	{
 	public:
 		using Ptr = std::shared_ptr<Client>;
 
-		Client(const std::shared_ptr<cppio::IoLine>& ioLine, Impl* i) : line(ioLine),
+		Client(const std::shared_ptr<cppio::IoLine>& ioLine, Impl* i, Writer* w) : line(ioLine),
 			impl(i),
-			run(false)
+			binary(false),
+			binaryRequests(false),
+			notificationWriter(w),
+			notificationsScheduled(false),
+			flushing(false),
+			overflowed(false),
+			closed(false),
+			threadedReads(i->clientReceiveTimeout != 0),
+			readerRun(false),
+			lineLost(false)
 		{
+			// The worker reads the line itself only if reads return at once, see nonBlockingReceiveTimeout
+			int timeout = threadedReads ? ReaderReceiveTimeout : 0;
+			line->setOption(cppio::LineOption::ReceiveTimeout, &timeout);
+			retiredOrders.setPolicy(impl->retention);
 		}
 
+		// Starts the reader thread if the line needs one
 		void start()
 		{
-			thread = boost::thread(std::bind(&Client::eventLoop, this));
+			if(!threadedReads)
+				return;
+			readerRun = true;
+			reader = boost::thread(std::bind(&Client::readerLoop, this));
 		}
 
-		void stop()
+		/*
+		 * Handles messages that have already arrived, at most MaxMessagesPerPass of them, without waiting.
+		 * A client whose notification queue is half full is not read until the writer catches up, so that
+		 * replies to its requests do not fill the queue. Returns false if the connection is lost or
+		 * the client is to be disconnected for falling behind, see enqueue().
+		 */
+		bool poll(size_t& handled)
 		{
-			run = false;
-		}
-
-		void join()
-		{
-			if(thread.joinable())
-				thread.join();
-		}
-
-		void eventLoop()
-		{
-			run = true;
 			cppio::MessageProtocol proto(line.get());
-
-			while(run)
+			handled = 0;
 			{
+				boost::unique_lock<boost::mutex> lock(notificationMutex);
+				if(overflowed)
+					return false;
+				if(2 * notifications.size() >= impl->notificationQueueCapacity)
+					return true;
+			}
+			while(handled < MaxMessagesPerPass)
+			{
+				cppio::Message incoming;
+				ssize_t rc = threadedReads ? takeReceived(incoming) : proto.readMessage(incoming);
+				if(rc == cppio::eTimeout)
+					break;
+				else if(rc <= 0)
+					return false;
+
+				handled++;
 				try
 				{
-					cppio::Message incoming;
-					ssize_t rc = proto.readMessage(incoming);
-
-					if(rc > 0)
-					{
-						handleMessage(incoming, proto);
-					}
-					else if(rc != cppio::eTimeout)
-					{
-						run = false;
-					}
+					handleMessage(incoming);
 				}
 				catch(const LibGoldmineException& e)
 				{
-					Json::Value response;
-					response["result"] = "error";
 					auto errmsg = boost::get_error_info<errinfo_str>(e);
-					if(errmsg)
-						response["reason"] = *errmsg;
-
-					Json::FastWriter writer;
-					cppio::Message outgoing;
-					outgoing << (uint32_t)MessageType::Control;
-					outgoing << writer.write(response);
-
-					proto.sendMessage(outgoing);
+					sendResult(false, errmsg ? *errmsg : std::string());
 				}
 			}
+
+			if(impl->retention.maxAge.count() > 0)
+			{
+				boost::unique_lock<boost::mutex> lock(orderListMutex);
+				retiredOrders.expire();
+			}
+			return true;
 		}
 
-		void handleMessage(const cppio::Message& incoming, cppio::MessageProtocol& proto)
+		void handleMessage(const cppio::Message& incoming)
 		{
 			int messageType = incoming.get<uint32_t>(0);
 			if(messageType == (int)MessageType::Control)
 			{
+				// Orders and cancels are read by the streaming codec, rare commands go through Json::Reader
+				const auto& frame = incoming.frame(1);
+				JsonReader request((const char*)frame.data(), frame.size());
+				if(request.next() != JsonReader::Token::BeginObject)
+					BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Unable to parse incoming JSON: object expected"));
+				if(request.next() == JsonReader::Token::Key)
+				{
+					if(request.string() == "order")
+					{
+						acceptOrder(readOrder(request));
+						return;
+					}
+					else if(request.string() == "cancel-order")
+					{
+						acceptCancel(readCancelOrder(request));
+						return;
+					}
+				}
+
 				Json::Value root;
 				Json::Reader reader;
 				if(!reader.parse(incoming.get<std::string>(1), root))
@@ -144,89 +191,112 @@ struct BrokerServer::Impl : public Broker::Reactor
 					if(command.asString() == "get-identity")
 					{
 						identity = impl->generateNewIdentity();
+						{
+							boost::unique_lock<boost::mutex> lock(orderListMutex);
+							retiredOrders.setArchive(impl->orderArchive, identity);
+						}
 
-						Json::Value response;
-						response["identity"] = identity;
-						Json::FastWriter writer;
-						cppio::Message outgoing;
-						outgoing << (uint32_t)MessageType::Control;
-						outgoing << writer.write(response);
+						// Binary encoding is used from the next message on if the client supports it
+						bool useBinary = false;
+						for(const auto& encoding : root["encodings"])
+						{
+							if(encoding.asString() == BinaryEncodingName)
+								useBinary = true;
+						}
 
-						proto.sendMessage(outgoing);
+						// Goes through the writer as well, so that replies queued before it keep their encoding
+						Notification notification;
+						notification.type = Notification::Type::Identity;
+						notification.id = 0;
+						notification.success = useBinary;
+						notification.reason = identity;
+						enqueue(std::move(notification));
+
+						binaryRequests = useBinary;
+						decoder.reset();
 					}
 				}
-				else
+			}
+			else if(messageType == (int)MessageType::Binary)
+			{
+				if(!binaryRequests)
+					BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Binary encoding is not negotiated"));
+
+				switch(BinaryDecoder::messageId(incoming))
 				{
-					Json::Value order = root["order"];
-					if(!order.isNull())
-					{
-						if(identity.empty())
-						{
-							BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("No identity is set"));
-						}
-						else
-						{
-							auto orderObject = deserializeOrder(order);
+				case BinaryMessageId::DefineSymbol:
+					decoder.defineSymbol(incoming);
+					break;
+				case BinaryMessageId::NewOrder:
+					acceptOrder(decoder.newOrder(incoming));
+					break;
+				case BinaryMessageId::CancelOrder:
+					acceptCancel(decoder.cancelOrder(incoming));
+					break;
+				default:
+					BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Unexpected binary message"));
+				}
+			}
+		}
+
+		void acceptOrder(const Order::Ptr& order)
+		{
+			if(identity.empty())
+				BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("No identity is set"));
 
-							{
-								boost::unique_lock<boost::mutex> lock(orderListMutex);
-								auto it = std::find_if(clientOrders.begin(), clientOrders.end(), [&](const Order::Ptr& other) { return other->clientAssignedId() == orderObject->clientAssignedId();});
-								if(it != clientOrders.end())
-									BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Order with given id already exists: " + std::to_string(orderObject->clientAssignedId())));
-								clientOrders.push_back(orderObject);
-							}
+			auto dispatcher = impl->routes.find(order->account());
+			if(!dispatcher)
+				BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("No broker for account: " + order->account()));
 
-							Json::Value response;
-							response["result"] = "success";
+			{
+				boost::unique_lock<boost::mutex> lock(orderListMutex);
+				int id = order->clientAssignedId();
+				if((clientOrders.find(id) != clientOrders.end()) || retiredOrders.contains(id))
+					BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Order with given id already exists: " + std::to_string(id)));
+				clientOrders.emplace(id, order);
+			}
+			impl->orderIndex.insert(order, shared_from_this(), dispatcher);
 
-							Json::FastWriter writer;
-							cppio::Message outgoing;
-							outgoing << (uint32_t)MessageType::Control;
-							outgoing << writer.write(response);
+			sendResult(true, std::string());
+			dispatcher->submitOrder(order);
+		}
 
-							proto.sendMessage(outgoing);
+		void acceptCancel(int clientAssignedId)
+		{
+			if(identity.empty())
+				BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("No identity is set"));
 
-							impl->submitOrder(orderObject);
-						}
-					}
-					else if(!root["cancel-order"].isNull())
-					{
-						if(identity.empty())
-						{
-							BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("No identity is set"));
-						}
-						else
-						{
-							int clientAssignedId = root["cancel-order"]["id"].asInt();
-							std::vector<Order::Ptr>::iterator it = clientOrders.end();
-							{
-								boost::unique_lock<boost::mutex> lock(orderListMutex);
-								it = std::find_if(clientOrders.begin(), clientOrders.end(), [&](const Order::Ptr& other) { return other->clientAssignedId() == clientAssignedId;});
-								if(it == clientOrders.end())
-									BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Order with given id does not exists: " + std::to_string(clientAssignedId)));
-							}
-
-							Json::Value response;
-							response["result"] = "success";
-							Json::FastWriter writer;
-							cppio::Message outgoing;
-							outgoing << (uint32_t)MessageType::Control;
-							outgoing << writer.write(response);
-
-							proto.sendMessage(outgoing);
-							impl->cancelOrder(*it);
-						}
-					}
-				}
+			Order::Ptr order;
+			{
+				boost::unique_lock<boost::mutex> lock(orderListMutex);
+				auto it = clientOrders.find(clientAssignedId);
+				if(it == clientOrders.end())
+					BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Order with given id does not exists: " + std::to_string(clientAssignedId)));
+				order = it->second;
 			}
-		}
 
+			sendResult(true, std::string());
 
-		void tradeNotification(const Order::Ptr& order, const Trade& trade)
+			// Cancel goes to the broker the order was submitted to, even if the routes have changed since
+			OrderIndex::Entry entry;
+			if(impl->orderIndex.find(order->localId(), entry))
+				entry.dispatcher->cancelOrder(order);
+		}
+
+		// Result goes through the writer of the client, so the worker does not wait for a batch being sent
+		void sendResult(bool success, const std::string& reason)
 		{
-			Json::Value root;
-			serializeTrade(trade, root);
+			Notification notification;
+			notification.type = Notification::Type::Result;
+			notification.id = 0;
+			notification.success = success;
+			notification.reason = reason;
+			enqueue(std::move(notification));
+		}
 
+		// Should be called by the writer of the client
+		void sendJson(const Json::Value& root)
+		{
 			Json::FastWriter writer;
 			cppio::Message message;
 			message << (uint32_t)MessageType::Control;
@@ -234,18 +304,51 @@ struct BrokerServer::Impl : public Broker::Reactor
 
 			cppio::MessageProtocol proto(line.get());
 			proto.sendMessage(message);
+		}
+
+		// Should be called by the writer of the client
+		void sendWriter()
+		{
+			cppio::Message message;
+			message << (uint32_t)MessageType::Control;
+			message << writer.str();
+
+			cppio::MessageProtocol proto(line.get());
+			proto.sendMessage(message);
+		}
+
+		// Should be called by the writer of the client
+		void sendOutgoing()
+		{
+			cppio::MessageProtocol proto(line.get());
+			for(const auto& message : outgoing)
+				proto.sendMessage(message);
+		}
+
+		void tradeNotification(const Order::Ptr& order, const Trade& trade)
+		{
+			Notification notification;
+			notification.type = Notification::Type::Trade;
+			notification.id = order->clientAssignedId();
+			notification.trade = trade;
+			enqueue(std::move(notification));
 
 			order->setExecutedQuantity(order->executedQuantity() + trade.quantity);
 
-			if(order->executedQuantity() == order->quantity())
+			// A late trade of an order in a final state does not change the state
+			if(isFinalState(order->state()))
 			{
 				boost::unique_lock<boost::mutex> lock(orderListMutex);
-				auto it = std::find(clientOrders.begin(), clientOrders.end(), order);
-				if(it != clientOrders.end())
-				{
-					clientOrders.erase(it);
-					retiredOrders.push_back(order);
-				}
+				// If the final state is still to be reported, retire() takes care of the route
+				auto it = clientOrders.find(order->clientAssignedId());
+				bool working = (it != clientOrders.end()) && (it->second == order);
+				if(!working && (order->executedQuantity() >= order->quantity()))
+					impl->orderIndex.erase(order->localId());
+				return;
+			}
+
+			if(order->executedQuantity() == order->quantity())
+			{
 				order->updateState(Order::State::Executed);
 			}
 			else if(order->executedQuantity() < order->quantity())
@@ -260,115 +363,808 @@ struct BrokerServer::Impl : public Broker::Reactor
 			orderStateChanged(order);
 		}
 
-		Order::Ptr findOrderById(int id)
+		// Should be called with orderListMutex held
+		void retire(const Order::Ptr& order)
 		{
-			boost::unique_lock<boost::mutex> lock(orderListMutex);
-			auto it = std::find_if(clientOrders.begin(), clientOrders.end(), [=](const Order::Ptr& order)
-					{
-						return order->localId() == id;
-					});
-			if(it == clientOrders.end())
-				return Order::Ptr();
-			return *it;
-		}
-
-		Order::Ptr deserializeOrder(const Json::Value& order)
-		{
-			int id = order["id"].asInt();
-			auto account = order["account"].asString();
-			auto security = order["security"].asString();
-			auto price = order["price"].asDouble();
-			auto quantity = order["quantity"].asInt();
-			auto operationString = order["operation"].asString();
-			auto typeString = order["type"].asString();
-
-			auto strategyId = order["strategy"].asString();
-			auto signalId = order["signal-id"].asString();
-			auto comment = order["comment"].asString();
-
-			Order::Operation operation;
-			if(operationString == "buy")
-				operation = Order::Operation::Buy;
-			else if(operationString == "sell")
-				operation = Order::Operation::Sell;
+			auto it = clientOrders.find(order->clientAssignedId());
+			if((it == clientOrders.end()) || (it->second != order))
+				return;
+			clientOrders.erase(it);
+
+			// Trades may come after the final state: Executed may be reported ahead of the fill, or a fill may
+			// race a cancel. So the order is routed until it is filled, or until newer retired orders push it out.
+			if(order->executedQuantity() >= order->quantity())
+				impl->orderIndex.erase(order->localId());
 			else
-				BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unknown operation specified: " + operationString));
+				impl->orderIndex.retire(order->localId());
+
+			retiredOrders.add(order);
+		}
 
-			Order::OrderType type;
-			if(typeString == "market")
-				type = Order::OrderType::Market;
-			else if(typeString == "limit")
+		void orderStateChanged(const Order::Ptr& order)
+		{
+			Notification notification;
+			notification.type = Notification::Type::OrderState;
+			notification.id = order->clientAssignedId();
+			notification.state = order->state();
+			bool finalState = isFinalState(notification.state);
+			enqueue(std::move(notification));
+
+			// Same rule as BrokerClient: no more reports are expected for an order in a final state
+			if(finalState)
 			{
-				type = Order::OrderType::Limit;
-				if(order["price"].isNull())
-					BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("No price specified for limit order"));
+				boost::unique_lock<boost::mutex> lock(orderListMutex);
+				retire(order);
 			}
-			else
-				BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unknown order type specified: " + typeString));
-
-			auto brokerOrder = std::make_shared<Order>(id, account, security, price, quantity, operation, type);
-			brokerOrder->setSignalId(SignalId {strategyId, signalId, comment});
-			return brokerOrder;
 		}
 
-		bool ownsOrder(const Order::Ptr& order)
+		// Sends notifications queued so far, called by the writer of the client
+		void flushNotifications()
 		{
-			return findOrderById(order->localId()) != nullptr;
+			std::vector<Notification> batch;
+			{
+				boost::unique_lock<boost::mutex> lock(notificationMutex);
+				notificationsScheduled = false;
+				if(closed || overflowed)
+					return;
+				batch.swap(notifications);
+				lastNotification.clear();
+				flushing = true;
+			}
+
+			for(const auto& notification : batch)
+			{
+				if(notification.type == Notification::Type::Identity)
+				{
+					Json::Value response;
+					response["identity"] = notification.reason;
+					if(notification.success)
+						response["encoding"] = BinaryEncodingName;
+					sendJson(response);
+					binary = notification.success;
+					encoder.reset();
+				}
+				else if(binary)
+				{
+					outgoing.clear();
+					if(notification.type == Notification::Type::Result)
+						encoder.result(notification.success, notification.reason, outgoing);
+					else if(notification.type == Notification::Type::Trade)
+						encoder.trade(notification.trade, outgoing);
+					else
+						encoder.orderState(notification.id, notification.state, outgoing);
+					sendOutgoing();
+				}
+				else
+				{
+					if(notification.type == Notification::Type::Result)
+						writeResult(writer, notification.success, notification.reason);
+					else if(notification.type == Notification::Type::Trade)
+						writeTrade(writer, notification.trade);
+					else
+						writeOrderState(writer, notification.id, notification.state);
+					sendWriter();
+				}
+			}
+
+			// The line is released by whoever is the last to use it, see close()
+			{
+				boost::unique_lock<boost::mutex> lock(notificationMutex);
+				flushing = false;
+				if(!closed)
+					return;
+			}
+			line.reset();
 		}
 
-		void orderStateChanged(const Order::Ptr& order)
+		/*
+		 * Called by the worker when the connection is lost, the client falls behind or the server stops;
+		 * pending and later notifications are discarded. The line is closed here or, if the writer is sending
+		 * a batch, at the end of it. Working orders of the client are taken out of the order index, which
+		 * holds the client otherwise.
+		 */
+		void close()
 		{
-			Json::Value orderJson;
-			orderJson["id"] = order->clientAssignedId();
-			orderJson["new-state"] = serializeOrderState(order->state());;
-			Json::Value root;
-			root["order"] = orderJson;
+			{
+				boost::unique_lock<boost::mutex> lock(receivedMutex);
+				readerRun = false;
+				receivedCv.notify_all();
+			}
+			if(reader.joinable())
+				reader.join();
 
-			Json::FastWriter writer;
-			cppio::Message message;
-			message << (uint32_t)MessageType::Control;
-			message << writer.write(root);
+			bool releaseLine;
+			{
+				boost::unique_lock<boost::mutex> lock(notificationMutex);
+				closed = true;
+				notifications.clear();
+				lastNotification.clear();
+				releaseLine = !flushing;
+			}
+			if(releaseLine)
+				line.reset();
+
+			boost::unique_lock<boost::mutex> lock(orderListMutex);
+			for(const auto& order : clientOrders)
+				impl->orderIndex.erase(order.second->localId());
+			clientOrders.clear();
+		}
 
+	private:
+		struct Notification
+		{
+			enum class Type
+			{
+				OrderState,
+				Trade,
+				Result,
+				Identity // reply to get-identity, `success` tells if binary encoding is used after it
+			};
+
+			Type type;
+			int id; // client-assigned id of the order
+			Order::State state;
+			Trade trade;
+			bool success; // result of a client request
+			std::string reason; // or the identity
+		};
+
+		/*
+		 * Reads the line for a worker when its type has no non-blocking reads, so that the worker does not
+		 * wait on idle clients. Reads ahead by at most MaxReadAhead messages.
+		 */
+		void readerLoop()
+		{
 			cppio::MessageProtocol proto(line.get());
-			proto.sendMessage(message);
+			while(true)
+			{
+				{
+					boost::unique_lock<boost::mutex> lock(receivedMutex);
+					while(readerRun && (received.size() >= MaxReadAhead))
+						receivedCv.wait(lock);
+					if(!readerRun)
+						return;
+				}
+
+				cppio::Message incoming;
+				ssize_t rc = proto.readMessage(incoming);
+				if(rc == cppio::eTimeout)
+					continue;
+
+				boost::unique_lock<boost::mutex> lock(receivedMutex);
+				if(rc <= 0)
+				{
+					lineLost = true;
+					return;
+				}
+				received.push_back(std::move(incoming));
+			}
+		}
+
+		// Same results as MessageProtocol::readMessage, for messages read by the reader thread
+		ssize_t takeReceived(cppio::Message& incoming)
+		{
+			boost::unique_lock<boost::mutex> lock(receivedMutex);
+			if(received.empty())
+				return lineLost ? 0 : cppio::eTimeout;
+
+			incoming = std::move(received.front());
+			received.pop_front();
+			receivedCv.notify_all();
+			return 1;
 		}
 
+		/*
+		 * State change of an order that has a state change still queued, with no trade of the order after it,
+		 * replaces the queued one: a client that is behind gets the latest state rather than every step.
+		 * Trades and replies are queued as they are. Broker threads never wait for the writer: a notification
+		 * that finds the queue full, whatever its type, disconnects the client. Its queue is dropped and
+		 * the worker closes the connection on the next pass, see poll().
+		 */
+		void enqueue(Notification&& notification)
+		{
+			boost::unique_lock<boost::mutex> lock(notificationMutex);
+			if(closed || overflowed)
+				return;
+
+			if(notification.type == Notification::Type::OrderState)
+			{
+				auto it = lastNotification.find(notification.id);
+				if((it != lastNotification.end()) && (notifications[it->second].type == Notification::Type::OrderState))
+				{
+					notifications[it->second].state = notification.state;
+					return;
+				}
+			}
+
+			if(notifications.size() >= impl->notificationQueueCapacity)
+			{
+				overflowed = true;
+				notifications.clear();
+				lastNotification.clear();
+				return;
+			}
+
+			bool reply = (notification.type == Notification::Type::Result) || (notification.type == Notification::Type::Identity);
+			if(!reply)
+				lastNotification[notification.id] = notifications.size();
+			notifications.push_back(std::move(notification));
+			if(!notificationsScheduled)
+			{
+				notificationsScheduled = true;
+				lock.unlock();
+				notificationWriter->schedule(shared_from_this());
+			}
+		}
 
-	private:
 		std::shared_ptr<cppio::IoLine> line;
-		std::vector<Order::Ptr> clientOrders;
-		std::vector<Order::Ptr> retiredOrders;
+		std::unordered_map<int, Order::Ptr> clientOrders; // by client-assigned id
+		RetiredOrders retiredOrders; // ids of these are rejected as duplicates
 		boost::mutex orderListMutex;
 		Impl* impl;
-		boost::thread thread;
-		bool run;
 		std::string identity;
+
+		// Outgoing messages are sent by the writer of the client only
+		bool binary;
+		BinaryEncoder encoder;
+		bool binaryRequests; // used by the client thread only, as the decoder
+		BinaryDecoder decoder;
+		std::vector<cppio::Message> outgoing;
+		JsonWriter writer;
+
+		// Reactor callbacks queue notifications, the writer of the client sends them
+		Writer* notificationWriter;
+		boost::mutex notificationMutex;
+		std::vector<Notification> notifications;
+		std::unordered_map<int, size_t> lastNotification; // index of the last queued notification by order id
+		bool notificationsScheduled;
+		bool flushing; // the writer is sending a batch
+		bool overflowed; // the queue has been full, the client is to be disconnected
+		bool closed;
+
+		// Lines without non-blocking reads are read by a thread of their own, see readerLoop()
+		bool threadedReads;
+		boost::thread reader;
+		boost::mutex receivedMutex; // guards the fields below
+		boost::condition_variable receivedCv;
+		std::deque<cppio::Message> received;
+		bool readerRun;
+		bool lineLost;
+	};
+
+	/*
+	 * Outbound queue of a registered broker, drained by its own thread, so that a slow adapter does not hold up
+	 * the workers reading client connections or other brokers. Cancels go ahead of new orders; cancel of an order
+	 * that is still queued takes the order out of the queue and reports it cancelled without involving the broker.
+	 */
+	class Dispatcher
+	{
+	public:
+		using Ptr = std::shared_ptr<Dispatcher>;
+
+		Dispatcher(const Broker::Ptr& broker, Impl* impl) : m_broker(broker),
+			m_impl(impl),
+			m_run(false),
+			m_dispatchedOrders(0),
+			m_dispatchedCancels(0),
+			m_lastLag(0),
+			m_maxLag(0)
+		{
+		}
+
+		~Dispatcher()
+		{
+			stop();
+		}
+
+		const Broker::Ptr& broker() const
+		{
+			return m_broker;
+		}
+
+		void start()
+		{
+			m_run = true;
+			m_thread = boost::thread(std::bind(&Dispatcher::eventLoop, this));
+		}
+
+		// Requests queued so far are passed to the broker before the thread exits
+		void stop()
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				m_run = false;
+				m_cv.notify_one();
+			}
+			if(m_thread.joinable())
+				m_thread.join();
+		}
+
+		void submitOrder(const Order::Ptr& order)
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				if(m_run)
+				{
+					m_orders.push_back(Request { order, boost::chrono::steady_clock::now() });
+					m_cv.notify_one();
+					return;
+				}
+			}
+			m_broker->submitOrder(order);
+		}
+
+		void cancelOrder(const Order::Ptr& order)
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				if(m_run)
+				{
+					auto it = std::find_if(m_orders.begin(), m_orders.end(), [&](const Request& r) { return r.order == order; });
+					if(it == m_orders.end())
+					{
+						m_cancels.push_back(Request { order, boost::chrono::steady_clock::now() });
+						m_cv.notify_one();
+						return;
+					}
+					m_orders.erase(it);
+				}
+				else
+				{
+					lock.unlock();
+					m_broker->cancelOrder(order);
+					return;
+				}
+			}
+
+			m_dispatchedCancels++;
+			order->updateState(Order::State::Cancelled);
+			m_impl->orderCallback(order);
+		}
+
+		DispatchStats stats() const
+		{
+			DispatchStats result;
+			result.broker = m_broker;
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				result.pendingOrders = m_orders.size();
+				result.pendingCancels = m_cancels.size();
+			}
+			result.dispatchedOrders = m_dispatchedOrders.load();
+			result.dispatchedCancels = m_dispatchedCancels.load();
+			result.lastLagMicroseconds = m_lastLag.load();
+			result.maxLagMicroseconds = m_maxLag.load();
+			return result;
+		}
+
+	private:
+		struct Request
+		{
+			Order::Ptr order;
+			boost::chrono::steady_clock::time_point enqueued;
+		};
+
+		void eventLoop()
+		{
+			while(true)
+			{
+				Request request;
+				bool cancel;
+				{
+					boost::unique_lock<boost::mutex> lock(m_mutex);
+					while(m_run && m_orders.empty() && m_cancels.empty())
+						m_cv.wait(lock);
+
+					cancel = !m_cancels.empty();
+					auto& queue = cancel ? m_cancels : m_orders;
+					if(queue.empty())
+						break;
+					request = std::move(queue.front());
+					queue.pop_front();
+				}
+
+				// Counted before the call, as the broker may report the outcome before it returns
+				updateLag(request.enqueued);
+				if(cancel)
+				{
+					m_dispatchedCancels++;
+					m_broker->cancelOrder(request.order);
+				}
+				else
+				{
+					m_dispatchedOrders++;
+					m_broker->submitOrder(request.order);
+				}
+			}
+		}
+
+		void updateLag(const boost::chrono::steady_clock::time_point& enqueued)
+		{
+			uint64_t lag = boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now() - enqueued).count();
+			m_lastLag = lag;
+			uint64_t maxLag = m_maxLag.load();
+			while(lag > maxLag && !m_maxLag.compare_exchange_weak(maxLag, lag))
+			{
+			}
+		}
+
+		Broker::Ptr m_broker;
+		Impl* m_impl;
+		boost::thread m_thread;
+		mutable boost::mutex m_mutex;
+		boost::condition_variable m_cv;
+		bool m_run;
+		std::deque<Request> m_orders;
+		std::deque<Request> m_cancels;
+		std::atomic<uint64_t> m_dispatchedOrders;
+		std::atomic<uint64_t> m_dispatchedCancels;
+		std::atomic<uint64_t> m_lastLag;
+		std::atomic<uint64_t> m_maxLag;
+	};
+
+	/*
+	 * Working orders of all clients by local id, so that execution reports are routed
+	 * without scanning clients. Sharded by id to keep lock contention between
+	 * client threads and broker callbacks low.
+	 */
+	class OrderIndex
+	{
+	public:
+		struct Entry
+		{
+			Order::Ptr order;
+			Client::Ptr client;
+			Dispatcher::Ptr dispatcher;
+		};
+
+		void insert(const Order::Ptr& order, const Client::Ptr& client, const Dispatcher::Ptr& dispatcher)
+		{
+			auto& s = shard(order->localId());
+			boost::unique_lock<boost::mutex> lock(s.mutex);
+			s.entries[order->localId()] = Entry { order, client, dispatcher };
+		}
+
+		void erase(int localId)
+		{
+			auto& s = shard(localId);
+			boost::unique_lock<boost::mutex> lock(s.mutex);
+			s.entries.erase(localId);
+		}
+
+		bool find(int localId, Entry& entry)
+		{
+			auto& s = shard(localId);
+			boost::unique_lock<boost::mutex> lock(s.mutex);
+			auto it = s.entries.find(localId);
+			if(it == s.entries.end())
+				return false;
+			entry = it->second;
+			return true;
+		}
+
+		// Entry of an order in a final state is kept for late trades; only the last MaxRetiredRoutes of them are
+		void retire(int localId)
+		{
+			boost::unique_lock<boost::mutex> lock(m_retiredMutex);
+			m_retired.push_back(localId);
+			if(m_retired.size() > MaxRetiredRoutes)
+			{
+				erase(m_retired.front());
+				m_retired.pop_front();
+			}
+		}
+
+	private:
+		// Local ids are sequential, so plain modulo spreads them evenly
+		static const size_t ShardCount = 16;
+
+		struct Shard
+		{
+			boost::mutex mutex;
+			std::unordered_map<int, Entry> entries;
+		};
+
+		Shard& shard(int localId)
+		{
+			return m_shards[(unsigned int)localId % ShardCount];
+		}
+
+		std::array<Shard, ShardCount> m_shards;
+
+		boost::mutex m_retiredMutex;
+		std::deque<int> m_retired; // local ids, oldest first; some may be erased already
+	};
+
+	/*
+	 * Account to broker routes, built from Broker::accounts() of the registered brokers. If several brokers
+	 * report the same account, the one registered first gets it. Accounts that no broker reports go to
+	 * the default broker, if it is set.
+	 */
+	class RoutingTable
+	{
+	public:
+		void rebuild(const std::vector<Dispatcher::Ptr>& dispatchers)
+		{
+			std::unordered_map<std::string, Dispatcher::Ptr> routes;
+			for(const auto& dispatcher : dispatchers)
+			{
+				for(const auto& account : dispatcher->broker()->accounts())
+					routes.emplace(account, dispatcher);
+			}
+
+			boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+			m_routes.swap(routes);
+		}
+
+		void setDefault(const Dispatcher::Ptr& dispatcher)
+		{
+			boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+			m_default = dispatcher;
+		}
+
+		Dispatcher::Ptr defaultDispatcher() const
+		{
+			boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+			return m_default;
+		}
+
+		Dispatcher::Ptr find(const std::string& account) const
+		{
+			boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+			auto it = m_routes.find(account);
+			if(it != m_routes.end())
+				return it->second;
+			return m_default;
+		}
+
+	private:
+		mutable boost::shared_mutex m_mutex;
+		std::unordered_map<std::string, Dispatcher::Ptr> m_routes;
+		Dispatcher::Ptr m_default;
+	};
+
+	/*
+	 * cppio has no readiness notification, so a worker polls its clients in turn with non-blocking reads
+	 * and backs off when none of them has data. A client whose line type has no non-blocking reads
+	 * (see nonBlockingReceiveTimeout) is read by a thread of its own, and the worker takes what it has read,
+	 * so the worker never waits on an idle client either way. Disconnected clients are dropped right away.
+	 */
+	class Worker
+	{
+	public:
+		explicit Worker(const BusyPollPolicy& idlePolicy) : m_idlePolicy(idlePolicy),
+			m_run(false),
+			m_clientCount(0)
+		{
+		}
+
+		~Worker()
+		{
+			stop();
+		}
+
+		void start()
+		{
+			m_run = true;
+			m_thread = boost::thread(std::bind(&Worker::eventLoop, this));
+		}
+
+		void stop()
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				m_run = false;
+				m_cv.notify_one();
+			}
+			if(m_thread.joinable())
+				m_thread.join();
+		}
+
+		void addClient(const Client::Ptr& client)
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			m_newClients.push_back(client);
+			m_clientCount++;
+			m_cv.notify_one();
+		}
+
+		size_t clientCount() const
+		{
+			return m_clientCount;
+		}
+
+	private:
+		void eventLoop()
+		{
+			BusyPollBackoff backoff(m_idlePolicy);
+			while(true)
+			{
+				{
+					boost::unique_lock<boost::mutex> lock(m_mutex);
+					// Nothing to poll, so the worker sleeps until a client comes
+					while(m_run && m_clients.empty() && m_newClients.empty())
+						m_cv.wait(lock);
+					if(!m_run)
+						break;
+
+					m_clients.insert(m_clients.end(), m_newClients.begin(), m_newClients.end());
+					m_newClients.clear();
+				}
+
+				bool active = false;
+				for(size_t i = 0; i < m_clients.size();)
+				{
+					size_t handled;
+					if(!m_clients[i]->poll(handled))
+					{
+						m_clients[i]->close();
+						m_clients[i] = m_clients.back();
+						m_clients.pop_back();
+						m_clientCount--;
+						continue;
+					}
+					if(handled > 0)
+						active = true;
+					i++;
+				}
+
+				if(active)
+					backoff.reset();
+				else
+					backoff.idle();
+			}
+			for(const auto& client : m_clients)
+				client->close();
+			for(const auto& client : m_newClients)
+				client->close();
+			m_clients.clear();
+			m_newClients.clear();
+		}
+
+		BusyPollPolicy m_idlePolicy;
+		boost::thread m_thread;
+		boost::mutex m_mutex;
+		boost::condition_variable m_cv;
+		bool m_run;
+		std::vector<Client::Ptr> m_newClients;
+		std::vector<Client::Ptr> m_clients; // owned by the worker thread
+		std::atomic<size_t> m_clientCount;
+	};
+
+	/*
+	 * Sends queued notifications of the clients bound to it, so that a client with a slow connection
+	 * delays only the clients that share its writer and never the broker threads.
+	 */
+	class Writer
+	{
+	public:
+		Writer() : m_run(false)
+		{
+		}
+
+		~Writer()
+		{
+			stop();
+		}
+
+		void start()
+		{
+			m_run = true;
+			m_thread = boost::thread(std::bind(&Writer::eventLoop, this));
+		}
+
+		// Clients scheduled so far are flushed before the thread exits
+		void stop()
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				m_run = false;
+				m_cv.notify_one();
+			}
+			if(m_thread.joinable())
+				m_thread.join();
+		}
+
+		void schedule(const Client::Ptr& client)
+		{
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				if(m_run)
+				{
+					m_ready.push_back(client);
+					m_cv.notify_one();
+					return;
+				}
+			}
+			client->close();
+		}
+
+	private:
+		void eventLoop()
+		{
+			std::vector<Client::Ptr> ready;
+			while(true)
+			{
+				{
+					boost::unique_lock<boost::mutex> lock(m_mutex);
+					while(m_run && m_ready.empty())
+						m_cv.wait(lock);
+					if(m_ready.empty())
+						break;
+					ready.swap(m_ready);
+				}
+
+				for(const auto& client : ready)
+					client->flushNotifications();
+				ready.clear();
+			}
+		}
+
+		boost::thread m_thread;
+		boost::mutex m_mutex;
+		boost::condition_variable m_cv;
+		bool m_run;
+		std::vector<Client::Ptr> m_ready;
 	};
 
 	Impl(const std::shared_ptr<cppio::IoLineManager>& m,
 			const std::string& ep) :
 		manager(m), endpoint(ep),
-		run(false)
+		run(false),
+		workerThreads(DefaultWorkerThreads),
+		clientReceiveTimeout(MinReceiveTimeout),
+		writerThreads(DefaultWriterThreads),
+		notificationQueueCapacity(DefaultNotificationQueueCapacity),
+		nextWriter(0),
+		tradeSinkStopTimeout(0),
+		tradeSinkRun(false)
 	{
 	}
 
 	~Impl()
 	{
+		for(const auto& dispatcher : dispatchers)
+			dispatcher->stop();
 	}
 
-	std::vector<Broker::Ptr> brokers;
+	std::vector<Dispatcher::Ptr> dispatchers; // one per registered broker
 	std::shared_ptr<cppio::IoLineManager> manager;
 	std::string endpoint;
 	boost::thread mainThread;
 	boost::thread tradeSinkThread;
 	bool run;
-	std::vector<Client::Ptr> clients;
+	size_t workerThreads;
+	BusyPollPolicy busyPoll;
+	int clientReceiveTimeout; // see nonBlockingReceiveTimeout
+	std::vector<std::unique_ptr<Worker>> workers;
+	size_t writerThreads;
+	size_t notificationQueueCapacity;
+	std::vector<std::unique_ptr<Writer>> writers;
+	size_t nextWriter;
+	OrderIndex orderIndex;
+	RoutingTable routes;
+	mutable boost::mutex brokersMutex; // guards dispatchers while the routes are rebuilt
+	RetentionPolicy retention;
+	OrderArchive::Ptr orderArchive;
 	boost::uuids::random_generator uuidGenerator;
 	std::string tradesSinkEndpoint;
+	boost::chrono::milliseconds tradeSinkStopTimeout;
+	std::string tradeSinkSession;
 
-	boost::mutex tradeQueueMutex;
+	boost::mutex tradeQueueMutex; // guards the fields below
 	boost::condition_variable tradeQueueCv;
-	std::queue<Trade> tradeQueue;
+	std::deque<Trade> tradeQueue;
+	bool tradeSinkRun;
+	boost::chrono::steady_clock::time_point tradeSinkStopDeadline;
+
+	struct TradeBatch
+	{
+		int64_t id;
+		std::vector<Trade> trades;
+		std::string json;
+		boost::chrono::steady_clock::time_point sent;
+	};
 
 	void eventLoop()
 	{
@@ -376,7 +1172,14 @@ struct BrokerServer::Impl : public Broker::Reactor
 		auto acceptor = std::unique_ptr<cppio::IoAcceptor>(manager->createServer(endpoint));
 		if(!acceptor)
 			throw std::runtime_error("Unable to bind acceptor to endpoint: " + endpoint);
+		clientReceiveTimeout = nonBlockingReceiveTimeout(*manager, endpoint);
 
+		// Clients are not accepted yet, so the generator is not shared with the workers here
+		tradeSinkSession = generateNewIdentity();
+		{
+			boost::unique_lock<boost::mutex> lock(tradeQueueMutex);
+			tradeSinkRun = true;
+		}
 		tradeSinkThread = boost::thread(std::bind(&Impl::tradeSink, this));
 
 		while(run)
@@ -384,161 +1187,257 @@ struct BrokerServer::Impl : public Broker::Reactor
 			auto line = std::shared_ptr<cppio::IoLine>(acceptor->waitConnection(100));
 			if(line)
 			{
-				int timeout = 200;
-				line->setOption(cppio::LineOption::ReceiveTimeout, &timeout);
-				auto client = std::make_shared<Client>(line, this);
+				auto client = std::make_shared<Client>(line, this, writers[nextWriter++ % writers.size()].get());
 				client->start();
-				clients.push_back(client);
+				auto worker = std::min_element(workers.begin(), workers.end(),
+						[](const std::unique_ptr<Worker>& a, const std::unique_ptr<Worker>& b) { return a->clientCount() < b->clientCount(); });
+				(*worker)->addClient(client);
 			}
 		}
 	}
 
+	void startWorkers()
+	{
+		for(size_t i = 0; i < writerThreads; i++)
+		{
+			writers.emplace_back(new Writer());
+			writers.back()->start();
+		}
+
+		auto policy = busyPoll.enabled ? busyPoll : workerIdlePolicy();
+		for(size_t i = 0; i < workerThreads; i++)
+		{
+			workers.emplace_back(new Worker(policy));
+			workers.back()->start();
+		}
+	}
+
+	void stopWorkers()
+	{
+		for(const auto& worker : workers)
+			worker->stop();
+		workers.clear();
+	}
+
+	void stopWriters()
+	{
+		for(const auto& writer : writers)
+			writer->stop();
+		writers.clear();
+	}
+
+	size_t clientCount() const
+	{
+		size_t result = 0;
+		for(const auto& worker : workers)
+			result += worker->clientCount();
+		return result;
+	}
+
+	/*
+	 * Trades queued since the last batch are sent as one batch; up to MaxTradeBatchesInFlight batches may wait
+	 * for acknowledgement. Batches not acknowledged before the connection is lost are sent again
+	 * after reconnect, so the sink may get a batch twice. Batch ids start at 1 for every run of the server,
+	 * which is told apart by the session id of the batches.
+	 *
+	 * A heartbeat is sent when the sink has been idle for a while; its reply is polled for together with
+	 * acknowledgements, so batches are not held up by it. After stop is requested, trades left are still
+	 * delivered until tradeSinkStopTimeout passes; the rest is kept in tradeQueue, see undeliveredTrades().
+	 */
 	void tradeSink()
 	{
-		while(run)
+		JsonWriter writer;
+		std::deque<TradeBatch> inFlight;
+		std::vector<Trade> trades;
+		int64_t nextBatchId = 1;
+		while(tradeSinkActive(inFlight))
 		{
 			std::unique_ptr<cppio::IoLine> tradesSink(manager->createClient(tradesSinkEndpoint));
-			if(tradesSink)
+			if(!tradesSink)
 			{
-				cppio::MessageProtocol proto(tradesSink.get());
-				while(run)
+				boost::unique_lock<boost::mutex> lock(tradeQueueMutex);
+				if(!tradeSinkRun)
+					break;
+				tradeQueueCv.wait_for(lock, TradeSinkReconnectInterval);
+				continue;
+			}
+
+			int timeout = TradeSinkAckPollInterval;
+			tradesSink->setOption(cppio::LineOption::ReceiveTimeout, &timeout);
+			cppio::MessageProtocol proto(tradesSink.get());
+
+			bool connected = true;
+			for(auto& batch : inFlight)
+			{
+				if(!sendTradeBatch(proto, batch))
+				{
+					connected = false;
+					break;
+				}
+			}
+
+			// Default time point means no heartbeat is waiting for reply
+			boost::chrono::steady_clock::time_point heartbeatSent;
+			while(connected && tradeSinkActive(inFlight))
+			{
+				bool waiting = !inFlight.empty() || (heartbeatSent != boost::chrono::steady_clock::time_point());
+				if(inFlight.size() < MaxTradeBatchesInFlight)
 				{
-					{
-						cppio::Message message;
-						std::string rawmsg(R"({ "command" : "heartbeat" })");
-						message.addFrame(cppio::Frame(rawmsg.data(), rawmsg.size()));
-						size_t rc = proto.sendMessage(message);
-						if(rc != 1)
-							break;
-						message.clear();
-						rc = proto.readMessage(message);
-						if(rc != 1)
-							break;
-
-						// No need to check the response, if we got anything we are happy
-					}
-					Trade trade;
 					{
 						boost::unique_lock<boost::mutex> lock(tradeQueueMutex);
-						while(trade.orderId == 0)
-						{
-							if(!run)
-								return;
-
-							if(tradeQueue.size() > 0)
-							{
-								trade = tradeQueue.front();
-							}
-							else
-							{
-								tradeQueueCv.wait_for(lock, boost::chrono::milliseconds(1000));
-								continue;
-							}
-						}
+						if(!waiting && tradeQueue.empty() && tradeSinkRun)
+							tradeQueueCv.wait_for(lock, TradeSinkHeartbeatInterval);
+						size_t count = std::min(tradeQueue.size(), MaxTradesPerBatch);
+						trades.assign(tradeQueue.begin(), tradeQueue.begin() + count);
+						tradeQueue.erase(tradeQueue.begin(), tradeQueue.begin() + count);
 					}
-					if(trade.orderId != 0)
+					if(!trades.empty())
 					{
-						Json::Value root;
-						serializeTrade(trade, root);
-
-						Json::FastWriter writer;
-						cppio::Message message;
-						message << writer.write(root);
-
-						size_t rc = proto.sendMessage(message);
-						if(rc != 1)
-							break;
-						tradeQueue.pop();
+						writeTradeBatch(writer, tradeSinkSession, nextBatchId, trades);
+						inFlight.push_back(TradeBatch { nextBatchId, std::move(trades), writer.str(), boost::chrono::steady_clock::now() });
+						trades.clear();
+						nextBatchId++;
+						connected = sendTradeBatch(proto, inFlight.back());
+						continue;
 					}
 				}
-			}
-			else
-			{
-				boost::this_thread::sleep_for(boost::chrono::milliseconds(10000));
+
+				if(waiting)
+				{
+					connected = readTradeAcks(proto, inFlight, heartbeatSent);
+				}
+				else if(tradeSinkActive(inFlight))
+				{
+					connected = sendHeartbeat(proto);
+					heartbeatSent = boost::chrono::steady_clock::now();
+				}
 			}
 		}
+
+		// Unacknowledged trades go back ahead of the queued ones
+		boost::unique_lock<boost::mutex> lock(tradeQueueMutex);
+		for(auto it = inFlight.rbegin(); it != inFlight.rend(); ++it)
+			tradeQueue.insert(tradeQueue.begin(), it->trades.begin(), it->trades.end());
 	}
 
-	void setTradeSink(const std::string& endpoint)
+	// Once stop is requested, the sink is served only while there are trades left and the stop timeout has not passed
+	bool tradeSinkActive(const std::deque<TradeBatch>& inFlight)
 	{
-		tradesSinkEndpoint = endpoint;
+		boost::unique_lock<boost::mutex> lock(tradeQueueMutex);
+		if(tradeSinkRun)
+			return true;
+		return (!inFlight.empty() || !tradeQueue.empty()) && (boost::chrono::steady_clock::now() < tradeSinkStopDeadline);
 	}
 
-	void sendTradeToSink(const Trade& trade)
+	bool sendTradeBatch(cppio::MessageProtocol& proto, TradeBatch& batch)
 	{
-		boost::unique_lock<boost::mutex> lock(tradeQueueMutex);
-		tradeQueue.push(trade);
-		tradeQueueCv.notify_one();
+		cppio::Message message;
+		message << batch.json;
+		batch.sent = boost::chrono::steady_clock::now();
+		return proto.sendMessage(message) == 1;
 	}
 
-	static void serializeTrade(const Trade& trade, Json::Value& root)
+	bool sendHeartbeat(cppio::MessageProtocol& proto)
 	{
-		Json::Value tradeJson;
-		tradeJson["order-id"] = trade.orderId;
-		tradeJson["price"] = trade.price;
-		tradeJson["quantity"] = trade.quantity;
-		tradeJson["operation"] = trade.operation == Order::Operation::Buy ? "buy" : "sell";
-		tradeJson["volume"] = trade.volume;
-		tradeJson["volume-currency"] = trade.volumeCurrency;
-		tradeJson["account"] = trade.account;
-		tradeJson["security"] = trade.security;
-		tradeJson["execution-time"] = serializeExecutionTime(trade.timestamp, trade.useconds);
-		if(!trade.signalId.strategyId.empty())
-			tradeJson["strategy"] = trade.signalId.strategyId;
-		if(!trade.signalId.signalId.empty())
-			tradeJson["signal-id"] = trade.signalId.signalId;
-		if(!trade.signalId.comment.empty())
-			tradeJson["order-comment"] = trade.signalId.comment;
-
-		root.clear();
-		root["trade"] = tradeJson;
+		cppio::Message message;
+		message << std::string(R"({ "command" : "heartbeat" })");
+		return proto.sendMessage(message) == 1;
 	}
 
-	void submitOrder(const Order::Ptr& order)
+	/*
+	 * Acknowledgement { "ack" : <id> } covers all batches up to the given id. No need to check the reply
+	 * to a heartbeat: any message from the sink answers it. Returns false if the connection is lost or
+	 * the sink has not replied for TradeSinkReplyTimeout.
+	 */
+	bool readTradeAcks(cppio::MessageProtocol& proto, std::deque<TradeBatch>& inFlight,
+			boost::chrono::steady_clock::time_point& heartbeatSent)
 	{
-		for(const auto& broker : brokers)
+		cppio::Message message;
+		ssize_t rc = proto.readMessage(message);
+		if(rc == cppio::eTimeout)
+		{
+			auto now = boost::chrono::steady_clock::now();
+			if(!inFlight.empty() && (now - inFlight.front().sent >= TradeSinkReplyTimeout))
+				return false;
+			return (heartbeatSent == boost::chrono::steady_clock::time_point()) || (now - heartbeatSent < TradeSinkReplyTimeout);
+		}
+		else if(rc != 1)
+		{
+			return false;
+		}
+
+		heartbeatSent = boost::chrono::steady_clock::time_point();
+		try
+		{
+			auto json = message.get<std::string>(0);
+			JsonReader reader(json);
+			if((reader.next() == JsonReader::Token::BeginObject) && (reader.next() == JsonReader::Token::Key) &&
+					(reader.string() == "ack") && (reader.next() == JsonReader::Token::Number))
+			{
+				int64_t id = (int64_t)reader.number();
+				while(!inFlight.empty() && (inFlight.front().id <= id))
+					inFlight.pop_front();
+			}
+		}
+		catch(const ProtocolError& e)
 		{
-			if(broker->hasAccount(order->account()))
-				broker->submitOrder(order);
+			// Not an acknowledgement
 		}
+		return true;
+	}
+
+	void setTradeSink(const std::string& endpoint, const boost::chrono::milliseconds& stopTimeout)
+	{
+		tradesSinkEndpoint = endpoint;
+		tradeSinkStopTimeout = stopTimeout;
 	}
 
-	void cancelOrder(const Order::Ptr& order)
+	void stopTradeSink()
 	{
-		for(const auto& broker : brokers)
 		{
-			if(broker->hasAccount(order->account()))
-				broker->cancelOrder(order);
+			boost::unique_lock<boost::mutex> lock(tradeQueueMutex);
+			tradeSinkRun = false;
+			tradeSinkStopDeadline = boost::chrono::steady_clock::now() + tradeSinkStopTimeout;
+			tradeQueueCv.notify_all();
 		}
+		if(tradeSinkThread.joinable())
+			tradeSinkThread.join();
+	}
+
+	void sendTradeToSink(const Trade& trade)
+	{
+		boost::unique_lock<boost::mutex> lock(tradeQueueMutex);
+		tradeQueue.push_back(trade);
+		tradeQueueCv.notify_one();
 	}
 
 	virtual void orderCallback(const Order::Ptr& order) override
 	{
-		for(const auto& client : clients)
-		{
-			if(client->ownsOrder(order))
-				client->orderStateChanged(order);
-		}
+		OrderIndex::Entry entry;
+		if(orderIndex.find(order->localId(), entry))
+			entry.client->orderStateChanged(order);
 	}
 
 	virtual void tradeCallback(const Trade& trade) override
 	{
-		for(const auto& client : clients)
+		OrderIndex::Entry entry;
+		if(orderIndex.find(trade.orderId, entry))
 		{
-			auto order = client->findOrderById(trade.orderId);
-			if(order)
-			{
-				Trade t(trade);
-				t.orderId = order->clientAssignedId();
-				t.signalId = order->signalId();
-				client->tradeNotification(order, t);
-				break;
-			}
+			Trade t(trade);
+			t.orderId = entry.order->clientAssignedId();
+			t.signalId = entry.order->signalId();
+			entry.client->tradeNotification(entry.order, t);
 		}
 
 		sendTradeToSink(trade);
 	}
 
+	Dispatcher::Ptr findDispatcher(const Broker::Ptr& broker) const
+	{
+		auto it = std::find_if(dispatchers.begin(), dispatchers.end(), [&](const Dispatcher::Ptr& d) { return d->broker() == broker; });
+		return it != dispatchers.end() ? *it : Dispatcher::Ptr();
+	}
+
 	std::string generateNewIdentity()
 	{
 		return boost::uuids::to_string(uuidGenerator());
@@ -556,43 +1455,139 @@ BrokerServer::~BrokerServer()
 
 void BrokerServer::registerBroker(const Broker::Ptr& broker)
 {
-	m_impl->brokers.push_back(broker);
+	auto dispatcher = std::make_shared<Impl::Dispatcher>(broker, m_impl.get());
+	dispatcher->start();
+	{
+		boost::unique_lock<boost::mutex> lock(m_impl->brokersMutex);
+		m_impl->dispatchers.push_back(dispatcher);
+		m_impl->routes.rebuild(m_impl->dispatchers);
+	}
 	broker->registerReactor(m_impl);
 }
 
 void BrokerServer::unregisterBroker(const Broker::Ptr& broker)
 {
-	auto it = std::find(m_impl->brokers.begin(), m_impl->brokers.end(), broker);
-	if(it != m_impl->brokers.end())
-		m_impl->brokers.erase(it);
+	Impl::Dispatcher::Ptr dispatcher;
+	{
+		boost::unique_lock<boost::mutex> lock(m_impl->brokersMutex);
+		dispatcher = m_impl->findDispatcher(broker);
+		if(!dispatcher)
+			return;
+		m_impl->dispatchers.erase(std::find(m_impl->dispatchers.begin(), m_impl->dispatchers.end(), dispatcher));
+		if(m_impl->routes.defaultDispatcher() == dispatcher)
+			m_impl->routes.setDefault(Impl::Dispatcher::Ptr());
+		m_impl->routes.rebuild(m_impl->dispatchers);
+	}
+	// Broker callbacks of the queued requests take other locks, so the queue is drained outside of brokersMutex
+	dispatcher->stop();
+}
+
+void BrokerServer::setDefaultBroker(const Broker::Ptr& broker)
+{
+	boost::unique_lock<boost::mutex> lock(m_impl->brokersMutex);
+	Impl::Dispatcher::Ptr dispatcher;
+	if(broker)
+	{
+		dispatcher = m_impl->findDispatcher(broker);
+		if(!dispatcher)
+			BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Default broker should be registered"));
+	}
+	m_impl->routes.setDefault(dispatcher);
+}
+
+void BrokerServer::refreshRoutes()
+{
+	boost::unique_lock<boost::mutex> lock(m_impl->brokersMutex);
+	m_impl->routes.rebuild(m_impl->dispatchers);
 }
 
 void BrokerServer::start()
 {
+	m_impl->startWorkers();
 	m_impl->mainThread = boost::thread(std::bind(&Impl::eventLoop, m_impl.get()));
 }
 
 void BrokerServer::stop()
 {
 	m_impl->run = false;
-	for(const auto& client : m_impl->clients)
-	{
-		client->stop();
-	}
+	if(m_impl->mainThread.joinable())
+		m_impl->mainThread.join();
+
+	m_impl->stopWorkers();
 
-	for(const auto& client : m_impl->clients)
+	std::vector<Impl::Dispatcher::Ptr> dispatchers;
 	{
-		client->join();
+		boost::unique_lock<boost::mutex> lock(m_impl->brokersMutex);
+		dispatchers.swap(m_impl->dispatchers);
+		m_impl->routes.setDefault(Impl::Dispatcher::Ptr());
+		m_impl->routes.rebuild(m_impl->dispatchers);
 	}
-	m_impl->brokers.clear();
+	for(const auto& dispatcher : dispatchers)
+		dispatcher->stop();
 
-	if(m_impl->mainThread.joinable())
-		m_impl->mainThread.join();
+	// After the dispatchers, so that trades reported for the requests they have drained are delivered too
+	m_impl->stopTradeSink();
+
+	m_impl->stopWriters();
+}
+
+void BrokerServer::setTradeSink(const std::string& endpoint, const boost::chrono::milliseconds& stopTimeout)
+{
+	m_impl->setTradeSink(endpoint, stopTimeout);
+}
+
+std::vector<Trade> BrokerServer::undeliveredTrades() const
+{
+	boost::unique_lock<boost::mutex> lock(m_impl->tradeQueueMutex);
+	return std::vector<Trade>(m_impl->tradeQueue.begin(), m_impl->tradeQueue.end());
+}
+
+void BrokerServer::setWorkerThreads(size_t count)
+{
+	if(count == 0)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("At least one worker thread is required"));
+	m_impl->workerThreads = count;
+}
+
+void BrokerServer::setBusyPoll(const BusyPollPolicy& policy)
+{
+	if(!policy.valid())
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid busy-poll policy"));
+	m_impl->busyPoll = policy;
+}
+
+void BrokerServer::setNotificationWriters(size_t writers, size_t queueCapacity)
+{
+	if(writers == 0)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("At least one writer thread is required"));
+	if(queueCapacity == 0)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Notification queue capacity should be positive"));
+	m_impl->writerThreads = writers;
+	m_impl->notificationQueueCapacity = queueCapacity;
+}
+
+size_t BrokerServer::clientCount() const
+{
+	return m_impl->clientCount();
+}
+
+std::vector<BrokerServer::DispatchStats> BrokerServer::dispatchStats() const
+{
+	boost::unique_lock<boost::mutex> lock(m_impl->brokersMutex);
+	std::vector<DispatchStats> result;
+	for(const auto& dispatcher : m_impl->dispatchers)
+		result.push_back(dispatcher->stats());
+	return result;
+}
+
+void BrokerServer::setRetention(const RetentionPolicy& policy)
+{
+	m_impl->retention = policy;
 }
 
-void BrokerServer::setTradeSink(const std::string& endpoint)
+void BrokerServer::setOrderArchive(const std::string& path)
 {
-	m_impl->setTradeSink(endpoint);
+	m_impl->orderArchive = std::make_shared<OrderArchive>(path);
 }
 
 }
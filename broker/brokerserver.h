@@ -3,10 +3,15 @@
 #define BROKERSERVER_H
 
 #include "broker.h"
+#include "orderarchive.h"
+#include "goldmine/busypoll.h"
 
 #include "cppio/iolinemanager.h"
 
+#include <boost/chrono.hpp>
+
 #include <memory>
+#include <vector>
 
 namespace goldmine
 {
@@ -16,16 +21,86 @@ class BrokerServer
 public:
 	using Ptr = std::shared_ptr<BrokerServer>;
 
+	struct DispatchStats
+	{
+		Broker::Ptr broker;
+		size_t pendingOrders;
+		size_t pendingCancels;
+		uint64_t dispatchedOrders;
+		uint64_t dispatchedCancels;
+		uint64_t lastLagMicroseconds; // time from acceptance of the request to the broker call
+		uint64_t maxLagMicroseconds;
+	};
+
+	static const size_t DefaultNotificationQueueCapacity = 4096;
+
 	BrokerServer(const std::shared_ptr<cppio::IoLineManager>& manager, const std::string& endpoint);
 	virtual ~BrokerServer();
 
+	/*
+	 * Orders are routed by account to the broker that lists it in Broker::accounts() at registration.
+	 * Orders for other accounts go to the default broker or are rejected if there is none.
+	 *
+	 * Every registered broker gets its own dispatch thread: accepted orders and cancels are queued
+	 * and passed to the broker from that thread, cancels ahead of new orders. Requests that are still
+	 * queued when the broker is unregistered or the server is stopped are passed to the broker before that returns.
+	 */
 	void registerBroker(const Broker::Ptr& broker);
 	void unregisterBroker(const Broker::Ptr& broker);
 
+	// `broker` should be registered; empty pointer removes the default route
+	void setDefaultBroker(const Broker::Ptr& broker);
+
+	// Should be called when accounts of a registered broker change
+	void refreshRoutes();
+
 	void start();
 	void stop();
 
-	void setTradeSink(const std::string& endpoint);
+	/*
+	 * All trades reported by the brokers are forwarded to the sink at `endpoint` in batches that the sink
+	 * acknowledges. On stop, trades left are still delivered for at most `stopTimeout`.
+	 */
+	void setTradeSink(const std::string& endpoint, const boost::chrono::milliseconds& stopTimeout = boost::chrono::milliseconds(2000));
+
+	// Trades that the sink has not acknowledged before the server stopped, in order of reporting
+	std::vector<Trade> undeliveredTrades() const;
+
+	/*
+	 * Should be called before start. Client connections are served by a fixed pool of `count` worker threads,
+	 * each polling its share of the connections with non-blocking reads. Connections of an endpoint type
+	 * that has no non-blocking reads (see nonBlockingReceiveTimeout) get a reader thread each in addition.
+	 */
+	void setWorkerThreads(size_t count);
+
+	/*
+	 * Should be called before start. Idle workers back off according to `policy` instead of sleeping
+	 * for a millisecond between polls, see BusyPollPolicy.
+	 */
+	void setBusyPoll(const BusyPollPolicy& policy);
+
+	/*
+	 * Should be called before start. Order state changes and trades reported by brokers are queued per client
+	 * and sent by a pool of `writers` threads, each serving its share of the clients. Pending state changes
+	 * of an order are merged into the latest one while the client is behind; trades and replies are sent
+	 * as they are. Queue of a client holds at most `queueCapacity` notifications. Broker threads never wait
+	 * for a client: one whose queue is full is disconnected.
+	 */
+	void setNotificationWriters(size_t writers, size_t queueCapacity = DefaultNotificationQueueCapacity);
+
+	// Number of connected clients
+	size_t clientCount() const;
+
+	// One entry per registered broker, in order of registration
+	std::vector<DispatchStats> dispatchStats() const;
+
+	/*
+	 * Should be called before start. Every client connection keeps its orders that reached a final state
+	 * according to `policy` and writes evicted ones to the archive at `path`, if it is set.
+	 * Ids of the kept orders are rejected as duplicates, ids of evicted ones may be reused.
+	 */
+	void setRetention(const RetentionPolicy& policy);
+	void setOrderArchive(const std::string& path);
 
 private:
 	struct Impl;
@@ -0,0 +1,903 @@
+
+#include "jsoncodec.h"
+
+#include "goldmine/exceptions.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <limits>
+
+namespace goldmine
+{
+
+static const char* orderStateName(Order::State state)
+{
+	switch(state)
+	{
+	case Order::State::Cancelled:
+		return "cancelled";
+	case Order::State::Executed:
+		return "executed";
+	case Order::State::PartiallyExecuted:
+		return "partially-executed";
+	case Order::State::Rejected:
+		return "rejected";
+	case Order::State::Submitted:
+		return "submitted";
+	case Order::State::Unsubmitted:
+		return "unsubmitted";
+	case Order::State::Error:
+		return "error";
+	}
+	return "unknown";
+}
+
+static Order::State parseOrderState(const std::string& str)
+{
+	if(str == "cancelled")
+		return Order::State::Cancelled;
+	else if(str == "executed")
+		return Order::State::Executed;
+	else if(str == "partially-executed")
+		return Order::State::PartiallyExecuted;
+	else if(str == "rejected")
+		return Order::State::Rejected;
+	else if(str == "submitted")
+		return Order::State::Submitted;
+	else if(str == "unsubmitted")
+		return Order::State::Unsubmitted;
+	else if(str == "error")
+		return Order::State::Error;
+	else
+		return (Order::State)(-1);
+}
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar
+static int64_t daysFromCivil(int year, int month, int day)
+{
+	year -= month <= 2;
+	int64_t era = (year >= 0 ? year : year - 399) / 400;
+	int yearOfEra = year - era * 400;
+	int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097 + dayOfEra - 719468;
+}
+
+JsonWriter::JsonWriter() : m_needComma(false)
+{
+}
+
+void JsonWriter::clear()
+{
+	m_buffer.clear();
+	m_needComma = false;
+}
+
+void JsonWriter::beginObject()
+{
+	separate();
+	m_buffer.push_back('{');
+	m_needComma = false;
+}
+
+void JsonWriter::endObject()
+{
+	m_buffer.push_back('}');
+	m_needComma = true;
+}
+
+void JsonWriter::beginArray()
+{
+	separate();
+	m_buffer.push_back('[');
+	m_needComma = false;
+}
+
+void JsonWriter::endArray()
+{
+	m_buffer.push_back(']');
+	m_needComma = true;
+}
+
+void JsonWriter::key(const char* name)
+{
+	separate();
+	writeString(name, strlen(name));
+	m_buffer.push_back(':');
+	m_needComma = false;
+}
+
+void JsonWriter::value(const char* str)
+{
+	separate();
+	writeString(str, strlen(str));
+	m_needComma = true;
+}
+
+void JsonWriter::value(const std::string& str)
+{
+	separate();
+	writeString(str.data(), str.size());
+	m_needComma = true;
+}
+
+void JsonWriter::value(int v)
+{
+	value((int64_t)v);
+}
+
+void JsonWriter::value(int64_t v)
+{
+	separate();
+	char buf[24];
+	int len = snprintf(buf, sizeof(buf), "%lld", (long long)v);
+	m_buffer.append(buf, len);
+	m_needComma = true;
+}
+
+void JsonWriter::value(double v)
+{
+	separate();
+	// Same representation as Json::FastWriter
+	char buf[32];
+	int len;
+	if(std::isfinite(v))
+	{
+		len = snprintf(buf, sizeof(buf), "%.17g", v);
+		for(int i = 0; i < len; i++)
+		{
+			if(buf[i] == ',')
+				buf[i] = '.';
+		}
+	}
+	else if(v != v)
+		len = snprintf(buf, sizeof(buf), "null");
+	else if(v < 0)
+		len = snprintf(buf, sizeof(buf), "-1e+9999");
+	else
+		len = snprintf(buf, sizeof(buf), "1e+9999");
+	m_buffer.append(buf, len);
+	m_needComma = true;
+}
+
+void JsonWriter::value(bool v)
+{
+	separate();
+	m_buffer.append(v ? "true" : "false");
+	m_needComma = true;
+}
+
+void JsonWriter::separate()
+{
+	if(m_needComma)
+		m_buffer.push_back(',');
+}
+
+void JsonWriter::writeString(const char* str, size_t size)
+{
+	static const char* hex = "0123456789abcdef";
+
+	m_buffer.push_back('"');
+	size_t runStart = 0;
+	for(size_t i = 0; i < size; i++)
+	{
+		unsigned char c = str[i];
+		if((c >= 0x20) && (c != '"') && (c != '\\'))
+			continue;
+
+		m_buffer.append(str + runStart, i - runStart);
+		runStart = i + 1;
+		switch(c)
+		{
+		case '"':
+			m_buffer.append("\\\"");
+			break;
+		case '\\':
+			m_buffer.append("\\\\");
+			break;
+		case '\n':
+			m_buffer.append("\\n");
+			break;
+		case '\r':
+			m_buffer.append("\\r");
+			break;
+		case '\t':
+			m_buffer.append("\\t");
+			break;
+		default:
+			m_buffer.append("\\u00");
+			m_buffer.push_back(hex[c >> 4]);
+			m_buffer.push_back(hex[c & 0x0f]);
+		}
+	}
+	m_buffer.append(str + runStart, size - runStart);
+	m_buffer.push_back('"');
+}
+
+JsonReader::JsonReader(const char* data, size_t size) : m_pos(data),
+	m_end(data + size),
+	m_depth(0),
+	m_afterKey(false),
+	m_afterValue(false),
+	m_done(false),
+	m_number(0)
+{
+}
+
+JsonReader::JsonReader(const std::string& data) : JsonReader(data.data(), data.size())
+{
+}
+
+JsonReader::Token JsonReader::next()
+{
+	skipWhitespace();
+	if(m_done)
+	{
+		if(m_pos != m_end)
+			BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Unexpected data after JSON document"));
+		return Token::End;
+	}
+
+	if(m_pos == m_end)
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Unexpected end of JSON document"));
+
+	if((m_depth > 0) && !m_afterKey)
+	{
+		char container = m_stack[m_depth - 1];
+		if(*m_pos == (container == '{' ? '}' : ']'))
+		{
+			m_pos++;
+			pop();
+			return container == '{' ? Token::EndObject : Token::EndArray;
+		}
+
+		if(m_afterValue)
+		{
+			if(*m_pos != ',')
+				BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Expected ',' in JSON document"));
+			m_pos++;
+			skipWhitespace();
+		}
+
+		if(container == '{')
+		{
+			readString();
+			skipWhitespace();
+			if((m_pos == m_end) || (*m_pos != ':'))
+				BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Expected ':' in JSON document"));
+			m_pos++;
+			m_afterKey = true;
+			return Token::Key;
+		}
+	}
+
+	if(m_pos == m_end)
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Unexpected end of JSON document"));
+
+	m_afterKey = false;
+	Token token;
+	switch(*m_pos)
+	{
+	case '{':
+		m_pos++;
+		push('{');
+		return Token::BeginObject;
+	case '[':
+		m_pos++;
+		push('[');
+		return Token::BeginArray;
+	case '"':
+		readString();
+		token = Token::String;
+		break;
+	case 't':
+		readLiteral("true");
+		token = Token::True;
+		break;
+	case 'f':
+		readLiteral("false");
+		token = Token::False;
+		break;
+	case 'n':
+		readLiteral("null");
+		token = Token::Null;
+		break;
+	default:
+		readNumber();
+		token = Token::Number;
+	}
+
+	m_afterValue = true;
+	if(m_depth == 0)
+		m_done = true;
+	return token;
+}
+
+void JsonReader::skipValue()
+{
+	int depth = m_depth;
+	auto token = next();
+	if((token == Token::BeginObject) || (token == Token::BeginArray))
+	{
+		while(m_depth > depth)
+			next();
+	}
+}
+
+void JsonReader::skipWhitespace()
+{
+	while((m_pos < m_end) && ((*m_pos == ' ') || (*m_pos == '\n') || (*m_pos == '\r') || (*m_pos == '\t')))
+		m_pos++;
+}
+
+static int hexDigit(char c)
+{
+	if((c >= '0') && (c <= '9'))
+		return c - '0';
+	else if((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	else if((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+	BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid escape sequence in JSON string"));
+}
+
+void JsonReader::readString()
+{
+	if((m_pos == m_end) || (*m_pos != '"'))
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Expected string in JSON document"));
+	m_pos++;
+
+	m_string.clear();
+	const char* runStart = m_pos;
+	while(true)
+	{
+		if(m_pos == m_end)
+			BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Unterminated JSON string"));
+
+		char c = *m_pos;
+		if(c == '"')
+		{
+			m_string.append(runStart, m_pos - runStart);
+			m_pos++;
+			return;
+		}
+		else if((unsigned char)c < 0x20)
+		{
+			BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Control character in JSON string"));
+		}
+		else if(c != '\\')
+		{
+			m_pos++;
+			continue;
+		}
+
+		m_string.append(runStart, m_pos - runStart);
+		m_pos++;
+		if(m_pos == m_end)
+			BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Unterminated JSON string"));
+
+		switch(*m_pos++)
+		{
+		case '"':
+			m_string.push_back('"');
+			break;
+		case '\\':
+			m_string.push_back('\\');
+			break;
+		case '/':
+			m_string.push_back('/');
+			break;
+		case 'b':
+			m_string.push_back('\b');
+			break;
+		case 'f':
+			m_string.push_back('\f');
+			break;
+		case 'n':
+			m_string.push_back('\n');
+			break;
+		case 'r':
+			m_string.push_back('\r');
+			break;
+		case 't':
+			m_string.push_back('\t');
+			break;
+		case 'u':
+		{
+			auto readCodeUnit = [&]()
+			{
+				if(m_end - m_pos < 4)
+					BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid escape sequence in JSON string"));
+				uint32_t unit = 0;
+				for(int i = 0; i < 4; i++)
+					unit = (unit << 4) | hexDigit(*m_pos++);
+				return unit;
+			};
+
+			uint32_t codePoint = readCodeUnit();
+			if((codePoint >= 0xd800) && (codePoint < 0xdc00))
+			{
+				if((m_end - m_pos < 2) || (m_pos[0] != '\\') || (m_pos[1] != 'u'))
+					BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid surrogate pair in JSON string"));
+				m_pos += 2;
+				uint32_t low = readCodeUnit();
+				if((low < 0xdc00) || (low >= 0xe000))
+					BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid surrogate pair in JSON string"));
+				codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+			}
+
+			if(codePoint < 0x80)
+			{
+				m_string.push_back((char)codePoint);
+			}
+			else if(codePoint < 0x800)
+			{
+				m_string.push_back((char)(0xc0 | (codePoint >> 6)));
+				m_string.push_back((char)(0x80 | (codePoint & 0x3f)));
+			}
+			else if(codePoint < 0x10000)
+			{
+				m_string.push_back((char)(0xe0 | (codePoint >> 12)));
+				m_string.push_back((char)(0x80 | ((codePoint >> 6) & 0x3f)));
+				m_string.push_back((char)(0x80 | (codePoint & 0x3f)));
+			}
+			else
+			{
+				m_string.push_back((char)(0xf0 | (codePoint >> 18)));
+				m_string.push_back((char)(0x80 | ((codePoint >> 12) & 0x3f)));
+				m_string.push_back((char)(0x80 | ((codePoint >> 6) & 0x3f)));
+				m_string.push_back((char)(0x80 | (codePoint & 0x3f)));
+			}
+			break;
+		}
+		default:
+			BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid escape sequence in JSON string"));
+		}
+		runStart = m_pos;
+	}
+}
+
+void JsonReader::readNumber()
+{
+	// Input is not null-terminated, so the number is copied before conversion
+	char buf[64];
+	size_t len = 0;
+	while((m_pos < m_end) && (len < sizeof(buf) - 1))
+	{
+		char c = *m_pos;
+		if(!(((c >= '0') && (c <= '9')) || (c == '-') || (c == '+') || (c == '.') || (c == 'e') || (c == 'E')))
+			break;
+		buf[len++] = c;
+		m_pos++;
+	}
+	buf[len] = '\0';
+
+	char* end;
+	m_number = strtod(buf, &end);
+	if((len == 0) || (end != buf + len))
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid number in JSON document"));
+}
+
+void JsonReader::readLiteral(const char* literal)
+{
+	size_t len = strlen(literal);
+	if(((size_t)(m_end - m_pos) < len) || (memcmp(m_pos, literal, len) != 0))
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid literal in JSON document"));
+	m_pos += len;
+}
+
+void JsonReader::push(char container)
+{
+	if(m_depth == MaxDepth)
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("JSON document is nested too deep"));
+	m_stack[m_depth++] = container;
+	m_afterValue = false;
+}
+
+void JsonReader::pop()
+{
+	m_depth--;
+	m_afterValue = true;
+	if(m_depth == 0)
+		m_done = true;
+}
+
+// Returns nullptr for null, the string is valid until the next token
+static const std::string* nextString(JsonReader& reader)
+{
+	auto token = reader.next();
+	if(token == JsonReader::Token::String)
+		return &reader.string();
+	else if(token == JsonReader::Token::Null)
+		return nullptr;
+	BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Expected string in JSON document"));
+}
+
+static void readString(JsonReader& reader, std::string& out)
+{
+	auto str = nextString(reader);
+	if(str)
+		out.assign(*str);
+	else
+		out.clear();
+}
+
+static bool readNumber(JsonReader& reader, double& out)
+{
+	auto token = reader.next();
+	if(token == JsonReader::Token::Number)
+	{
+		out = reader.number();
+		return true;
+	}
+	else if(token == JsonReader::Token::Null)
+	{
+		return false;
+	}
+	BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Expected number in JSON document"));
+}
+
+static int readInt(JsonReader& reader)
+{
+	double value = 0;
+	readNumber(reader, value);
+	if(!(value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max()) ||
+			(value != std::trunc(value)))
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Expected integer in JSON document"));
+	return (int)value;
+}
+
+static void beginMessage(JsonReader& reader)
+{
+	if(reader.next() != JsonReader::Token::BeginObject)
+		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Expected object in JSON document"));
+}
+
+static bool nextField(JsonReader& reader)
+{
+	return reader.next() == JsonReader::Token::Key;
+}
+
+static const char* operationName(Order::Operation operation)
+{
+	return operation == Order::Operation::Buy ? "buy" : "sell";
+}
+
+static void writeExecutionTime(JsonWriter& writer, uint64_t timestamp, uint32_t useconds)
+{
+	time_t seconds = timestamp + useconds / 1000000;
+	struct tm t;
+	gmtime_r(&seconds, &t);
+
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%d-%02d-%02d %02d:%02d:%02d.%03d",
+			t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+			t.tm_hour, t.tm_min, t.tm_sec,
+			(int)(useconds % 1000000) / 1000);
+	writer.value(buf);
+}
+
+static void parseExecutionTime(const std::string& str, Trade& trade)
+{
+	int year, month, day, hour, minute, second, msec;
+	if(sscanf(str.c_str(), "%d-%d-%d %d:%d:%d.%d", &year, &month, &day, &hour, &minute, &second, &msec) != 7 ||
+			(month < 1) || (month > 12) || (day < 1) || (day > 31) ||
+			(hour < 0) || (hour > 23) || (minute < 0) || (minute > 59) || (second < 0) || (second > 60) ||
+			(msec < 0) || (msec > 999))
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid execution time specified: " + str));
+
+	trade.timestamp = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+	trade.useconds = msec * 1000;
+}
+
+void writeOrder(JsonWriter& writer, const Order& order)
+{
+	writer.clear();
+	writer.beginObject();
+	writer.key("order");
+	writer.beginObject();
+	writer.field("id", order.clientAssignedId());
+	writer.field("account", order.account());
+	writer.field("security", order.security());
+	writer.field("type", order.type() == Order::OrderType::Limit ? "limit" : "market");
+	writer.field("operation", operationName(order.operation()));
+	writer.field("quantity", order.quantity());
+	writer.field("price", order.price());
+
+	auto signalId = order.signalId();
+	if(!signalId.strategyId.empty())
+		writer.field("strategy", signalId.strategyId);
+	if(!signalId.signalId.empty())
+		writer.field("signal-id", signalId.signalId);
+	if(!signalId.comment.empty())
+		writer.field("comment", signalId.comment);
+	writer.endObject();
+	writer.endObject();
+}
+
+void writeCancelOrder(JsonWriter& writer, const Order& order)
+{
+	writer.clear();
+	writer.beginObject();
+	writer.key("cancel-order");
+	writer.beginObject();
+	writer.field("id", order.clientAssignedId());
+	writer.field("account", order.account());
+	writer.endObject();
+	writer.endObject();
+}
+
+void writeOrderState(JsonWriter& writer, int id, Order::State state)
+{
+	writer.clear();
+	writer.beginObject();
+	writer.key("order");
+	writer.beginObject();
+	writer.field("id", id);
+	writer.field("new-state", orderStateName(state));
+	writer.endObject();
+	writer.endObject();
+}
+
+static void writeTradeObject(JsonWriter& writer, const Trade& trade)
+{
+	writer.beginObject();
+	writer.field("order-id", trade.orderId);
+	writer.field("price", trade.price);
+	writer.field("quantity", trade.quantity);
+	writer.field("operation", operationName(trade.operation));
+	writer.field("volume", trade.volume);
+	writer.field("volume-currency", trade.volumeCurrency);
+	writer.field("account", trade.account);
+	writer.field("security", trade.security);
+	writer.key("execution-time");
+	writeExecutionTime(writer, trade.timestamp, trade.useconds);
+	if(!trade.signalId.strategyId.empty())
+		writer.field("strategy", trade.signalId.strategyId);
+	if(!trade.signalId.signalId.empty())
+		writer.field("signal-id", trade.signalId.signalId);
+	if(!trade.signalId.comment.empty())
+		writer.field("order-comment", trade.signalId.comment);
+	writer.endObject();
+}
+
+void writeTrade(JsonWriter& writer, const Trade& trade)
+{
+	writer.clear();
+	writer.beginObject();
+	writer.key("trade");
+	writeTradeObject(writer, trade);
+	writer.endObject();
+}
+
+void writeTradeBatch(JsonWriter& writer, const std::string& session, int64_t batchId, const std::vector<Trade>& trades)
+{
+	writer.clear();
+	writer.beginObject();
+	writer.key("trade-batch");
+	writer.beginObject();
+	writer.field("session", session);
+	writer.field("id", batchId);
+	writer.key("trades");
+	writer.beginArray();
+	for(const auto& trade : trades)
+		writeTradeObject(writer, trade);
+	writer.endArray();
+	writer.endObject();
+	writer.endObject();
+}
+
+void writeResult(JsonWriter& writer, bool success, const std::string& reason)
+{
+	writer.clear();
+	writer.beginObject();
+	writer.field("result", success ? "success" : "error");
+	if(!reason.empty())
+		writer.field("reason", reason);
+	writer.endObject();
+}
+
+Order::Ptr readOrder(JsonReader& reader)
+{
+	int id = 0;
+	std::string account;
+	std::string security;
+	double price = 0;
+	bool hasPrice = false;
+	int quantity = 0;
+	std::string operationString;
+	std::string typeString;
+	SignalId signalId;
+
+	beginMessage(reader);
+	while(nextField(reader))
+	{
+		const auto& key = reader.string();
+		if(key == "id")
+			id = readInt(reader);
+		else if(key == "account")
+			readString(reader, account);
+		else if(key == "security")
+			readString(reader, security);
+		else if(key == "price")
+			hasPrice = readNumber(reader, price);
+		else if(key == "quantity")
+			quantity = readInt(reader);
+		else if(key == "operation")
+			readString(reader, operationString);
+		else if(key == "type")
+			readString(reader, typeString);
+		else if(key == "strategy")
+			readString(reader, signalId.strategyId);
+		else if(key == "signal-id")
+			readString(reader, signalId.signalId);
+		else if(key == "comment")
+			readString(reader, signalId.comment);
+		else
+			reader.skipValue();
+	}
+
+	Order::Operation operation;
+	if(operationString == "buy")
+		operation = Order::Operation::Buy;
+	else if(operationString == "sell")
+		operation = Order::Operation::Sell;
+	else
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unknown operation specified: " + operationString));
+
+	Order::OrderType type;
+	if(typeString == "market")
+		type = Order::OrderType::Market;
+	else if(typeString == "limit")
+	{
+		type = Order::OrderType::Limit;
+		if(!hasPrice)
+			BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("No price specified for limit order"));
+	}
+	else
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unknown order type specified: " + typeString));
+
+	auto order = std::make_shared<Order>(id, account, security, price, quantity, operation, type);
+	order->setSignalId(signalId);
+	return order;
+}
+
+int readCancelOrder(JsonReader& reader)
+{
+	int id = 0;
+	beginMessage(reader);
+	while(nextField(reader))
+	{
+		if(reader.string() == "id")
+			id = readInt(reader);
+		else
+			reader.skipValue();
+	}
+	return id;
+}
+
+void readOrderState(JsonReader& reader, int& id, Order::State& state, std::string& message)
+{
+	id = 0;
+	state = (Order::State)(-1);
+	message.clear();
+
+	beginMessage(reader);
+	while(nextField(reader))
+	{
+		const auto& key = reader.string();
+		if(key == "id")
+		{
+			id = readInt(reader);
+		}
+		else if(key == "new-state")
+		{
+			auto str = nextString(reader);
+			if(str)
+				state = parseOrderState(*str);
+		}
+		else if(key == "message")
+		{
+			readString(reader, message);
+		}
+		else
+		{
+			reader.skipValue();
+		}
+	}
+	if(state == (Order::State)(-1))
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Order state message without valid new-state"));
+}
+
+void readTrade(JsonReader& reader, Trade& trade)
+{
+	// Fields are reset one by one to keep the capacity of the strings
+	trade.orderId = 0;
+	trade.price = 0;
+	trade.quantity = 0;
+	trade.volume = 0;
+	trade.volumeCurrency.clear();
+	trade.account.clear();
+	trade.security.clear();
+	trade.timestamp = 0;
+	trade.useconds = 0;
+	trade.signalId.strategyId.clear();
+	trade.signalId.signalId.clear();
+	trade.signalId.comment.clear();
+	bool hasOperation = false;
+
+	beginMessage(reader);
+	while(nextField(reader))
+	{
+		const auto& key = reader.string();
+		if(key == "order-id")
+		{
+			trade.orderId = readInt(reader);
+		}
+		else if(key == "price")
+		{
+			readNumber(reader, trade.price);
+		}
+		else if(key == "quantity")
+		{
+			trade.quantity = readInt(reader);
+		}
+		else if(key == "volume")
+		{
+			readNumber(reader, trade.volume);
+		}
+		else if(key == "volume-currency")
+		{
+			readString(reader, trade.volumeCurrency);
+		}
+		else if(key == "operation")
+		{
+			auto str = nextString(reader);
+			if(str && (*str == "buy"))
+				trade.operation = Order::Operation::Buy;
+			else if(str && (*str == "sell"))
+				trade.operation = Order::Operation::Sell;
+			else
+				BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid operation specified: " + (str ? *str : std::string())));
+			hasOperation = true;
+		}
+		else if(key == "account")
+		{
+			readString(reader, trade.account);
+		}
+		else if(key == "security")
+		{
+			readString(reader, trade.security);
+		}
+		else if(key == "execution-time")
+		{
+			auto str = nextString(reader);
+			if(str)
+				parseExecutionTime(*str, trade);
+		}
+		else if(key == "strategy")
+		{
+			readString(reader, trade.signalId.strategyId);
+		}
+		else if(key == "signal-id")
+		{
+			readString(reader, trade.signalId.signalId);
+		}
+		else if(key == "order-comment")
+		{
+			readString(reader, trade.signalId.comment);
+		}
+		else
+		{
+			reader.skipValue();
+		}
+	}
+
+	if(!hasOperation)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid operation specified: "));
+}
+
+}
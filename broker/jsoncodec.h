@@ -0,0 +1,141 @@
+
+#ifndef BROKER_JSONCODEC_H_
+#define BROKER_JSONCODEC_H_
+
+#include "broker.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace goldmine
+{
+
+/*
+ * Streaming JSON codec for broker control messages (see doc/goldmine-protocol.md).
+ *
+ * Unlike Json::Value, no document tree is built: JsonWriter appends to a buffer which is reused
+ * between messages, and JsonReader yields tokens straight from the input. Readers of the message
+ * schemas below fill the target structs as the fields come.
+ */
+
+class JsonWriter
+{
+public:
+	JsonWriter();
+
+	// Starts a new document, capacity of the buffer is kept
+	void clear();
+
+	void beginObject();
+	void endObject();
+	void beginArray();
+	void endArray();
+	void key(const char* name);
+
+	void value(const char* str);
+	void value(const std::string& str);
+	void value(int v);
+	void value(int64_t v);
+	void value(double v);
+	void value(bool v);
+
+	template<typename T>
+	void field(const char* name, const T& v)
+	{
+		key(name);
+		value(v);
+	}
+
+	const std::string& str() const { return m_buffer; }
+
+private:
+	void separate();
+	void writeString(const char* str, size_t size);
+
+	std::string m_buffer;
+	bool m_needComma;
+};
+
+/*
+ * Pull reader, throws ProtocolError on malformed input.
+ */
+class JsonReader
+{
+public:
+	enum class Token
+	{
+		BeginObject,
+		EndObject,
+		BeginArray,
+		EndArray,
+		Key,
+		String,
+		Number,
+		True,
+		False,
+		Null,
+		End
+	};
+
+	// `data` should outlive the reader
+	JsonReader(const char* data, size_t size);
+	explicit JsonReader(const std::string& data);
+	explicit JsonReader(std::string&& data) = delete;
+
+	Token next();
+
+	// Skips the next value, including nested objects and arrays
+	void skipValue();
+
+	// Text of the last Key or String token, with escapes resolved
+	const std::string& string() const { return m_string; }
+
+	// Value of the last Number token
+	double number() const { return m_number; }
+
+private:
+	static const int MaxDepth = 32;
+
+	void skipWhitespace();
+	void readString();
+	void readNumber();
+	void readLiteral(const char* literal);
+	void push(char container);
+	void pop();
+
+	const char* m_pos;
+	const char* m_end;
+	char m_stack[MaxDepth];
+	int m_depth;
+	bool m_afterKey;
+	bool m_afterValue;
+	bool m_done;
+	std::string m_string;
+	double m_number;
+};
+
+/*
+ * Message writers. Each one clears the writer and produces a complete document.
+ */
+void writeOrder(JsonWriter& writer, const Order& order);
+void writeCancelOrder(JsonWriter& writer, const Order& order);
+void writeOrderState(JsonWriter& writer, int id, Order::State state);
+void writeTrade(JsonWriter& writer, const Trade& trade);
+void writeTradeBatch(JsonWriter& writer, const std::string& session, int64_t batchId, const std::vector<Trade>& trades);
+void writeResult(JsonWriter& writer, bool success, const std::string& reason);
+
+/*
+ * Message readers. Each one should be called right after the Key token of the message
+ * ("order", "cancel-order", "trade") and consumes the object that follows it. Unknown fields are skipped.
+ * Invalid field values, including non-integral or out of range integers and an order state message
+ * without a known new-state, cause ParameterError.
+ */
+Order::Ptr readOrder(JsonReader& reader);
+int readCancelOrder(JsonReader& reader);
+void readOrderState(JsonReader& reader, int& id, Order::State& state, std::string& message);
+void readTrade(JsonReader& reader, Trade& trade);
+
+}
+
+#endif /* BROKER_JSONCODEC_H_ */
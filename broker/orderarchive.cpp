@@ -0,0 +1,261 @@
+
+#include "orderarchive.h"
+
+#include "goldmine/exceptions.h"
+
+#include "json/json.h"
+
+namespace goldmine
+{
+
+static const size_t DefaultRetainedOrders = 10000;
+
+static std::string serializeState(Order::State state)
+{
+	switch(state)
+	{
+	case Order::State::Cancelled:
+		return "cancelled";
+	case Order::State::Executed:
+		return "executed";
+	case Order::State::PartiallyExecuted:
+		return "partially-executed";
+	case Order::State::Rejected:
+		return "rejected";
+	case Order::State::Submitted:
+		return "submitted";
+	case Order::State::Unsubmitted:
+		return "unsubmitted";
+	case Order::State::Error:
+		return "error";
+	}
+	return "unknown";
+}
+
+static Order::State deserializeState(const std::string& str)
+{
+	if(str == "cancelled")
+		return Order::State::Cancelled;
+	else if(str == "executed")
+		return Order::State::Executed;
+	else if(str == "partially-executed")
+		return Order::State::PartiallyExecuted;
+	else if(str == "rejected")
+		return Order::State::Rejected;
+	else if(str == "submitted")
+		return Order::State::Submitted;
+	else if(str == "unsubmitted")
+		return Order::State::Unsubmitted;
+	else
+		return Order::State::Error;
+}
+
+static std::string serializeRecord(const Order::Ptr& order, const std::string& owner, time_t retiredAt)
+{
+	Json::Value root;
+	root["owner"] = owner;
+	root["local-id"] = order->localId();
+	root["id"] = order->clientAssignedId();
+	root["account"] = order->account();
+	root["security"] = order->security();
+	root["type"] = order->type() == Order::OrderType::Limit ? "limit" : "market";
+	root["operation"] = order->operation() == Order::Operation::Buy ? "buy" : "sell";
+	root["price"] = order->price();
+	root["quantity"] = order->quantity();
+	root["executed-quantity"] = order->executedQuantity();
+	root["state"] = serializeState(order->state());
+	root["retired-at"] = (Json::Int64)retiredAt;
+	if(!order->message().empty())
+		root["message"] = order->message();
+	if(!order->signalId().strategyId.empty())
+		root["strategy"] = order->signalId().strategyId;
+	if(!order->signalId().signalId.empty())
+		root["signal-id"] = order->signalId().signalId;
+	if(!order->signalId().comment.empty())
+		root["comment"] = order->signalId().comment;
+
+	// FastWriter terminates the record with a newline
+	Json::FastWriter writer;
+	return writer.write(root);
+}
+
+OrderArchive::OrderArchive(const std::string& path) : m_file(path, std::ios::out | std::ios::app),
+	m_run(true)
+{
+	if(!m_file)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unable to open order archive: " + path));
+	m_thread = boost::thread(std::bind(&OrderArchive::writerLoop, this));
+}
+
+OrderArchive::~OrderArchive()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(m_mutex);
+		m_run = false;
+		m_cv.notify_one();
+	}
+	if(m_thread.joinable())
+		m_thread.join();
+}
+
+void OrderArchive::append(const Order::Ptr& order, const std::string& owner, time_t retiredAt)
+{
+	boost::unique_lock<boost::mutex> lock(m_mutex);
+	m_pending.push_back(Pending { order, owner, retiredAt });
+	m_cv.notify_one();
+}
+
+void OrderArchive::flush()
+{
+	boost::unique_lock<boost::mutex> lock(m_fileMutex);
+	writePending();
+}
+
+void OrderArchive::writerLoop()
+{
+	while(true)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(m_mutex);
+			while(m_run && m_pending.empty())
+				m_cv.wait(lock);
+			if(!m_run && m_pending.empty())
+				break;
+		}
+
+		boost::unique_lock<boost::mutex> lock(m_fileMutex);
+		writePending();
+	}
+}
+
+void OrderArchive::writePending()
+{
+	std::vector<Pending> batch;
+	{
+		boost::unique_lock<boost::mutex> lock(m_mutex);
+		batch.swap(m_pending);
+	}
+	if(batch.empty())
+		return;
+
+	for(const auto& record : batch)
+		m_file << serializeRecord(record.order, record.owner, record.retiredAt);
+	m_file.flush();
+}
+
+std::vector<OrderArchive::Record> OrderArchive::read(const std::string& path)
+{
+	std::ifstream file(path);
+	if(!file)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unable to open order archive: " + path));
+
+	std::vector<Record> result;
+	std::string line;
+	int lineNumber = 0;
+	while(std::getline(file, line))
+	{
+		lineNumber++;
+		if(line.empty())
+			continue;
+
+		Json::Value root;
+		Json::Reader reader;
+		if(!reader.parse(line, root) || !root.isObject())
+		{
+			if(file.eof())
+				break;
+			BOOST_THROW_EXCEPTION(FormatError() << errinfo_str("Malformed order archive record at line " + std::to_string(lineNumber)));
+		}
+
+		auto order = std::make_shared<Order>(root["id"].asInt(),
+				root["account"].asString(),
+				root["security"].asString(),
+				root["price"].asDouble(),
+				root["quantity"].asInt(),
+				root["operation"].asString() == "buy" ? Order::Operation::Buy : Order::Operation::Sell,
+				root["type"].asString() == "limit" ? Order::OrderType::Limit : Order::OrderType::Market);
+		order->setExecutedQuantity(root["executed-quantity"].asInt());
+		order->updateState(deserializeState(root["state"].asString()));
+		order->setMessage(root["message"].asString());
+		order->setSignalId(SignalId(root["strategy"].asString(), root["signal-id"].asString(), root["comment"].asString()));
+
+		Record record;
+		record.order = order;
+		record.localId = root["local-id"].asInt();
+		record.owner = root["owner"].asString();
+		record.retiredAt = root["retired-at"].asInt64();
+		result.push_back(record);
+	}
+	return result;
+}
+
+RetentionPolicy::RetentionPolicy() : maxOrders(DefaultRetainedOrders),
+	maxAge(0)
+{
+}
+
+RetiredOrders::RetiredOrders()
+{
+}
+
+RetiredOrders::~RetiredOrders()
+{
+	while(!m_orders.empty())
+		evictFront();
+}
+
+void RetiredOrders::setPolicy(const RetentionPolicy& policy)
+{
+	m_policy = policy;
+}
+
+void RetiredOrders::setArchive(const OrderArchive::Ptr& archive, const std::string& owner)
+{
+	m_archive = archive;
+	m_owner = owner;
+}
+
+void RetiredOrders::add(const Order::Ptr& order)
+{
+	Entry entry;
+	entry.order = order;
+	entry.retired = boost::chrono::steady_clock::now();
+	entry.retiredAt = time(nullptr);
+	m_orders.push_back(entry);
+	m_ids.insert(order->clientAssignedId());
+
+	while((m_policy.maxOrders > 0) && (m_orders.size() > m_policy.maxOrders))
+		evictFront();
+	expire();
+}
+
+void RetiredOrders::expire()
+{
+	if(m_policy.maxAge.count() == 0)
+		return;
+
+	auto now = boost::chrono::steady_clock::now();
+	while(!m_orders.empty() && (now - m_orders.front().retired > m_policy.maxAge))
+		evictFront();
+}
+
+size_t RetiredOrders::size() const
+{
+	return m_orders.size();
+}
+
+bool RetiredOrders::contains(int clientAssignedId) const
+{
+	return m_ids.find(clientAssignedId) != m_ids.end();
+}
+
+void RetiredOrders::evictFront()
+{
+	const auto& entry = m_orders.front();
+	if(m_archive)
+		m_archive->append(entry.order, m_owner, entry.retiredAt);
+	m_ids.erase(m_ids.find(entry.order->clientAssignedId()));
+	m_orders.pop_front();
+}
+
+}
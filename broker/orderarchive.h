@@ -0,0 +1,137 @@
+
+#ifndef BROKER_ORDERARCHIVE_H_
+#define BROKER_ORDERARCHIVE_H_
+
+#include "broker.h"
+
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace goldmine
+{
+
+/*
+ * Append-only archive of retired orders, one JSON object per line.
+ * Records are written and flushed in batches by a thread of the archive, so that append()
+ * does not wait for the disk. Safe to share between threads.
+ */
+class OrderArchive
+{
+public:
+	using Ptr = std::shared_ptr<OrderArchive>;
+
+	struct Record
+	{
+		Order::Ptr order; // restored order, its localId() differs from the original one
+		int localId;
+		std::string owner; // identity of the client connection
+		time_t retiredAt;
+	};
+
+	// Throws ParameterError if the file can not be opened
+	explicit OrderArchive(const std::string& path);
+
+	// Records appended so far are written before the thread exits
+	virtual ~OrderArchive();
+
+	// Only queues the record; the order should not change after it is retired
+	void append(const Order::Ptr& order, const std::string& owner, time_t retiredAt);
+
+	// Writes records appended so far and flushes the file
+	void flush();
+
+	/*
+	 * Reads all records of the archive. Incomplete last line, e.g. after a crash, is skipped,
+	 * other malformed lines cause FormatError.
+	 */
+	static std::vector<Record> read(const std::string& path);
+
+private:
+	struct Pending
+	{
+		Order::Ptr order;
+		std::string owner;
+		time_t retiredAt;
+	};
+
+	void writerLoop();
+
+	// Should be called with m_fileMutex held
+	void writePending();
+
+	std::ofstream m_file;
+	boost::mutex m_fileMutex; // keeps batches in order of appending
+	boost::mutex m_mutex;
+	boost::condition_variable m_cv;
+	std::vector<Pending> m_pending;
+	bool m_run;
+	boost::thread m_thread;
+};
+
+/*
+ * Orders are kept after retirement only for a while: the oldest ones are evicted when there are more
+ * than maxOrders of them or when they are older than maxAge. 0 means no limit.
+ */
+struct RetentionPolicy
+{
+	RetentionPolicy();
+
+	size_t maxOrders;
+	boost::chrono::milliseconds maxAge;
+};
+
+/*
+ * Recently retired orders, bounded by RetentionPolicy. Evicted orders are written to
+ * the archive, if one is set. Client-assigned ids of the orders still kept are looked up
+ * by contains(), so that they are not reused. Not thread-safe.
+ */
+class RetiredOrders
+{
+public:
+	RetiredOrders();
+
+	// Orders still kept are archived on destruction
+	virtual ~RetiredOrders();
+
+	void setPolicy(const RetentionPolicy& policy);
+	void setArchive(const OrderArchive::Ptr& archive, const std::string& owner);
+
+	void add(const Order::Ptr& order);
+
+	// Evicts orders that are older than maxAge, should be called periodically
+	void expire();
+
+	size_t size() const;
+
+	// True if an order with given client-assigned id is still kept
+	bool contains(int clientAssignedId) const;
+
+private:
+	struct Entry
+	{
+		Order::Ptr order;
+		boost::chrono::steady_clock::time_point retired;
+		time_t retiredAt;
+	};
+
+	void evictFront();
+
+	RetentionPolicy m_policy;
+	OrderArchive::Ptr m_archive;
+	std::string m_owner;
+	std::deque<Entry> m_orders;
+	std::unordered_multiset<int> m_ids;
+};
+
+}
+
+#endif /* BROKER_ORDERARCHIVE_H_ */
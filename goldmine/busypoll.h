@@ -0,0 +1,89 @@
+
+#ifndef GOLDMINE_BUSYPOLL_H_
+#define GOLDMINE_BUSYPOLL_H_
+
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace goldmine
+{
+	/*
+	 * Busy-poll receive: the line is read with non-blocking reads (see nonBlockingReceiveTimeout) in a
+	 * tight loop instead of blocking in the kernel, which removes wakeup latency at the cost of a busy core per reader.
+	 * An idle reader spins `spinRounds` times with a CPU pause between reads, then yields
+	 * `yieldRounds` times, then sleeps for `sleepInterval` between reads until data comes again.
+	 * Zero sleepInterval means yielding for as long as the line is idle.
+	 */
+	struct BusyPollPolicy
+	{
+		BusyPollPolicy() : enabled(false),
+			spinRounds(1000),
+			yieldRounds(1000),
+			sleepInterval(50)
+		{
+		}
+
+		bool valid() const
+		{
+			return (spinRounds >= 0) && (yieldRounds >= 0) && (sleepInterval.count() >= 0);
+		}
+
+		bool enabled;
+		int spinRounds;
+		int yieldRounds;
+		boost::chrono::microseconds sleepInterval;
+	};
+
+	class BusyPollBackoff
+	{
+	public:
+		explicit BusyPollBackoff(const BusyPollPolicy& policy) : m_policy(policy),
+			m_idleRounds(0)
+		{
+		}
+
+		// Called after a read that returned nothing
+		void idle()
+		{
+			if(m_idleRounds < m_policy.spinRounds)
+			{
+				m_idleRounds++;
+				pause();
+			}
+			else if((m_idleRounds < m_policy.spinRounds + m_policy.yieldRounds) || (m_policy.sleepInterval.count() == 0))
+			{
+				m_idleRounds++;
+				boost::this_thread::yield();
+			}
+			else
+			{
+				boost::this_thread::sleep_for(m_policy.sleepInterval);
+			}
+		}
+
+		// Called after a read that returned data
+		void reset()
+		{
+			m_idleRounds = 0;
+		}
+
+	private:
+		static void pause()
+		{
+#if defined(__x86_64__) || defined(__i386__)
+			_mm_pause();
+#elif defined(__aarch64__)
+			asm volatile("yield");
+#endif
+		}
+
+		BusyPollPolicy m_policy;
+		int m_idleRounds;
+	};
+}
+
+#endif /* GOLDMINE_BUSYPOLL_H_ */
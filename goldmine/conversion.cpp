@@ -0,0 +1,548 @@
+
+#include "goldmine/conversion.h"
+#include "goldmine/exceptions.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace goldmine
+{
+
+// Vector kernels load and store packed decimal_fixed as 12 bytes: int64 value, int32 fractional
+static_assert(sizeof(decimal_fixed) == 12 && offsetof(decimal_fixed, value) == 0 && offsetof(decimal_fixed, fractional) == 8,
+		"Unexpected decimal_fixed layout");
+
+namespace
+{
+
+void decimalsToDoubles_generic(const decimal_fixed* in, double* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		out[i] = in[i].toDouble();
+}
+
+void doublesToDecimals_generic(const double* in, decimal_fixed* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		out[i] = decimal_fixed(in[i]);
+}
+
+void decimalsToScaled_generic(const decimal_fixed* in, int64_t* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		out[i] = in[i].toScaled();
+}
+
+void scaledToDecimals_generic(const int64_t* in, decimal_fixed* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		out[i] = decimal_fixed::fromScaled(in[i]);
+}
+
+void priceColumnsToDoubles_generic(const int64_t* values, const int32_t* fractionals, double* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		out[i] = (double)values[i] + (double)fractionals[i] / 1e9;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+ * Neither AVX2 nor SSE4.2 convert between int64 and double. Integers within +-2^51 are converted exactly
+ * by adding them to the bit pattern of 1.5 * 2^52 and subtracting 1.5 * 2^52 as doubles, and back the other way;
+ * a block with a value out of that range falls back to the scalar conversion. Integer multiplication by 1e9 is
+ * made of 32x32 -> 64 bit products, modulo 2^64 as in the scalar code. Every floating point step is a single
+ * correctly rounded operation, the same as in decimal_fixed, so results match it bit for bit.
+ */
+const int64_t MagicBits = 0x4338000000000000ll;
+const double Magic = 6755399441055744.; // 1.5 * 2^52
+const int64_t RangeBias = 1ll << 51;
+const double RangeLimit = 2251799813685248.; // 2^51
+
+#define GOLDMINE_SSE42 __attribute__((target("sse4.2")))
+#define GOLDMINE_AVX2 __attribute__((target("avx2")))
+
+/*
+ * Four packed decimal_fixed take three 16-byte words, dwords [v0 v0 f0 v1] [v1 f1 v2 v2] [f2 v3 v3 f3].
+ * They are split into the values of the first two, the values of the last two and the four fractionals,
+ * and put back together, with dword shuffles and blends. Used by both kernel sets: AVX2 implies SSE4.2.
+ */
+GOLDMINE_SSE42 inline void loadDecimals4(const decimal_fixed* in, __m128i& values01, __m128i& values23, __m128i& fractionals)
+{
+	const char* bytes = reinterpret_cast<const char*>(in);
+	__m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+	__m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 16));
+	__m128i c2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 32));
+
+	values01 = _mm_blend_epi16(_mm_shuffle_epi32(c0, _MM_SHUFFLE(0, 3, 1, 0)), _mm_shuffle_epi32(c1, _MM_SHUFFLE(0, 0, 0, 0)), 0xc0);
+	values23 = _mm_blend_epi16(_mm_shuffle_epi32(c1, _MM_SHUFFLE(0, 0, 3, 2)), _mm_shuffle_epi32(c2, _MM_SHUFFLE(2, 1, 0, 0)), 0xf0);
+	fractionals = _mm_blend_epi16(_mm_blend_epi16(_mm_shuffle_epi32(c0, _MM_SHUFFLE(0, 0, 0, 2)),
+				_mm_shuffle_epi32(c1, _MM_SHUFFLE(0, 0, 1, 0)), 0x0c),
+			_mm_shuffle_epi32(c2, _MM_SHUFFLE(3, 0, 0, 0)), 0xf0);
+}
+
+GOLDMINE_SSE42 inline void storeDecimals4(decimal_fixed* out, __m128i values01, __m128i values23, __m128i fractionals)
+{
+	char* bytes = reinterpret_cast<char*>(out);
+	__m128i c0 = _mm_blend_epi16(_mm_shuffle_epi32(values01, _MM_SHUFFLE(2, 0, 1, 0)), _mm_shuffle_epi32(fractionals, _MM_SHUFFLE(0, 0, 0, 0)), 0x30);
+	__m128i c1 = _mm_blend_epi16(_mm_blend_epi16(_mm_shuffle_epi32(values01, _MM_SHUFFLE(0, 0, 0, 3)),
+				_mm_shuffle_epi32(fractionals, _MM_SHUFFLE(0, 0, 1, 0)), 0x0c),
+			_mm_shuffle_epi32(values23, _MM_SHUFFLE(1, 0, 0, 0)), 0xf0);
+	__m128i c2 = _mm_blend_epi16(_mm_shuffle_epi32(values23, _MM_SHUFFLE(0, 3, 2, 0)), _mm_shuffle_epi32(fractionals, _MM_SHUFFLE(3, 0, 0, 2)), 0xc3);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), c0);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(bytes + 16), c1);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(bytes + 32), c2);
+}
+
+// Low dwords of four int64, which should fit in int32
+GOLDMINE_SSE42 inline __m128i narrow(__m128i low, __m128i high)
+{
+	return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+GOLDMINE_AVX2 inline bool inRange_avx2(__m256i v)
+{
+	__m256i outOfRange = _mm256_srli_epi64(_mm256_add_epi64(v, _mm256_set1_epi64x(RangeBias)), 52);
+	return _mm256_testz_si256(outOfRange, outOfRange);
+}
+
+GOLDMINE_AVX2 inline __m256d int64ToDouble_avx2(__m256i v)
+{
+	return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(v, _mm256_set1_epi64x(MagicBits))), _mm256_set1_pd(Magic));
+}
+
+// `v` should hold integers within +-2^51
+GOLDMINE_AVX2 inline __m256i doubleToInt64_avx2(__m256d v)
+{
+	return _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(v, _mm256_set1_pd(Magic))), _mm256_set1_epi64x(MagicBits));
+}
+
+GOLDMINE_AVX2 inline __m256i mulScale_avx2(__m256i v)
+{
+	const __m256i scale = _mm256_set1_epi64x(DecimalFixedScale);
+	__m256i low = _mm256_mul_epu32(v, scale);
+	__m256i high = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), scale);
+	return _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+}
+
+GOLDMINE_AVX2 inline __m256d toDoubles_avx2(__m256i values, __m128i fractionals)
+{
+	return _mm256_add_pd(int64ToDouble_avx2(values), _mm256_div_pd(_mm256_cvtepi32_pd(fractionals), _mm256_set1_pd(1e9)));
+}
+
+GOLDMINE_AVX2 inline void loadDecimals_avx2(const decimal_fixed* in, __m256i& values, __m128i& fractionals)
+{
+	__m128i values01;
+	__m128i values23;
+	loadDecimals4(in, values01, values23, fractionals);
+	values = _mm256_inserti128_si256(_mm256_castsi128_si256(values01), values23, 1);
+}
+
+GOLDMINE_AVX2 inline void storeDecimals_avx2(decimal_fixed* out, __m256i values, __m128i fractionals)
+{
+	storeDecimals4(out, _mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1), fractionals);
+}
+
+GOLDMINE_AVX2 void decimalsToDoubles_avx2(const decimal_fixed* in, double* out, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m256i values;
+		__m128i fractionals;
+		loadDecimals_avx2(in + i, values, fractionals);
+		if(!inRange_avx2(values))
+			decimalsToDoubles_generic(in + i, out + i, 4);
+		else
+			_mm256_storeu_pd(out + i, toDoubles_avx2(values, fractionals));
+	}
+	decimalsToDoubles_generic(in + i, out + i, count - i);
+}
+
+GOLDMINE_AVX2 void doublesToDecimals_avx2(const double* in, decimal_fixed* out, size_t count)
+{
+	const __m256d scale = _mm256_set1_pd(1e9);
+	const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffll));
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m256d v = _mm256_loadu_pd(in + i);
+		__m256d intPart = _mm256_floor_pd(v);
+		// Also false for NaN
+		__m256d inRange = _mm256_cmp_pd(_mm256_and_pd(intPart, absMask), _mm256_set1_pd(RangeLimit), _CMP_LT_OQ);
+		if(_mm256_movemask_pd(inRange) != 0xf)
+		{
+			doublesToDecimals_generic(in + i, out + i, 4);
+			continue;
+		}
+
+		__m256d nano = _mm256_floor_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(v, intPart), scale), _mm256_set1_pd(0.5)));
+		__m256d carry = _mm256_cmp_pd(nano, scale, _CMP_GE_OQ);
+		intPart = _mm256_add_pd(intPart, _mm256_and_pd(carry, _mm256_set1_pd(1.)));
+		nano = _mm256_sub_pd(nano, _mm256_and_pd(carry, scale));
+
+		storeDecimals_avx2(out + i, doubleToInt64_avx2(intPart), _mm256_cvttpd_epi32(nano));
+	}
+	doublesToDecimals_generic(in + i, out + i, count - i);
+}
+
+GOLDMINE_AVX2 void decimalsToScaled_avx2(const decimal_fixed* in, int64_t* out, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m256i values;
+		__m128i fractionals;
+		loadDecimals_avx2(in + i, values, fractionals);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_add_epi64(mulScale_avx2(values), _mm256_cvtepi32_epi64(fractionals)));
+	}
+	decimalsToScaled_generic(in + i, out + i, count - i);
+}
+
+/*
+ * The quotient is estimated in doubles and may be off by one near integers,
+ * so the remainder is brought back to [0, 1e9) with one correction step.
+ */
+GOLDMINE_AVX2 void scaledToDecimals_avx2(const int64_t* in, decimal_fixed* out, size_t count)
+{
+	const __m256i scale = _mm256_set1_epi64x(DecimalFixedScale);
+	const __m256i maxRemainder = _mm256_set1_epi64x(DecimalFixedScale - 1);
+
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m256i scaled = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		if(!inRange_avx2(scaled))
+		{
+			scaledToDecimals_generic(in + i, out + i, 4);
+			continue;
+		}
+
+		__m256i quotient = doubleToInt64_avx2(_mm256_floor_pd(_mm256_div_pd(int64ToDouble_avx2(scaled), _mm256_set1_pd(1e9))));
+		__m256i remainder = _mm256_sub_epi64(scaled, mulScale_avx2(quotient));
+
+		__m256i negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(), remainder);
+		quotient = _mm256_add_epi64(quotient, negative);
+		remainder = _mm256_add_epi64(remainder, _mm256_and_si256(negative, scale));
+		__m256i overflow = _mm256_cmpgt_epi64(remainder, maxRemainder);
+		quotient = _mm256_sub_epi64(quotient, overflow);
+		remainder = _mm256_sub_epi64(remainder, _mm256_and_si256(overflow, scale));
+
+		storeDecimals_avx2(out + i, quotient, narrow(_mm256_castsi256_si128(remainder), _mm256_extracti128_si256(remainder, 1)));
+	}
+	scaledToDecimals_generic(in + i, out + i, count - i);
+}
+
+GOLDMINE_AVX2 void priceColumnsToDoubles_avx2(const int64_t* values, const int32_t* fractionals, double* out, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+		if(!inRange_avx2(v))
+		{
+			priceColumnsToDoubles_generic(values + i, fractionals + i, out + i, 4);
+			continue;
+		}
+		__m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fractionals + i));
+		_mm256_storeu_pd(out + i, toDoubles_avx2(v, f));
+	}
+	priceColumnsToDoubles_generic(values + i, fractionals + i, out + i, count - i);
+}
+
+/*
+ * SSE4.2 kernels do the same on two values per instruction, for CPUs without AVX2.
+ */
+GOLDMINE_SSE42 inline bool inRange_sse42(__m128i v)
+{
+	__m128i outOfRange = _mm_srli_epi64(_mm_add_epi64(v, _mm_set1_epi64x(RangeBias)), 52);
+	return _mm_testz_si128(outOfRange, outOfRange);
+}
+
+GOLDMINE_SSE42 inline __m128d int64ToDouble_sse42(__m128i v)
+{
+	return _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(v, _mm_set1_epi64x(MagicBits))), _mm_set1_pd(Magic));
+}
+
+GOLDMINE_SSE42 inline __m128i doubleToInt64_sse42(__m128d v)
+{
+	return _mm_sub_epi64(_mm_castpd_si128(_mm_add_pd(v, _mm_set1_pd(Magic))), _mm_set1_epi64x(MagicBits));
+}
+
+GOLDMINE_SSE42 inline __m128i mulScale_sse42(__m128i v)
+{
+	const __m128i scale = _mm_set1_epi64x(DecimalFixedScale);
+	__m128i low = _mm_mul_epu32(v, scale);
+	__m128i high = _mm_mul_epu32(_mm_srli_epi64(v, 32), scale);
+	return _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+}
+
+// `fractionals` holds two int32 in its low half
+GOLDMINE_SSE42 inline __m128d toDoubles_sse42(__m128i values, __m128i fractionals)
+{
+	return _mm_add_pd(int64ToDouble_sse42(values), _mm_div_pd(_mm_cvtepi32_pd(fractionals), _mm_set1_pd(1e9)));
+}
+
+GOLDMINE_SSE42 inline __m128i highHalf(__m128i v)
+{
+	return _mm_unpackhi_epi64(v, v);
+}
+
+GOLDMINE_SSE42 void decimalsToDoubles_sse42(const decimal_fixed* in, double* out, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i values01;
+		__m128i values23;
+		__m128i fractionals;
+		loadDecimals4(in + i, values01, values23, fractionals);
+		if(!inRange_sse42(values01) || !inRange_sse42(values23))
+		{
+			decimalsToDoubles_generic(in + i, out + i, 4);
+			continue;
+		}
+		_mm_storeu_pd(out + i, toDoubles_sse42(values01, fractionals));
+		_mm_storeu_pd(out + i + 2, toDoubles_sse42(values23, highHalf(fractionals)));
+	}
+	decimalsToDoubles_generic(in + i, out + i, count - i);
+}
+
+GOLDMINE_SSE42 inline bool doubleToDecimals_sse42(__m128d v, __m128i& values, __m128i& nanos)
+{
+	const __m128d scale = _mm_set1_pd(1e9);
+	const __m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffll));
+
+	__m128d intPart = _mm_floor_pd(v);
+	__m128d inRange = _mm_cmplt_pd(_mm_and_pd(intPart, absMask), _mm_set1_pd(RangeLimit));
+	if(_mm_movemask_pd(inRange) != 0x3)
+		return false;
+
+	__m128d nano = _mm_floor_pd(_mm_add_pd(_mm_mul_pd(_mm_sub_pd(v, intPart), scale), _mm_set1_pd(0.5)));
+	__m128d carry = _mm_cmpge_pd(nano, scale);
+	intPart = _mm_add_pd(intPart, _mm_and_pd(carry, _mm_set1_pd(1.)));
+	nano = _mm_sub_pd(nano, _mm_and_pd(carry, scale));
+
+	values = doubleToInt64_sse42(intPart);
+	nanos = _mm_cvttpd_epi32(nano);
+	return true;
+}
+
+GOLDMINE_SSE42 void doublesToDecimals_sse42(const double* in, decimal_fixed* out, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i values01;
+		__m128i values23;
+		__m128i nanos01;
+		__m128i nanos23;
+		if(!doubleToDecimals_sse42(_mm_loadu_pd(in + i), values01, nanos01) ||
+				!doubleToDecimals_sse42(_mm_loadu_pd(in + i + 2), values23, nanos23))
+		{
+			doublesToDecimals_generic(in + i, out + i, 4);
+			continue;
+		}
+		storeDecimals4(out + i, values01, values23, _mm_unpacklo_epi64(nanos01, nanos23));
+	}
+	doublesToDecimals_generic(in + i, out + i, count - i);
+}
+
+GOLDMINE_SSE42 void decimalsToScaled_sse42(const decimal_fixed* in, int64_t* out, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i values01;
+		__m128i values23;
+		__m128i fractionals;
+		loadDecimals4(in + i, values01, values23, fractionals);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi64(mulScale_sse42(values01), _mm_cvtepi32_epi64(fractionals)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 2), _mm_add_epi64(mulScale_sse42(values23), _mm_cvtepi32_epi64(highHalf(fractionals))));
+	}
+	decimalsToScaled_generic(in + i, out + i, count - i);
+}
+
+GOLDMINE_SSE42 inline void scaledToDecimal_sse42(__m128i scaled, __m128i& quotient, __m128i& remainder)
+{
+	const __m128i scale = _mm_set1_epi64x(DecimalFixedScale);
+
+	quotient = doubleToInt64_sse42(_mm_floor_pd(_mm_div_pd(int64ToDouble_sse42(scaled), _mm_set1_pd(1e9))));
+	remainder = _mm_sub_epi64(scaled, mulScale_sse42(quotient));
+
+	__m128i negative = _mm_cmpgt_epi64(_mm_setzero_si128(), remainder);
+	quotient = _mm_add_epi64(quotient, negative);
+	remainder = _mm_add_epi64(remainder, _mm_and_si128(negative, scale));
+	__m128i overflow = _mm_cmpgt_epi64(remainder, _mm_set1_epi64x(DecimalFixedScale - 1));
+	quotient = _mm_sub_epi64(quotient, overflow);
+	remainder = _mm_sub_epi64(remainder, _mm_and_si128(overflow, scale));
+}
+
+GOLDMINE_SSE42 void scaledToDecimals_sse42(const int64_t* in, decimal_fixed* out, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i scaled01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		__m128i scaled23 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 2));
+		if(!inRange_sse42(scaled01) || !inRange_sse42(scaled23))
+		{
+			scaledToDecimals_generic(in + i, out + i, 4);
+			continue;
+		}
+
+		__m128i values01;
+		__m128i values23;
+		__m128i remainders01;
+		__m128i remainders23;
+		scaledToDecimal_sse42(scaled01, values01, remainders01);
+		scaledToDecimal_sse42(scaled23, values23, remainders23);
+		storeDecimals4(out + i, values01, values23, narrow(remainders01, remainders23));
+	}
+	scaledToDecimals_generic(in + i, out + i, count - i);
+}
+
+GOLDMINE_SSE42 void priceColumnsToDoubles_sse42(const int64_t* values, const int32_t* fractionals, double* out, size_t count)
+{
+	size_t i = 0;
+	for(; i + 2 <= count; i += 2)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+		if(!inRange_sse42(v))
+		{
+			priceColumnsToDoubles_generic(values + i, fractionals + i, out + i, 2);
+			continue;
+		}
+		__m128i f = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(fractionals + i));
+		_mm_storeu_pd(out + i, toDoubles_sse42(v, f));
+	}
+	priceColumnsToDoubles_generic(values + i, fractionals + i, out + i, count - i);
+}
+#endif
+
+struct ConversionKernels
+{
+	const char* name;
+	void (*decimalsToDoubles)(const decimal_fixed*, double*, size_t);
+	void (*doublesToDecimals)(const double*, decimal_fixed*, size_t);
+	void (*decimalsToScaled)(const decimal_fixed*, int64_t*, size_t);
+	void (*scaledToDecimals)(const int64_t*, decimal_fixed*, size_t);
+	void (*priceColumnsToDoubles)(const int64_t*, const int32_t*, double*, size_t);
+	bool (*supported)();
+};
+
+bool alwaysSupported()
+{
+	return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+bool avx2Supported()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+bool sse42Supported()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+// Fastest first
+const ConversionKernels Kernels[] =
+{
+#if defined(__x86_64__) || defined(__i386__)
+	{ "avx2", decimalsToDoubles_avx2, doublesToDecimals_avx2, decimalsToScaled_avx2, scaledToDecimals_avx2,
+		priceColumnsToDoubles_avx2, avx2Supported },
+	{ "sse4.2", decimalsToDoubles_sse42, doublesToDecimals_sse42, decimalsToScaled_sse42, scaledToDecimals_sse42,
+		priceColumnsToDoubles_sse42, sse42Supported },
+#endif
+	{ "generic", decimalsToDoubles_generic, doublesToDecimals_generic, decimalsToScaled_generic, scaledToDecimals_generic,
+		priceColumnsToDoubles_generic, alwaysSupported },
+};
+
+const ConversionKernels* detectKernels()
+{
+	for(const auto& kernels : Kernels)
+	{
+		if(kernels.supported())
+			return &kernels;
+	}
+	return &Kernels[sizeof(Kernels) / sizeof(Kernels[0]) - 1];
+}
+
+std::atomic<const ConversionKernels*>& currentKernels()
+{
+	static std::atomic<const ConversionKernels*> current(detectKernels());
+	return current;
+}
+
+const ConversionKernels& kernels()
+{
+	return *currentKernels().load(std::memory_order_relaxed);
+}
+
+}
+
+void decimalsToDoubles(const decimal_fixed* in, double* out, size_t count)
+{
+	kernels().decimalsToDoubles(in, out, count);
+}
+
+void doublesToDecimals(const double* in, decimal_fixed* out, size_t count)
+{
+	kernels().doublesToDecimals(in, out, count);
+}
+
+void decimalsToScaled(const decimal_fixed* in, int64_t* out, size_t count)
+{
+	kernels().decimalsToScaled(in, out, count);
+}
+
+void scaledToDecimals(const int64_t* in, decimal_fixed* out, size_t count)
+{
+	kernels().scaledToDecimals(in, out, count);
+}
+
+void priceColumnsToDoubles(const int64_t* values, const int32_t* fractionals, double* out, size_t count)
+{
+	kernels().priceColumnsToDoubles(values, fractionals, out, count);
+}
+
+const char* conversionKernelName()
+{
+	return kernels().name;
+}
+
+std::vector<std::string> supportedConversionKernels()
+{
+	std::vector<std::string> result;
+	for(const auto& kernels : Kernels)
+	{
+		if(kernels.supported())
+			result.push_back(kernels.name);
+	}
+	return result;
+}
+
+void selectConversionKernel(const std::string& name)
+{
+	for(const auto& kernels : Kernels)
+	{
+		if((name == kernels.name) && kernels.supported())
+		{
+			currentKernels().store(&kernels, std::memory_order_relaxed);
+			return;
+		}
+	}
+	BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Conversion kernel is not supported: " + name));
+}
+
+}
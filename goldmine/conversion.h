@@ -0,0 +1,39 @@
+
+#ifndef GOLDMINE_CONVERSION_H_
+#define GOLDMINE_CONVERSION_H_
+
+#include "goldmine/data.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace goldmine
+{
+	/*
+	 * Batch conversions of prices, with results identical to the scalar decimal_fixed
+	 * conversions. Every conversion has AVX2, SSE4.2 and generic kernels; the fastest one
+	 * the CPU supports is selected on first use.
+	 */
+
+	void decimalsToDoubles(const decimal_fixed* in, double* out, size_t count);
+	void doublesToDecimals(const double* in, decimal_fixed* out, size_t count);
+
+	void decimalsToScaled(const decimal_fixed* in, int64_t* out, size_t count);
+	void scaledToDecimals(const int64_t* in, decimal_fixed* out, size_t count);
+
+	// Same as decimalsToDoubles, for the price columns of TickBatch
+	void priceColumnsToDoubles(const int64_t* values, const int32_t* fractionals, double* out, size_t count);
+
+	// Name of the kernels in use: "avx2", "sse4.2" or "generic"
+	const char* conversionKernelName();
+
+	// Kernels this CPU can run, fastest first
+	std::vector<std::string> supportedConversionKernels();
+
+	// Overrides the automatic choice, e.g. for tests and benchmarks. Throws ParameterError if `name` is not supported
+	void selectConversionKernel(const std::string& name);
+}
+
+#endif /* GOLDMINE_CONVERSION_H_ */
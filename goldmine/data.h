@@ -3,6 +3,7 @@
 #define GOLDMINE_DATA_H_
 
 #include <cstdint>
+#include <cstddef>
 #include <cmath>
 #include <utility>
 
@@ -13,7 +14,8 @@ namespace goldmine
 		Control = 0x01,
 		Data = 0x02,
 		Service = 0x03,
-		Event = 0x04
+		Event = 0x04,
+		Binary = 0x05
 	};
 
 	enum class PacketType
@@ -24,7 +26,8 @@ namespace goldmine
 
 	enum class EventId
 	{
-		StreamEnd = 0x01
+		StreamEnd = 0x01,
+		StreamGap = 0x02
 	};
 
 	enum class ServiceDataType
@@ -46,26 +49,35 @@ namespace goldmine
 		TotalDemand = 0x0a
 	};
 
+	static constexpr int64_t DecimalFixedScale = 1000000000;
+
 #pragma pack(push, 1)
+	/*
+	 * Fixed-point decimal with 1e-9 resolution.
+	 * Normalized values have fractional in [0, 1e9), so -1.25 is stored as (-2, 750000000).
+	 * Arithmetic keeps values normalized and exact; toScaled()/fromScaled() convert to and
+	 * from a single int64 of 1e-9 units, which is exact for |value| < 9.2e9.
+	 */
 	struct decimal_fixed
 	{
 		int64_t value;
 		int32_t fractional; // 1e-9 parts
 
-		decimal_fixed() : value(0), fractional(0)
+		constexpr decimal_fixed() : value(0), fractional(0)
 		{
 		}
-		decimal_fixed(int64_t int_part, int32_t nano) : value(int_part), fractional(nano)
+		constexpr decimal_fixed(int64_t int_part, int32_t nano) : value(int_part), fractional(nano)
 		{
 		}
 
-		decimal_fixed(double v) : value(::floor(v)), fractional((v - floor(v)) * 1e9)
-		{
-
-		}
-
-		~decimal_fixed()
+		// Rounds to the nearest 1e-9
+		decimal_fixed(double v) : value((int64_t)::floor(v)), fractional((int32_t)::floor((v - ::floor(v)) * 1e9 + 0.5))
 		{
+			if(fractional >= DecimalFixedScale)
+			{
+				value++;
+				fractional -= DecimalFixedScale;
+			}
 		}
 
 		decimal_fixed(const decimal_fixed& other) = default;
@@ -78,35 +90,212 @@ namespace goldmine
 			return (double)value + (double)fractional / 1e9;
 		}
 
-		bool operator==(const decimal_fixed& other) const
+		constexpr int64_t toScaled() const
 		{
-			return (value == other.value) && (fractional == other.fractional);
+			return value * DecimalFixedScale + fractional;
+		}
+
+		static constexpr decimal_fixed fromScaled(int64_t scaled)
+		{
+			return decimal_fixed(floorDiv(scaled, DecimalFixedScale), floorMod(scaled, DecimalFixedScale));
+		}
+
+		// Carries an arbitrary (possibly negative or overflowing) fractional part into value
+		static constexpr decimal_fixed normalized(int64_t int_part, int64_t nano)
+		{
+			return decimal_fixed(int_part + floorDiv(nano, DecimalFixedScale), floorMod(nano, DecimalFixedScale));
+		}
+
+		constexpr decimal_fixed operator+(const decimal_fixed& other) const
+		{
+			return normalized(value + other.value, (int64_t)fractional + other.fractional);
+		}
+
+		constexpr decimal_fixed operator-(const decimal_fixed& other) const
+		{
+			return normalized(value - other.value, (int64_t)fractional - other.fractional);
+		}
+
+		constexpr decimal_fixed operator-() const
+		{
+			return normalized(-value, -(int64_t)fractional);
+		}
+
+		// Multiplication by integer quantity, exact as long as the result fits
+		constexpr decimal_fixed operator*(int64_t quantity) const
+		{
+			return normalized(value * quantity, (int64_t)fractional * quantity);
+		}
+
+		decimal_fixed& operator+=(const decimal_fixed& other)
+		{
+			return *this = *this + other;
+		}
+
+		decimal_fixed& operator-=(const decimal_fixed& other)
+		{
+			return *this = *this - other;
+		}
+
+		decimal_fixed& operator*=(int64_t quantity)
+		{
+			return *this = *this * quantity;
 		}
 
-		bool operator<(const decimal_fixed& other) const
+		// Rounds to the nearest multiple of tickSize, halves are rounded up. tickSize should be positive
+		constexpr decimal_fixed roundToTick(const decimal_fixed& tickSize) const
 		{
-			if(value < other.value)
-				return true;
-			else if(value == other.value)
-				return fractional < other.fractional;
-			else
+			return fromScaled(floorDiv(toScaled() + tickSize.toScaled() / 2, tickSize.toScaled()) * tickSize.toScaled());
+		}
+
+		/*
+		 * Exact parsing of [+-]digits[.digits] with at most 9 significant fractional digits.
+		 * Returns false and leaves `out` untouched on malformed input.
+		 */
+		static bool parse(const char* str, size_t length, decimal_fixed& out)
+		{
+			size_t i = 0;
+			bool negative = false;
+			if(i < length && (str[i] == '-' || str[i] == '+'))
+			{
+				negative = (str[i] == '-');
+				i++;
+			}
+
+			uint64_t intPart = 0;
+			size_t intDigits = 0;
+			for(; i < length && str[i] >= '0' && str[i] <= '9'; i++, intDigits++)
+			{
+				if(intPart > (uint64_t)INT64_MAX / 10)
+					return false;
+				intPart = intPart * 10 + (str[i] - '0');
+			}
+			if(intPart > (uint64_t)INT64_MAX)
 				return false;
+
+			int64_t nano = 0;
+			size_t fracDigits = 0;
+			if(i < length && str[i] == '.')
+			{
+				i++;
+				for(; i < length && str[i] >= '0' && str[i] <= '9'; i++, fracDigits++)
+				{
+					if(fracDigits < 9)
+						nano = nano * 10 + (str[i] - '0');
+					else if(str[i] != '0')
+						return false;
+				}
+				for(size_t d = fracDigits; d < 9; d++)
+					nano *= 10;
+			}
+
+			if((i != length) || (intDigits + fracDigits == 0))
+				return false;
+
+			out = negative ? normalized(-(int64_t)intPart, -nano) : decimal_fixed(intPart, nano);
+			return true;
+		}
+
+		/*
+		 * Writes the shortest exact decimal representation and a terminating zero.
+		 * Returns the length of the representation; nothing is written if it does not fit into `size`.
+		 */
+		size_t format(char* buf, size_t size) const
+		{
+			char tmp[32];
+			char* end = tmp + sizeof(tmp);
+			char* p = end;
+
+			// The value may be not normalized. Its integer part is value + carry, and its magnitude is
+			// computed in unsigned arithmetic, which also covers INT64_MIN and overflow by the carry.
+			int64_t carry = floorDiv(fractional, DecimalFixedScale);
+			int64_t nano = floorMod(fractional, DecimalFixedScale);
+			bool negative = (value < -carry);
+			uint64_t intPart = (uint64_t)value + (uint64_t)carry;
+			if(negative)
+			{
+				intPart = 0 - intPart;
+				if(nano > 0)
+				{
+					intPart--;
+					nano = DecimalFixedScale - nano;
+				}
+			}
+
+			if(nano > 0)
+			{
+				int digits = 9;
+				while(nano % 10 == 0)
+				{
+					nano /= 10;
+					digits--;
+				}
+				for(; digits > 0; digits--)
+				{
+					*--p = '0' + nano % 10;
+					nano /= 10;
+				}
+				*--p = '.';
+			}
+
+			do
+			{
+				*--p = '0' + intPart % 10;
+				intPart /= 10;
+			} while(intPart > 0);
+
+			if(negative)
+				*--p = '-';
+
+			size_t length = end - p;
+			if(length + 1 > size)
+				return length;
+			for(size_t i = 0; i < length; i++)
+				buf[i] = p[i];
+			buf[length] = 0;
+			return length;
 		}
 
-		bool operator<=(const decimal_fixed& other) const
+		constexpr bool operator==(const decimal_fixed& other) const
+		{
+			return (value == other.value) && (fractional == other.fractional);
+		}
+
+		constexpr bool operator!=(const decimal_fixed& other) const
+		{
+			return !(*this == other);
+		}
+
+		constexpr bool operator<(const decimal_fixed& other) const
+		{
+			return (value < other.value) || ((value == other.value) && (fractional < other.fractional));
+		}
+
+		constexpr bool operator<=(const decimal_fixed& other) const
 		{
 			return (*this < other) || (*this == other);
 		}
 
-		bool operator>=(const decimal_fixed& other) const
+		constexpr bool operator>=(const decimal_fixed& other) const
 		{
 			return !(*this < other);
 		}
 
-		bool operator>(const decimal_fixed& other) const
+		constexpr bool operator>(const decimal_fixed& other) const
 		{
 			return !(*this <= other);
 		}
+
+	private:
+		static constexpr int64_t floorDiv(int64_t a, int64_t b)
+		{
+			return a / b - ((a % b < 0) ? 1 : 0);
+		}
+
+		static constexpr int64_t floorMod(int64_t a, int64_t b)
+		{
+			return a % b + ((a % b < 0) ? b : 0);
+		}
 	} __attribute__((packed,aligned(1)));
 
 	struct Tick
@@ -0,0 +1,185 @@
+
+#include "goldmine/nonblockingread.h"
+
+#include "cppio/ioline.h"
+#include "cppio/errors.h"
+
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <map>
+#include <memory>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace goldmine
+{
+
+namespace
+{
+
+// How long the probe waits for a connection and for the read to return
+const boost::chrono::milliseconds ProbeTimeout(100);
+
+struct ProbeRead
+{
+	ProbeRead() : done(false),
+		rc(0)
+	{
+	}
+
+	boost::mutex mutex;
+	boost::condition_variable cv;
+	bool done;
+	ssize_t rc;
+	std::unique_ptr<cppio::IoLine> line;
+};
+
+int freeTcpPort()
+{
+	int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0)
+		return -1;
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	socklen_t length = sizeof(address);
+	int port = -1;
+	if((::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) &&
+			(::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) == 0))
+	{
+		port = ntohs(address.sin_port);
+	}
+	::close(fd);
+	return port;
+}
+
+std::string endpointType(const std::string& endpoint)
+{
+	return endpoint.substr(0, endpoint.find("://"));
+}
+
+/*
+ * Private endpoint of the same type as `endpoint`, or an empty string if such an address can not be made.
+ * `path` is set to the file to remove afterwards, if any.
+ */
+std::string probeEndpoint(const std::string& endpoint, std::string& path)
+{
+	static std::atomic<int> counter(0);
+
+	auto separator = endpoint.find("://");
+	if(separator == std::string::npos)
+		return std::string();
+
+	auto type = endpoint.substr(0, separator);
+	auto name = "goldmine-probe-" + std::to_string(::getpid()) + "-" + std::to_string(counter++);
+	if(type == "inproc")
+		return "inproc://" + name;
+
+	if(type == "tcp")
+	{
+		int port = freeTcpPort();
+		if(port <= 0)
+			return std::string();
+		return "tcp://127.0.0.1:" + std::to_string(port);
+	}
+
+	// Line types addressed by a file, e.g. unix domain sockets
+	if(endpoint.compare(separator + 3, 1, "/") == 0)
+	{
+		path = "/tmp/" + name;
+		return type + "://" + path;
+	}
+	return std::string();
+}
+
+bool probe(cppio::IoLineManager& manager, const std::string& address)
+{
+	std::unique_ptr<cppio::IoAcceptor> acceptor(manager.createServer(address));
+	if(!acceptor)
+		return false;
+	std::unique_ptr<cppio::IoLine> client(manager.createClient(address));
+	if(!client)
+		return false;
+
+	// Shared with the reading thread, which may outlive the probe if the read can not be woken up
+	auto read = std::make_shared<ProbeRead>();
+	read->line.reset(acceptor->waitConnection(ProbeTimeout.count()));
+	if(!read->line)
+		return false;
+	int timeout = 0;
+	read->line->setOption(cppio::LineOption::ReceiveTimeout, &timeout);
+
+	boost::thread reader([read]()
+			{
+				char byte;
+				ssize_t rc = read->line->read(&byte, 1);
+
+				boost::unique_lock<boost::mutex> lock(read->mutex);
+				read->rc = rc;
+				read->done = true;
+				read->cv.notify_all();
+			});
+
+	bool returned;
+	{
+		boost::unique_lock<boost::mutex> lock(read->mutex);
+		returned = read->cv.wait_for(lock, ProbeTimeout, [&]() { return read->done; });
+	}
+	if(!returned)
+	{
+		// The read waits for data, so it is given some and the line is closed
+		char byte = 0;
+		client->write(&byte, 1);
+		client.reset();
+	}
+	if(!reader.try_join_for(ProbeTimeout))
+		reader.detach();
+
+	boost::unique_lock<boost::mutex> lock(read->mutex);
+	return returned && (read->rc == cppio::eTimeout);
+}
+
+}
+
+bool zeroTimeoutReadsReturn(cppio::IoLineManager& manager, const std::string& endpoint)
+{
+	static boost::mutex mutex;
+	static std::map<std::string, bool> results; // by endpoint type
+
+	auto type = endpointType(endpoint);
+	boost::unique_lock<boost::mutex> lock(mutex);
+	auto it = results.find(type);
+	if(it != results.end())
+		return it->second;
+
+	bool result = false;
+	std::string path;
+	try
+	{
+		auto address = probeEndpoint(endpoint, path);
+		if(!address.empty())
+			result = probe(manager, address);
+	}
+	catch(const std::exception& e)
+	{
+		result = false;
+	}
+	if(!path.empty())
+		::unlink(path.c_str());
+
+	results.emplace(type, result);
+	return result;
+}
+
+int nonBlockingReceiveTimeout(cppio::IoLineManager& manager, const std::string& endpoint)
+{
+	return zeroTimeoutReadsReturn(manager, endpoint) ? 0 : MinReceiveTimeout;
+}
+
+}
@@ -0,0 +1,34 @@
+#ifndef GOLDMINE_NONBLOCKINGREAD_H_
+#define GOLDMINE_NONBLOCKINGREAD_H_
+
+#include "cppio/iolinemanager.h"
+
+#include <string>
+
+namespace goldmine
+{
+	/*
+	 * Non-blocking reads of cppio lines, shared by every reader that must not wait for data: busy-poll in
+	 * QuoteSource client handlers and QuoteSourceClient, QuoteSourceClient::poll with zero timeout and
+	 * BrokerServer workers.
+	 *
+	 * cppio has no readiness notification and does not expose descriptors, so a line is read without
+	 * blocking by setting its ReceiveTimeout to 0. Not every line type has to take 0 as "return at once":
+	 * one that maps ReceiveTimeout to SO_RCVTIMEO takes it as "no timeout" and would block the reader.
+	 * So this is checked once per endpoint type by a probe: a line pair of the same type is made on a
+	 * private endpoint and its idle end is read with zero timeout. A line type that does not pass, or
+	 * that can not be probed, is read with MinReceiveTimeout instead, which bounds a read to 1 ms.
+	 */
+	static const int MinReceiveTimeout = 1; // ms
+
+	/*
+	 * Whether reads of lines of the same type as `endpoint` return at once with zero ReceiveTimeout.
+	 * The first call per endpoint type may take up to a few hundred milliseconds; the result is kept.
+	 */
+	bool zeroTimeoutReadsReturn(cppio::IoLineManager& manager, const std::string& endpoint);
+
+	// ReceiveTimeout for non-blocking reads of lines of the same type as `endpoint`: 0 or MinReceiveTimeout
+	int nonBlockingReceiveTimeout(cppio::IoLineManager& manager, const std::string& endpoint);
+}
+
+#endif /* GOLDMINE_NONBLOCKINGREAD_H_ */
@@ -0,0 +1,182 @@
+
+#ifndef GOLDMINE_TICKBATCH_H_
+#define GOLDMINE_TICKBATCH_H_
+
+#include "goldmine/data.h"
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+namespace goldmine
+{
+	template<typename T, size_t Alignment = 64>
+	struct AlignedAllocator
+	{
+		typedef T value_type;
+
+		template<typename U>
+		struct rebind
+		{
+			typedef AlignedAllocator<U, Alignment> other;
+		};
+
+		AlignedAllocator() {}
+
+		template<typename U>
+		AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+		T* allocate(size_t n)
+		{
+			void* p = nullptr;
+#ifdef WIN32
+			p = _aligned_malloc(n * sizeof(T), Alignment);
+			if(!p)
+				throw std::bad_alloc();
+#else
+			if(posix_memalign(&p, Alignment, n * sizeof(T)) != 0)
+				throw std::bad_alloc();
+#endif
+			return static_cast<T*>(p);
+		}
+
+		void deallocate(T* p, size_t)
+		{
+#ifdef WIN32
+			_aligned_free(p);
+#else
+			free(p);
+#endif
+		}
+
+		template<typename U>
+		bool operator==(const AlignedAllocator<U, Alignment>&) const
+		{
+			return true;
+		}
+
+		template<typename U>
+		bool operator!=(const AlignedAllocator<U, Alignment>&) const
+		{
+			return false;
+		}
+	};
+
+	/*
+	 * Structure-of-arrays counterpart of a packed Tick array. Every column is
+	 * 64-byte aligned, so that column-wise loops can be vectorized.
+	 * Price is kept exactly, as separate integral and fractional columns.
+	 */
+	struct TickBatch
+	{
+		template<typename T>
+		using Column = std::vector<T, AlignedAllocator<T>>;
+
+		Column<uint64_t> timestamps;
+		Column<uint32_t> useconds;
+		Column<uint32_t> datatypes;
+		Column<int64_t> priceValues;
+		Column<int32_t> priceFractionals; // 1e-9 parts
+		Column<int32_t> volumes;
+
+		size_t size() const
+		{
+			return timestamps.size();
+		}
+
+		bool empty() const
+		{
+			return timestamps.empty();
+		}
+
+		void clear()
+		{
+			resize(0);
+		}
+
+		void reserve(size_t n)
+		{
+			timestamps.reserve(n);
+			useconds.reserve(n);
+			datatypes.reserve(n);
+			priceValues.reserve(n);
+			priceFractionals.reserve(n);
+			volumes.reserve(n);
+		}
+
+		void resize(size_t n)
+		{
+			timestamps.resize(n);
+			useconds.resize(n);
+			datatypes.resize(n);
+			priceValues.resize(n);
+			priceFractionals.resize(n);
+			volumes.resize(n);
+		}
+
+		void append(const Tick& tick)
+		{
+			append(&tick, 1);
+		}
+
+		// Scatters packed ticks into the columns
+		void append(const Tick* ticks, size_t count)
+		{
+			size_t base = size();
+			resize(base + count);
+
+			uint64_t* ts = timestamps.data() + base;
+			uint32_t* us = useconds.data() + base;
+			uint32_t* dt = datatypes.data() + base;
+			int64_t* pv = priceValues.data() + base;
+			int32_t* pf = priceFractionals.data() + base;
+			int32_t* vol = volumes.data() + base;
+			for(size_t i = 0; i < count; i++)
+			{
+				const Tick& tick = ticks[i];
+				ts[i] = tick.timestamp;
+				us[i] = tick.useconds;
+				dt[i] = tick.datatype;
+				pv[i] = tick.value.value;
+				pf[i] = tick.value.fractional;
+				vol[i] = tick.volume;
+			}
+		}
+
+		// Gathers ticks [first, first + count) back into packed form
+		void toTicks(Tick* out, size_t first, size_t count) const
+		{
+			for(size_t i = 0; i < count; i++)
+			{
+				size_t j = first + i;
+				Tick& tick = out[i];
+				tick.packet_type = (uint32_t)PacketType::Tick;
+				tick.timestamp = timestamps[j];
+				tick.useconds = useconds[j];
+				tick.datatype = datatypes[j];
+				tick.value.value = priceValues[j];
+				tick.value.fractional = priceFractionals[j];
+				tick.volume = volumes[j];
+			}
+		}
+
+		void toTicks(Tick* out) const
+		{
+			toTicks(out, 0, size());
+		}
+
+		Tick tick(size_t i) const
+		{
+			Tick result;
+			toTicks(&result, i, 1);
+			return result;
+		}
+	};
+}
+
+#endif /* GOLDMINE_TICKBATCH_H_ */
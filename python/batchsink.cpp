@@ -0,0 +1,242 @@
+
+#include "batchsink.h"
+
+#include "goldmine/exceptions.h"
+
+namespace goldmine
+{
+
+struct TickBufferObject
+{
+	PyObject_HEAD
+	std::vector<Tick>* ticks;
+	Py_ssize_t count;
+	Py_ssize_t itemSize;
+};
+
+static const char* TickBufferFormat = "<IQIIqii";
+static_assert(sizeof(Tick) == 36, "TickBuffer format should match Tick layout");
+
+static int TickBuffer_getbuffer(PyObject* self, Py_buffer* view, int flags)
+{
+	auto buffer = reinterpret_cast<TickBufferObject*>(self);
+	if(flags & PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "TickBuffer is read-only");
+		view->obj = nullptr;
+		return -1;
+	}
+
+	view->obj = self;
+	Py_INCREF(self);
+	view->buf = buffer->ticks->data();
+	view->len = buffer->count * buffer->itemSize;
+	view->readonly = 1;
+	view->itemsize = buffer->itemSize;
+	view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(TickBufferFormat) : nullptr;
+	view->ndim = 1;
+	view->shape = (flags & PyBUF_ND) ? &buffer->count : nullptr;
+	view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? &buffer->itemSize : nullptr;
+	view->suboffsets = nullptr;
+	view->internal = nullptr;
+	return 0;
+}
+
+static Py_ssize_t TickBuffer_length(PyObject* self)
+{
+	return reinterpret_cast<TickBufferObject*>(self)->count;
+}
+
+static void TickBuffer_dealloc(PyObject* self)
+{
+	delete reinterpret_cast<TickBufferObject*>(self)->ticks;
+	Py_TYPE(self)->tp_free(self);
+}
+
+static PyBufferProcs TickBufferProcs = {
+	TickBuffer_getbuffer,
+	nullptr
+};
+
+static PySequenceMethods TickBufferSequenceMethods = {
+	TickBuffer_length
+};
+
+static PyTypeObject makeTickBufferType()
+{
+	PyTypeObject type = { PyVarObject_HEAD_INIT(nullptr, 0) };
+	type.tp_name = "pygoldmine.TickBuffer";
+	type.tp_basicsize = sizeof(TickBufferObject);
+	type.tp_dealloc = TickBuffer_dealloc;
+	type.tp_as_sequence = &TickBufferSequenceMethods;
+	type.tp_as_buffer = &TickBufferProcs;
+	type.tp_flags = Py_TPFLAGS_DEFAULT;
+	type.tp_doc = "Read-only buffer of packed ticks, format <IQIIqii";
+	return type;
+}
+
+PyTypeObject TickBufferType = makeTickBufferType();
+
+PyObject* createTickBuffer(std::vector<Tick>&& ticks)
+{
+	auto buffer = PyObject_New(TickBufferObject, &TickBufferType);
+	if(!buffer)
+		boost::python::throw_error_already_set();
+	buffer->ticks = new std::vector<Tick>(std::move(ticks));
+	buffer->count = buffer->ticks->size();
+	buffer->itemSize = sizeof(Tick);
+	return reinterpret_cast<PyObject*>(buffer);
+}
+
+BatchSink::BatchSink(size_t batchSize, int maxLatencyMs) : m_batchSize(batchSize),
+	m_maxLatency(maxLatencyMs),
+	m_pendingCount(0),
+	m_run(true)
+{
+	if(batchSize == 0 || maxLatencyMs <= 0)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Batch size and maximum latency should be positive"));
+	m_flushThread = boost::thread(std::bind(&BatchSink::flushThread, this));
+}
+
+BatchSink::~BatchSink()
+{
+	// Subclasses should have stopped the thread already; deliver() is not available at this point,
+	// so pending ticks are dropped
+	stopFlushThread();
+}
+
+void BatchSink::close()
+{
+	stopFlushThread();
+	flush();
+}
+
+void BatchSink::stopFlushThread()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(m_pendingMutex);
+		m_run = false;
+		m_pendingCondition.notify_all();
+	}
+	if(!m_flushThread.joinable())
+		return;
+
+	// Flush thread may be waiting for the GIL
+	if(PyGILState_Check())
+	{
+		Py_BEGIN_ALLOW_THREADS
+		m_flushThread.join();
+		Py_END_ALLOW_THREADS
+	}
+	else
+	{
+		m_flushThread.join();
+	}
+}
+
+void BatchSink::incomingTick(const std::string& ticker, const Tick& tick)
+{
+	incomingTicks(ticker, &tick, 1);
+}
+
+void BatchSink::incomingTicks(const std::string& ticker, const Tick* ticks, size_t count)
+{
+	boost::unique_lock<boost::mutex> lock(m_pendingMutex);
+	if(m_pendingCount == 0)
+	{
+		m_firstPending = boost::chrono::steady_clock::now();
+		m_pendingCondition.notify_all();
+	}
+	auto& pending = m_pending[ticker];
+	pending.insert(pending.end(), ticks, ticks + count);
+	bool wasFull = m_pendingCount >= m_batchSize;
+	m_pendingCount += count;
+
+	// A full batch is handed to the flush thread, this thread should not wait for the GIL
+	if(!wasFull && (m_pendingCount >= m_batchSize))
+		m_pendingCondition.notify_all();
+}
+
+void BatchSink::flush()
+{
+	deliverPending(false);
+}
+
+void BatchSink::deliverPending(bool fromFlushThread)
+{
+	// Batches are delivered one at a time, so that order within a ticker is preserved
+	boost::unique_lock<boost::mutex> deliverLock(m_deliverMutex);
+	{
+		boost::unique_lock<boost::mutex> lock(m_pendingMutex);
+		if(m_pendingCount == 0)
+			return;
+	}
+
+	PyGILState_STATE state = PyGILState_Ensure();
+	std::map<std::string, std::vector<Tick>> batch;
+	{
+		// The sink may be being destroyed once the thread is stopped; the destructor of a
+		// Python-owned sink holds the GIL, so this is checked after the GIL is taken
+		boost::unique_lock<boost::mutex> lock(m_pendingMutex);
+		if(fromFlushThread && !m_run)
+		{
+			lock.unlock();
+			PyGILState_Release(state);
+			return;
+		}
+		batch.swap(m_pending);
+		m_pendingCount = 0;
+	}
+
+	for(auto& entry : batch)
+	{
+		if(entry.second.empty())
+			continue;
+
+		PyObject* ticks = nullptr;
+		try
+		{
+			ticks = createTickBuffer(std::move(entry.second));
+			deliver(entry.first, ticks);
+		}
+		catch(const boost::python::error_already_set&)
+		{
+			PyErr_Print();
+		}
+		catch(const std::exception& e)
+		{
+			PyErr_SetString(PyExc_RuntimeError, e.what());
+			PyErr_Print();
+		}
+		Py_XDECREF(ticks);
+	}
+	PyGILState_Release(state);
+}
+
+void BatchSink::flushThread()
+{
+	while(true)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(m_pendingMutex);
+			if(!m_run)
+				break;
+			if(m_pendingCount == 0)
+			{
+				m_pendingCondition.wait_for(lock, m_maxLatency);
+				continue;
+			}
+
+			auto deadline = m_firstPending + m_maxLatency;
+			if((m_pendingCount < m_batchSize) && (boost::chrono::steady_clock::now() < deadline))
+			{
+				m_pendingCondition.wait_until(lock, deadline);
+				continue;
+			}
+		}
+
+		deliverPending(true);
+	}
+}
+
+}
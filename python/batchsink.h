@@ -0,0 +1,75 @@
+
+#ifndef PYTHON_BATCHSINK_H_
+#define PYTHON_BATCHSINK_H_
+
+#include <boost/python.hpp>
+#include <boost/thread.hpp>
+
+#include "quotesource/quotesourceclient.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace goldmine
+{
+	/*
+	 * Read-only buffer of packed ticks with struct format "<IQIIqii" (see Tick), to be used
+	 * with memoryview(ticks) or numpy.frombuffer(ticks, dtype=...). Owns the ticks, so views
+	 * stay valid after the callback returns.
+	 */
+	extern PyTypeObject TickBufferType;
+
+	PyObject* createTickBuffer(std::vector<Tick>&& ticks);
+
+	/*
+	 * Collects ticks and hands them to Python in batches: when `batchSize` ticks are pending,
+	 * or when the oldest pending tick has waited for `maxLatencyMs`. Batches are delivered by
+	 * the flush thread, so the thread that reports ticks never waits for the GIL. The GIL is taken
+	 * once per batch; deliver() is called with ticks grouped by ticker, in arrival order within a ticker.
+	 *
+	 * The flush thread calls deliver(), so every subclass should call stopFlushThread() from its
+	 * destructor, while deliver() is still there.
+	 */
+	class BatchSink : public QuoteSourceClient::Sink
+	{
+	public:
+		BatchSink(size_t batchSize, int maxLatencyMs);
+		virtual ~BatchSink();
+
+		void incomingTick(const std::string& ticker, const Tick& tick) override;
+		void incomingTicks(const std::string& ticker, const Tick* ticks, size_t count) override;
+
+		// Takes the GIL itself, so it should be called without it: Python bindings release it first
+		void flush();
+
+		// Stops the flush thread and delivers pending ticks; later ticks are delivered only by flush()
+		void close();
+
+	protected:
+		// Called with the GIL held
+		virtual void deliver(const std::string& ticker, PyObject* ticks) = 0;
+
+		// Pending ticks are kept. The thread delivers nothing once this is called, even if it is waiting for the GIL.
+		void stopFlushThread();
+
+	private:
+		void flushThread();
+		void deliverPending(bool fromFlushThread);
+
+		size_t m_batchSize;
+		boost::chrono::milliseconds m_maxLatency;
+
+		boost::mutex m_pendingMutex;
+		boost::condition_variable m_pendingCondition;
+		std::map<std::string, std::vector<Tick>> m_pending;
+		size_t m_pendingCount;
+		boost::chrono::steady_clock::time_point m_firstPending;
+		bool m_run;
+
+		boost::mutex m_deliverMutex;
+		boost::thread m_flushThread;
+	};
+}
+
+#endif /* PYTHON_BATCHSINK_H_ */
@@ -1,6 +1,7 @@
 
 #include <boost/python.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #include "quotesource/quotesource.h"
 #include "quotesource/quotesourceclient.h"
 #include "broker/broker.h"
@@ -8,6 +9,8 @@
 #include "broker/brokerserver.h"
 #include "cppio/iolinemanager.h"
 #include "goldmine/exceptions.h"
+#include "goldmine/conversion.h"
+#include "batchsink.h"
 
 using namespace boost::python;
 using namespace goldmine;
@@ -67,6 +70,47 @@ static Order::State deserializeState(const std::string& state)
 	BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid order state: " + state));
 }
 
+/*
+ * Releases the GIL for the duration of a blocking call, so that callback threads waiting for it can proceed.
+ * Arguments should not be Python objects.
+ */
+class ReleaseGIL
+{
+public:
+	ReleaseGIL() : m_state(PyEval_SaveThread())
+	{
+	}
+
+	~ReleaseGIL()
+	{
+		PyEval_RestoreThread(m_state);
+	}
+
+private:
+	PyThreadState* m_state;
+};
+
+template<typename T, void (T::*method)()>
+static void withoutGIL(T& self)
+{
+	ReleaseGIL nogil;
+	(self.*method)();
+}
+
+template<typename T, typename Arg, void (T::*method)(Arg)>
+static void withoutGIL(T& self, Arg arg)
+{
+	ReleaseGIL nogil;
+	(self.*method)(arg);
+}
+
+template<typename T, typename Arg1, typename Arg2, void (T::*method)(Arg1, Arg2)>
+static void withoutGIL(T& self, Arg1 arg1, Arg2 arg2)
+{
+	ReleaseGIL nogil;
+	(self.*method)(arg1, arg2);
+}
+
 std::shared_ptr<cppio::IoLineManager> makeIoLineManager()
 {
 	return std::shared_ptr<cppio::IoLineManager>(cppio::createLineManager());
@@ -154,6 +198,212 @@ static std::string Trade_getOperation(Trade& trade)
 	return "???";
 }
 
+static std::string decimal_fixed_str(const decimal_fixed& self)
+{
+	char buf[32];
+	self.format(buf, sizeof(buf));
+	return std::string(buf);
+}
+
+// Values are normalized, so that a fractional part out of [0, 1e9) is carried into the integer part
+static boost::shared_ptr<decimal_fixed> decimal_fixed_init(int64_t value, int64_t fractional)
+{
+	return boost::make_shared<decimal_fixed>(decimal_fixed::normalized(value, fractional));
+}
+
+static decimal_fixed decimal_fixed_fromString(const std::string& str)
+{
+	decimal_fixed result;
+	if(!decimal_fixed::parse(str.data(), str.size(), result))
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid decimal: " + str));
+	return result;
+}
+
+static decimal_fixed decimal_fixed_add(const decimal_fixed& self, const decimal_fixed& other)
+{
+	return self + other;
+}
+
+static decimal_fixed decimal_fixed_sub(const decimal_fixed& self, const decimal_fixed& other)
+{
+	return self - other;
+}
+
+static decimal_fixed decimal_fixed_mul(const decimal_fixed& self, int64_t quantity)
+{
+	return self * quantity;
+}
+
+static void QuoteSourceClient_setDispatchWorkers(QuoteSourceClient& self, size_t workers)
+{
+	self.setDispatchWorkers(workers);
+}
+
+static void QuoteSourceClient_setReconnectPolicy(QuoteSourceClient& self, int initialDelayMs, int maxDelayMs,
+		double multiplier, double jitter)
+{
+	QuoteSourceClient::ReconnectPolicy policy;
+	policy.initialDelay = boost::chrono::milliseconds(initialDelayMs);
+	policy.maxDelay = boost::chrono::milliseconds(maxDelayMs);
+	policy.multiplier = multiplier;
+	policy.jitter = jitter;
+	self.setReconnectPolicy(policy);
+}
+
+static void QuoteSourceClient_setHeartbeatPeriod(QuoteSourceClient& self, int periodMs)
+{
+	self.setHeartbeatPeriod(boost::chrono::milliseconds(periodMs));
+}
+
+static void QuoteSourceClient_setBusyPoll(QuoteSourceClient& self, bool enabled, int spinRounds, int yieldRounds,
+		int sleepIntervalUs)
+{
+	BusyPollPolicy policy;
+	policy.enabled = enabled;
+	policy.spinRounds = spinRounds;
+	policy.yieldRounds = yieldRounds;
+	policy.sleepInterval = boost::chrono::microseconds(sleepIntervalUs);
+	self.setBusyPoll(policy);
+}
+
+static size_t QuoteSourceClient_poll(QuoteSourceClient& self, size_t maxTicks, int timeoutMs)
+{
+	// Sinks take the GIL themselves
+	ReleaseGIL nogil;
+	return self.poll(maxTicks, boost::chrono::milliseconds(timeoutMs));
+}
+
+// Struct module format of the elements of a buffer with values of T, without the byte order character
+template<typename T>
+struct BufferFormat;
+
+template<>
+struct BufferFormat<double>
+{
+	static const char* value() { return "d"; }
+};
+
+template<>
+struct BufferFormat<uint32_t>
+{
+	static const char* value() { return "I"; }
+};
+
+template<>
+struct BufferFormat<decimal_fixed>
+{
+	static const char* value() { return "qi"; }
+};
+
+template<>
+struct BufferFormat<Tick>
+{
+	static const char* value() { return "IQIIqii"; }
+};
+
+/*
+ * Whether buffer elements are values of T. Byte order may be native or little-endian; structures are packed,
+ * so a format with native alignment is caught by the item size. Unsigned bytes (bytes, bytearray) are taken
+ * as raw memory of T, which is what the conversion functions return.
+ */
+template<typename T>
+static bool hasFormat(const Py_buffer& view)
+{
+	std::string format = view.format ? view.format : "B";
+	if((format == "B") && (view.itemsize == 1))
+		return true;
+
+	if(!format.empty() && ((format[0] == '@') || (format[0] == '=') || (format[0] == '<')))
+		format.erase(0, 1);
+	return (format == BufferFormat<T>::value()) && (view.itemsize == (Py_ssize_t)sizeof(T));
+}
+
+// Contiguous read-only view of an object supporting the buffer protocol, e.g. bytes or numpy array
+template<typename T>
+class BufferView
+{
+public:
+	BufferView(const object& input)
+	{
+		if(PyObject_GetBuffer(input.ptr(), &m_view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0)
+			throw_error_already_set();
+
+		if(!hasFormat<T>(m_view))
+		{
+			std::string format = m_view.format ? m_view.format : "B";
+			PyBuffer_Release(&m_view);
+			BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Buffer format '" + format +
+						"' does not match '" + BufferFormat<T>::value() + "'"));
+		}
+		if(m_view.len % sizeof(T) != 0)
+		{
+			PyBuffer_Release(&m_view);
+			BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Buffer size is not a multiple of element size"));
+		}
+	}
+
+	~BufferView()
+	{
+		PyBuffer_Release(&m_view);
+	}
+
+	const T* data() const
+	{
+		return reinterpret_cast<const T*>(m_view.buf);
+	}
+
+	size_t size() const
+	{
+		return m_view.len / sizeof(T);
+	}
+
+private:
+	Py_buffer m_view;
+};
+
+template<typename In, typename Out>
+static object convertBuffer(const object& input, void (*convert)(const In*, Out*, size_t))
+{
+	BufferView<In> view(input);
+	std::vector<Out> result(view.size());
+	convert(view.data(), result.data(), view.size());
+
+	return object(handle<>(PyBytes_FromStringAndSize(reinterpret_cast<const char*>(result.data()), result.size() * sizeof(Out))));
+}
+
+static void QuoteSource_incomingTicks(QuoteSource& self, const std::string& ticker, const object& ticks)
+{
+	BufferView<Tick> view(ticks);
+
+	ReleaseGIL nogil;
+	self.incomingTicks(ticker, view.data(), view.size());
+}
+
+static void QuoteSource_incomingMixedTicks(QuoteSource& self, const list& tickers, const object& tickerIds, const object& ticks)
+{
+	std::vector<std::string> tickerNames;
+	for(ssize_t i = 0; i < len(tickers); i++)
+		tickerNames.push_back(extract<std::string>(tickers[i]));
+
+	BufferView<uint32_t> ids(tickerIds);
+	BufferView<Tick> view(ticks);
+	if(ids.size() != view.size())
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Ticker ids and ticks should have the same length"));
+
+	ReleaseGIL nogil;
+	self.incomingTicks(tickerNames, ids.data(), view.data(), view.size());
+}
+
+static object pyDecimalsToDoubles(const object& input)
+{
+	return convertBuffer(input, decimalsToDoubles);
+}
+
+static object pyDoublesToDecimals(const object& input)
+{
+	return convertBuffer(input, doublesToDecimals);
+}
+
 BOOST_PYTHON_MODULE(pygoldmine)
 {
 	// Create GIL
@@ -168,6 +418,8 @@ BOOST_PYTHON_MODULE(pygoldmine)
 	class_<cppio::IoLineManager, std::shared_ptr<cppio::IoLineManager>, boost::noncopyable>("IoLineManager", no_init);
 
 	def("makeIoLineManager", makeIoLineManager);
+	def("decimalsToDoubles", pyDecimalsToDoubles);
+	def("doublesToDecimals", pyDoublesToDecimals);
 
 	class_<SignalId>("SignalId")
 		.def(init<std::string, std::string, std::string>())
@@ -177,8 +429,18 @@ BOOST_PYTHON_MODULE(pygoldmine)
 
 	class_<decimal_fixed>("decimal_fixed")
 		.def(init<double>())
-		.def(init<int64_t, int32_t>())
+		.def("__init__", make_constructor(decimal_fixed_init))
 		.def("toDouble", &decimal_fixed::toDouble)
+		.def("toScaled", &decimal_fixed::toScaled)
+		.def("fromScaled", &decimal_fixed::fromScaled).staticmethod("fromScaled")
+		.def("fromString", decimal_fixed_fromString).staticmethod("fromString")
+		.def("roundToTick", &decimal_fixed::roundToTick)
+		.def("__str__", decimal_fixed_str)
+		.def("__add__", decimal_fixed_add)
+		.def("__sub__", decimal_fixed_sub)
+		.def("__mul__", decimal_fixed_mul)
+		.def("__eq__", &decimal_fixed::operator==)
+		.def("__lt__", &decimal_fixed::operator<)
 		.add_property("value", make_getter(&decimal_fixed::value), make_setter(&decimal_fixed::value))
 		.add_property("fractional", make_getter(&decimal_fixed::fractional), make_setter(&decimal_fixed::fractional));
 
@@ -235,9 +497,11 @@ BOOST_PYTHON_MODULE(pygoldmine)
 
 	class_<QuoteSource, std::shared_ptr<QuoteSource>, boost::noncopyable>("QuoteSource", no_init)
 		.def(init<std::shared_ptr<cppio::IoLineManager>, std::string>(args("linemanager", "endpoint")))
-		.def("start", &QuoteSource::start)
-		.def("stop", &QuoteSource::stop)
-		.def("incomingTick", &QuoteSource::incomingTick);
+		.def("start", withoutGIL<QuoteSource, &QuoteSource::start>)
+		.def("stop", withoutGIL<QuoteSource, &QuoteSource::stop>)
+		.def("incomingTick", withoutGIL<QuoteSource, const std::string&, const Tick&, &QuoteSource::incomingTick>)
+		.def("incomingTicks", QuoteSource_incomingTicks)
+		.def("incomingTicks", QuoteSource_incomingMixedTicks);
 
 	struct SinkWrap : QuoteSourceClient::Sink, wrapper<QuoteSourceClient::Sink>
 	{
@@ -248,15 +512,65 @@ BOOST_PYTHON_MODULE(pygoldmine)
 			this->get_override("incomingTick")(ticker, tick);
 		}
 
+		void incomingTicks(const std::string& ticker, const Tick* ticks, size_t count)
+		{
+			GIL gil;
+
+			auto callback = this->get_override("incomingTick");
+			for(size_t i = 0; i < count; i++)
+				callback(ticker, ticks[i]);
+		}
+
+		void streamGap(uint64_t fromSequence, uint64_t toSequence)
+		{
+			GIL gil;
+
+			if(auto callback = this->get_override("streamGap"))
+				callback(fromSequence, toSequence);
+		}
+
 	};
 
 	class_<SinkWrap, boost::shared_ptr<SinkWrap>, boost::noncopyable>("QuoteSourceClientSink")
 		.def("incomingTick", &SinkWrap::incomingTick);
 
+	if(PyType_Ready(&TickBufferType) < 0)
+		throw_error_already_set();
+	scope().attr("TickBuffer") = object(handle<>(borrowed(reinterpret_cast<PyObject*>(&TickBufferType))));
+
+	struct BatchSinkWrap : BatchSink, wrapper<BatchSink>
+	{
+		BatchSinkWrap(size_t batchSize, int maxLatencyMs) : BatchSink(batchSize, maxLatencyMs)
+		{
+		}
+
+		virtual ~BatchSinkWrap()
+		{
+			stopFlushThread();
+		}
+
+		void deliver(const std::string& ticker, PyObject* ticks)
+		{
+			this->get_override("incomingTicks")(ticker, object(handle<>(borrowed(ticks))));
+		}
+	};
+
+	class_<BatchSinkWrap, boost::shared_ptr<BatchSinkWrap>, bases<QuoteSourceClient::Sink>, boost::noncopyable>("QuoteSourceClientBatchSink",
+			init<size_t, int>(args("batchSize", "maxLatencyMs")))
+		.def("flush", withoutGIL<BatchSink, &BatchSink::flush>)
+		.def("close", withoutGIL<BatchSink, &BatchSink::close>);
+
 	class_<QuoteSourceClient, std::shared_ptr<QuoteSourceClient>, boost::noncopyable>("QuoteSourceClient", no_init)
 		.def(init<std::shared_ptr<cppio::IoLineManager>, std::string>(args("linemanager", "endpoint")))
-		.def("startStream", &QuoteSourceClient::startStream)
-		.def("stop", &QuoteSourceClient::stop)
+		.def("startStream", withoutGIL<QuoteSourceClient, const std::string&, &QuoteSourceClient::startStream>)
+		.def("stop", withoutGIL<QuoteSourceClient, &QuoteSourceClient::stop>)
+		.def("startPolling", &QuoteSourceClient::startPolling)
+		.def("poll", QuoteSourceClient_poll, (arg("maxTicks"), arg("timeoutMs") = 1))
+		.def("setDispatchWorkers", QuoteSourceClient_setDispatchWorkers)
+		.def("setReconnectPolicy", QuoteSourceClient_setReconnectPolicy)
+		.def("setHeartbeatPeriod", QuoteSourceClient_setHeartbeatPeriod)
+		.def("setBusyPoll", QuoteSourceClient_setBusyPoll,
+				(arg("enabled"), arg("spinRounds") = 1000, arg("yieldRounds") = 1000, arg("sleepIntervalUs") = 50))
 		.def("registerSink", &QuoteSourceClient::registerBoostSink);
 
 	def("createOrder", createOrder);
@@ -314,14 +628,15 @@ BOOST_PYTHON_MODULE(pygoldmine)
 		;
 
 	class_<BrokerClient, std::shared_ptr<BrokerClient>, boost::noncopyable>("BrokerClient", init<std::shared_ptr<cppio::IoLineManager>, std::string>(args("linemanager", "endpoint")))
-		.def("start", &BrokerClient::start)
-		.def("stop", &BrokerClient::stop)
+		.def("start", withoutGIL<BrokerClient, &BrokerClient::start>)
+		.def("stop", withoutGIL<BrokerClient, &BrokerClient::stop>)
 		.def("registerReactor", static_cast<void (BrokerClient::*)(const boost::shared_ptr<BrokerClient::Reactor>&)>(&BrokerClient::registerReactor))
 		.def("unregisterReactor", static_cast<void (BrokerClient::*)(const boost::shared_ptr<BrokerClient::Reactor>&)>(&BrokerClient::unregisterReactor))
-		.def("submitOrder", &BrokerClient::submitOrder)
-		.def("cancelOrder", &BrokerClient::cancelOrder)
+		.def("submitOrder", withoutGIL<BrokerClient, const Order::Ptr&, &BrokerClient::submitOrder>)
+		.def("cancelOrder", withoutGIL<BrokerClient, const Order::Ptr&, &BrokerClient::cancelOrder>)
 		.def("setIdentity", &BrokerClient::setIdentity)
 		.def("identity", &BrokerClient::identity)
+		.def("setBinaryProtocol", &BrokerClient::setBinaryProtocol)
 		;
 
 }
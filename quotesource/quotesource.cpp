@@ -3,11 +3,20 @@
  */
 
 #include "quotesource.h"
+#include "shmring.h"
+#include "tickcodec.h"
+#include "goldmine/busypoll.h"
+#include "goldmine/nonblockingread.h"
 
+#include <algorithm>
 #include <atomic>
 #include <functional>
 #include <unordered_set>
+#include <unordered_map>
+#include <deque>
 #include <boost/lockfree/spsc_queue.hpp>
+#include <boost/circular_buffer.hpp>
+#include <boost/chrono.hpp>
 
 #include "json/json.h"
 #include "cppio/iolinemanager.h"
@@ -17,12 +26,90 @@ namespace goldmine
 {
 using namespace cppio;
 
+static const size_t MaxTicksPerFrame = 1024;
+
+struct SequencedTick
+{
+	uint64_t sequence;
+	uint32_t tickerId; // index in QuoteSource::Impl::tickerNames
+	Tick tick;
+};
+
 class Client;
 struct QuoteSource::Impl
 {
 	Impl(const std::shared_ptr<IoLineManager>& m) : manager(m),
-		run(false)
+		run(false),
+		busyPollReceiveTimeout(MinReceiveTimeout),
+		nextSequence(1),
+		retransmissionCapacity(DefaultRetransmissionCapacity),
+		retransmissionEnabled(false),
+		retainedFrom(0),
+		lastEvictedAny(0)
+	{
+		// Lets clients tell a restarted source from the one they were connected to
+		epoch = boost::chrono::duration_cast<boost::chrono::microseconds>(
+				boost::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	// Should be called with clientMutex locked
+	uint32_t internTicker(const std::string& ticker)
+	{
+		auto it = tickerIds.find(ticker);
+		if(it != tickerIds.end())
+			return it->second;
+
+		uint32_t id = tickerNames.size();
+		tickerIds.emplace(ticker, id);
+		tickerNames.push_back(ticker);
+		lastEvicted.push_back(0);
+		return id;
+	}
+
+	/*
+	 * Ticks are retained only after the first client asks for sequence numbers,
+	 * so that sources without such clients do not pay for the buffer.
+	 * Should be called with clientMutex locked.
+	 */
+	void enableRetransmission()
 	{
+		if(retransmissionEnabled)
+			return;
+		retransmissionEnabled = true;
+		retainedFrom = nextSequence;
+		retransmission.set_capacity(retransmissionCapacity);
+	}
+
+	// Drops the oldest retained ticks until at most `size` are left
+	void evict(size_t size)
+	{
+		while(retransmission.size() > size)
+		{
+			const auto& oldest = retransmission.front();
+			lastEvicted[oldest.tickerId] = oldest.sequence;
+			lastEvictedAny = oldest.sequence;
+			retransmission.pop_front();
+		}
+	}
+
+	/*
+	 * Whether ticks of the given tickers with sequence numbers from `fromSequence` on may have
+	 * been evicted or never retained. Should be called with clientMutex locked.
+	 */
+	bool lostSince(uint64_t fromSequence, const std::unordered_set<std::string>& tickers, bool allTickers) const
+	{
+		if(!retransmissionEnabled || (fromSequence < retainedFrom))
+			return true;
+		if(allTickers)
+			return lastEvictedAny >= fromSequence;
+
+		for(const auto& ticker : tickers)
+		{
+			auto it = tickerIds.find(ticker);
+			if((it != tickerIds.end()) && (lastEvicted[it->second] >= fromSequence))
+				return true;
+		}
+		return false;
 	}
 
 	void removeClient(Client* client)
@@ -40,6 +127,23 @@ struct QuoteSource::Impl
 
 	boost::mutex clientMutex;
 	std::vector<std::unique_ptr<Client>> clients;
+	std::unique_ptr<ShmRingWriter> shmWriter;
+	BusyPollPolicy busyPoll;
+	int busyPollReceiveTimeout; // see nonBlockingReceiveTimeout
+
+	// Guarded by clientMutex
+	uint64_t epoch;
+	uint64_t nextSequence;
+	size_t retransmissionCapacity;
+	bool retransmissionEnabled;
+	uint64_t retainedFrom; // first sequence number that could have been retained
+	boost::circular_buffer<SequencedTick> retransmission;
+
+	// Guarded by clientMutex. Retained ticks refer to tickers by id; ids are never reused.
+	std::unordered_map<std::string, uint32_t> tickerIds;
+	std::vector<std::string> tickerNames;
+	std::vector<uint64_t> lastEvicted; // per ticker id, sequence number of the last evicted tick or 0
+	uint64_t lastEvictedAny; // sequence number of the last evicted tick of any ticker or 0
 };
 
 class Client
@@ -53,9 +157,15 @@ public:
 		m_manualMode(false),
 		m_tickQueue(1024),
 		m_nextTickMessages(0),
-		m_allTickers(false)
+		m_allTickers(false),
+		m_protocolVersion(2),
+		m_sequenceNumbers(false),
+		m_resuming(false),
+		m_heartbeatPeriod(0)
 	{
-		int timeout = 100;
+		if(impl)
+			m_busyPoll = impl->busyPoll;
+		int timeout = m_busyPoll.enabled ? impl->busyPollReceiveTimeout : 100;
 		line->setOption(LineOption::ReceiveTimeout, &timeout);
 	}
 
@@ -63,7 +173,12 @@ public:
 		m_clientThread(std::move(other.m_clientThread)),
 		m_run(other.m_run.load()),
 		m_tickQueue(1024),
-		m_nextTickMessages(0)
+		m_nextTickMessages(0),
+		m_protocolVersion(other.m_protocolVersion),
+		m_sequenceNumbers(other.m_sequenceNumbers),
+		m_resuming(false),
+		m_heartbeatPeriod(other.m_heartbeatPeriod),
+		m_busyPoll(other.m_busyPoll)
 	{
 	}
 
@@ -127,12 +242,9 @@ public:
 				auto t = tickersArray[(int)i].asString();
 				tickers.push_back(t);
 			}
-			m_manualMode = root["manual-mode"].asBool();
-			startStream(tickers);
-			if(m_manualMode)
-			{
-				m_senderThread = boost::thread(std::bind(&Client::sendStreamThread, this));
-			}
+			std::unordered_set<std::string> pureTickers;
+			bool allTickers = false;
+			parseTickers(tickers, pureTickers, allTickers);
 
 			for(const auto& reactor : m_quotesource->reactors)
 			{
@@ -140,7 +252,60 @@ public:
 					reactor->clientRequestedStream("", ticker);
 			}
 
-			return makeOkMessage();
+			std::vector<SequencedTick> resumed;
+			std::vector<std::string> tickerNames;
+			uint64_t gapFrom = 0;
+			uint64_t gapTo = 0;
+			bool resume = false;
+			Message reply;
+			{
+				// The reply and the resume point are taken together, but sent after the lock is released
+				boost::unique_lock<boost::mutex> lock(m_quotesource->clientMutex);
+				m_manualMode = root["manual-mode"].asBool();
+				if(root["protocol-version"].asInt() >= TickCodecProtocolVersion)
+					m_protocolVersion = TickCodecProtocolVersion;
+				m_sequenceNumbers = root["sequence-numbers"].asBool();
+				if(m_sequenceNumbers)
+					m_quotesource->enableRetransmission();
+				m_tickers.insert(pureTickers.begin(), pureTickers.end());
+				m_allTickers = m_allTickers || allTickers;
+
+				reply = makeOkMessage();
+				// Live ticks should not get ahead of the reply and retransmitted ticks, so they are held back until those are sent
+				m_resuming = !m_manualMode;
+				if(m_sequenceNumbers && root.isMember("resume-from") &&
+						(root["resume-epoch"].asUInt64() == m_quotesource->epoch))
+				{
+					resume = true;
+					collectResumed(root["resume-from"].asUInt64(), resumed, gapFrom, gapTo);
+					if(!resumed.empty())
+						tickerNames = m_quotesource->tickerNames;
+				}
+			}
+
+			send(reply);
+			if(resume)
+				resumeStream(resumed, tickerNames, gapFrom, gapTo);
+			if(!m_manualMode)
+				sendDeferred();
+
+			if(m_manualMode)
+			{
+				m_senderThread = boost::thread(std::bind(&Client::sendStreamThread, this));
+			}
+
+			// Reply is already sent
+			return Message();
+		}
+		else if(root["command"] == "heartbeat-request")
+		{
+			double period = root["period"].asDouble();
+			if(period < 0)
+				BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid heartbeat period"));
+			m_heartbeatPeriod = boost::chrono::milliseconds((int64_t)(period * 1000));
+
+			// No reply
+			return Message();
 		}
 		BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid control command"));
 	}
@@ -166,7 +331,12 @@ public:
 	{
 		Json::Value root;
 		root["node-type"] = "quotesource";
+		// Clients that know only this field expect 2; newer versions are negotiated in start-stream
 		root["protocol-version"] = 2;
+		Json::Value versions(Json::arrayValue);
+		versions.append(2);
+		versions.append(TickCodecProtocolVersion);
+		root["supported-protocol-versions"] = versions;
 		Json::FastWriter writer;
 
 		Message outgoing;
@@ -179,6 +349,13 @@ public:
 	{
 		Json::Value root;
 		root["result"] = "success";
+		root["protocol-version"] = m_protocolVersion;
+		if(m_sequenceNumbers)
+		{
+			root["sequence-numbers"] = true;
+			root["epoch"] = Json::Value((Json::UInt64)m_quotesource->epoch);
+			root["next-sequence"] = Json::Value((Json::UInt64)m_quotesource->nextSequence);
+		}
 		Json::FastWriter writer;
 
 		Message outgoing;
@@ -187,23 +364,143 @@ public:
 		return outgoing;
 	}
 
-	void incomingTick(const std::string& ticker, const Tick& tick)
+	// Ticks have consecutive sequence numbers starting from `firstSequence`. Called with clientMutex locked.
+	void incomingTicks(const std::string& ticker, const Tick* ticks, size_t count, uint64_t firstSequence)
 	{
 		if(!m_manualMode)
 		{
 			if((m_tickers.find(ticker) != m_tickers.end()) || (m_allTickers))
 			{
-				sendTick(ticker, tick);
+				if(m_resuming)
+					m_deferred.push_back(DeferredTicks { ticker, std::vector<Tick>(ticks, ticks + count), firstSequence });
+				else
+					sendLiveTicks(ticker, ticks, count, firstSequence);
 			}
 		}
 		else
 		{
-			m_tickQueue.push(std::make_pair(ticker, tick));
+			for(size_t i = 0; i < count; i++)
+				m_tickQueue.push(QueuedTick { ticker, ticks[i], firstSequence + i });
 			m_tickQueueCondition.notify_one();
 		}
 	}
 
-	void startStream(const std::vector<std::string>& tickers)
+	/*
+	 * Copies retained ticks of the requested tickers starting from `fromSequence`.
+	 * [gapFrom, gapTo) is set to the part of the range which is no longer retained,
+	 * unless it is known to contain no ticks of the requested tickers.
+	 * Should be called with clientMutex locked.
+	 */
+	void collectResumed(uint64_t fromSequence, std::vector<SequencedTick>& resumed, uint64_t& gapFrom, uint64_t& gapTo)
+	{
+		const auto& ring = m_quotesource->retransmission;
+		uint64_t nextSequence = m_quotesource->nextSequence;
+		if(fromSequence > nextSequence)
+			return;
+
+		uint64_t oldest = ring.empty() ? nextSequence : ring.front().sequence;
+		if(fromSequence < oldest)
+		{
+			if(m_quotesource->lostSince(fromSequence, m_tickers, m_allTickers))
+			{
+				gapFrom = fromSequence;
+				gapTo = oldest;
+			}
+			fromSequence = oldest;
+		}
+
+		// Ticker ids of the requested tickers, so that the ring is scanned without string comparisons
+		std::vector<bool> requested(m_quotesource->tickerNames.size(), m_allTickers);
+		for(const auto& ticker : m_tickers)
+		{
+			auto it = m_quotesource->tickerIds.find(ticker);
+			if(it != m_quotesource->tickerIds.end())
+				requested[it->second] = true;
+		}
+
+		for(size_t i = fromSequence - oldest; i < ring.size(); i++)
+		{
+			if(requested[ring[i].tickerId])
+				resumed.push_back(ring[i]);
+		}
+	}
+
+	/*
+	 * Sends the gap and the retransmitted ticks without holding clientMutex. In manual mode ticks are
+	 * handed to the sender thread; otherwise live ticks published meanwhile are deferred until sendDeferred.
+	 */
+	void resumeStream(const std::vector<SequencedTick>& resumed, const std::vector<std::string>& tickerNames,
+			uint64_t gapFrom, uint64_t gapTo)
+	{
+		if(gapTo > gapFrom)
+			sendGap(gapFrom, gapTo);
+
+		if(m_manualMode)
+		{
+			boost::unique_lock<boost::mutex> lock(m_tickQueueMutex);
+			for(const auto& t : resumed)
+				m_resumeQueue.push_back(QueuedTick { tickerNames[t.tickerId], t.tick, t.sequence });
+			return;
+		}
+
+		// Runs of the same ticker with consecutive sequence numbers go as one frame
+		std::vector<Tick> run;
+		size_t first = 0;
+		while(first < resumed.size())
+		{
+			size_t last = first + 1;
+			while((last < resumed.size()) && (last - first < MaxTicksPerFrame) &&
+					(resumed[last].tickerId == resumed[first].tickerId) &&
+					(resumed[last].sequence == resumed[last - 1].sequence + 1))
+			{
+				last++;
+			}
+			run.clear();
+			for(size_t i = first; i < last; i++)
+				run.push_back(resumed[i].tick);
+			sendTicks(tickerNames[resumed[first].tickerId], run.data(), run.size(), resumed[first].sequence);
+			first = last;
+		}
+	}
+
+	// Sends live ticks deferred while the reply and retransmitted ticks were being sent, and stops deferring
+	void sendDeferred()
+	{
+		while(true)
+		{
+			std::vector<DeferredTicks> deferred;
+			{
+				boost::unique_lock<boost::mutex> lock(m_quotesource->clientMutex);
+				if(m_deferred.empty())
+				{
+					m_resuming = false;
+					break;
+				}
+				deferred.swap(m_deferred);
+			}
+			for(const auto& d : deferred)
+				sendLiveTicks(d.ticker, d.ticks.data(), d.ticks.size(), d.firstSequence);
+		}
+	}
+
+	void sendLiveTicks(const std::string& ticker, const Tick* ticks, size_t count, uint64_t firstSequence)
+	{
+		for(size_t i = 0; i < count; i += MaxTicksPerFrame)
+			sendTicks(ticker, ticks + i, std::min(count - i, MaxTicksPerFrame), firstSequence + i);
+	}
+
+	void sendGap(uint64_t fromSequence, uint64_t toSequence)
+	{
+		Message msg;
+		msg << (uint32_t)MessageType::Event;
+		msg << (uint32_t)EventId::StreamGap;
+		msg << fromSequence;
+		msg << toSequence;
+
+		send(msg);
+	}
+
+	static void parseTickers(const std::vector<std::string>& tickers, std::unordered_set<std::string>& pureTickers, bool& allTickers)
 	{
 		for(const auto& ticker : tickers)
 		{
@@ -212,10 +509,10 @@ public:
 			auto pureTicker = ticker.substr(2);
 			if(pureTicker == "*")
 			{
-				m_allTickers = true;
+				allTickers = true;
 				break;
 			}
-			m_tickers.insert(pureTicker);
+			pureTickers.insert(pureTicker);
 		}
 	}
 
@@ -223,12 +520,27 @@ public:
 	{
 		while(m_run)
 		{
+			if(m_nextTickMessages.load() > 0)
+			{
+				// Retransmitted ticks go before live ones
+				boost::unique_lock<boost::mutex> lock(m_tickQueueMutex);
+				if(!m_resumeQueue.empty())
+				{
+					QueuedTick tick = std::move(m_resumeQueue.front());
+					m_resumeQueue.pop_front();
+					lock.unlock();
+					sendTicks(tick.ticker, &tick.tick, 1, tick.sequence);
+					m_nextTickMessages.fetch_sub(1);
+					continue;
+				}
+			}
+
 			if(!m_tickQueue.empty() && (m_nextTickMessages.load() > 0))
 			{
-				std::pair<std::string, Tick> tick;
+				QueuedTick tick;
 				if(m_tickQueue.pop(tick))
 				{
-					sendTick(tick.first, tick.second);
+					sendTicks(tick.ticker, &tick.tick, 1, tick.sequence);
 					m_nextTickMessages.fetch_sub(1);
 				}
 			}
@@ -240,17 +552,57 @@ public:
 		}
 	}
 
-	void sendTick(const std::string& ticker, const Tick& tick)
+	void send(const Message& msg)
+	{
+		// Ticks, replies and heartbeats are sent from different threads
+		boost::unique_lock<boost::mutex> lock(m_sendMutex);
+		m_proto.sendMessage(msg);
+	}
+
+	void sendHeartbeat()
+	{
+		Message msg;
+		msg << (uint32_t)MessageType::Service;
+		msg << (uint32_t)ServiceDataType::Heartbeat;
+		send(msg);
+	}
+
+	void sendTicks(const std::string& ticker, const Tick* ticks, size_t count, uint64_t firstSequence)
 	{
 		Message msg;
 		msg << (uint32_t)MessageType::Data;
 		msg << ticker;
-		msg.addFrame(Frame(&tick, sizeof(tick)));
+		if(m_protocolVersion >= TickCodecProtocolVersion)
+		{
+			m_encodeBuffer.clear();
+			m_encoder.encode(ticker, ticks, count, m_encodeBuffer);
+			msg.addFrame(Frame(m_encodeBuffer.data(), m_encodeBuffer.size()));
+		}
+		else
+		{
+			msg.addFrame(Frame(ticks, count * sizeof(Tick)));
+		}
+		if(m_sequenceNumbers)
+			msg << firstSequence;
 
-		m_proto.sendMessage(msg);
+		send(msg);
 	}
 
 private:
+	struct QueuedTick
+	{
+		std::string ticker;
+		Tick tick;
+		uint64_t sequence;
+	};
+
+	struct DeferredTicks
+	{
+		std::string ticker;
+		std::vector<Tick> ticks;
+		uint64_t firstSequence;
+	};
+
 	std::shared_ptr<IoLine> m_line;
 	QuoteSource::Impl* m_quotesource;
 	MessageProtocol m_proto;
@@ -262,9 +614,23 @@ private:
 	boost::thread m_senderThread;
 	boost::mutex m_tickQueueMutex;
 	boost::condition_variable m_tickQueueCondition;
-	boost::lockfree::spsc_queue<std::pair<std::string, Tick>> m_tickQueue;
+	boost::lockfree::spsc_queue<QueuedTick> m_tickQueue;
+	std::deque<QueuedTick> m_resumeQueue; // guarded by m_tickQueueMutex
 	std::atomic_int m_nextTickMessages;
 	bool m_allTickers;
+
+	int m_protocolVersion;
+	TickEncoder m_encoder;
+	std::vector<char> m_encodeBuffer;
+	bool m_sequenceNumbers;
+
+	// Guarded by clientMutex: live ticks published while retransmitted ones are being sent
+	bool m_resuming;
+	std::vector<DeferredTicks> m_deferred;
+
+	boost::mutex m_sendMutex;
+	boost::chrono::milliseconds m_heartbeatPeriod; // 0 until the peer asks for heartbeats
+	BusyPollPolicy m_busyPoll;
 };
 
 
@@ -272,6 +638,9 @@ void Client::eventLoop()
 {
 	m_run = true;
 
+	auto lastReceived = boost::chrono::steady_clock::now();
+	auto lastHeartbeat = lastReceived;
+	BusyPollBackoff backoff(m_busyPoll);
 	while(m_run)
 	{
 		try
@@ -279,17 +648,37 @@ void Client::eventLoop()
 			Message incomingMessage;
 			ssize_t rc = m_proto.readMessage(incomingMessage);
 
+			auto now = boost::chrono::steady_clock::now();
+			if(m_heartbeatPeriod.count() > 0)
+			{
+				if(now - lastHeartbeat >= m_heartbeatPeriod)
+				{
+					sendHeartbeat();
+					lastHeartbeat = now;
+				}
+
+				// Peer that asked for heartbeats sends them with the same period
+				if((rc <= 0) && (now - lastReceived > m_heartbeatPeriod * 3))
+				{
+					m_run = false;
+					break;
+				}
+			}
+
 			if(rc > 0)
 			{
+				lastReceived = now;
+				backoff.reset();
 				Message outgoingMessage = handle(incomingMessage);
 				if(outgoingMessage.size() > 0)
 				{
-					m_proto.sendMessage(outgoingMessage);
+					send(outgoingMessage);
 				}
 			}
 			else if(rc == eTimeout)
 			{
-				// Ignore
+				if(m_busyPoll.enabled)
+					backoff.idle();
 			}
 			else
 			{
@@ -312,9 +701,15 @@ void Client::eventLoop()
 			Message msg;
 			msg << (uint32_t)MessageType::Control;
 			msg << writer.write(root);
-			m_proto.sendMessage(msg);
+			send(msg);
 		}
 	}
+
+	// Sender thread waits on members of this object, so it should be gone before the client is removed
+	m_tickQueueCondition.notify_all();
+	if(m_senderThread.joinable())
+		m_senderThread.join();
+
 	m_quotesource->removeClient(this);
 }
 
@@ -340,6 +735,13 @@ void QuoteSource::removeReactor(const Reactor::Ptr& reactor)
 
 void QuoteSource::start()
 {
+	if(isShmEndpoint(m_impl->endpoint))
+	{
+		boost::unique_lock<boost::mutex> lock(m_impl->clientMutex);
+		m_impl->shmWriter.reset(new ShmRingWriter(m_impl->endpoint));
+		m_impl->run = true;
+		return;
+	}
 	m_impl->acceptThread = boost::thread(std::bind(&QuoteSource::eventLoop, this));
 }
 
@@ -355,6 +757,10 @@ void QuoteSource::stop() noexcept
 	catch(const std::exception& e)
 	{
 	}
+	{
+		boost::unique_lock<boost::mutex> lock(m_impl->clientMutex);
+		m_impl->shmWriter.reset();
+	}
 	for(const auto& client : m_impl->clients)
 	{
 		try
@@ -373,6 +779,8 @@ void QuoteSource::eventLoop()
 	m_impl->run = true;
 
 	auto controlAcceptor = std::unique_ptr<IoAcceptor>(m_impl->manager->createServer(m_impl->endpoint));
+	if(m_impl->busyPoll.enabled)
+		m_impl->busyPollReceiveTimeout = nonBlockingReceiveTimeout(*m_impl->manager, m_impl->endpoint);
 
 	while(m_impl->run)
 	{
@@ -399,10 +807,82 @@ void QuoteSource::eventLoop()
 
 void QuoteSource::incomingTick(const std::string& ticker, const Tick& tick)
 {
+	incomingTicks(ticker, &tick, 1);
+}
+
+void QuoteSource::incomingTicks(const std::string& ticker, const Tick* ticks, size_t count)
+{
+	boost::unique_lock<boost::mutex> lock(m_impl->clientMutex);
+	publish(ticker, ticks, count);
+}
+
+void QuoteSource::incomingTicks(const std::vector<std::string>& tickers, const uint32_t* tickerIds, const Tick* ticks, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		if(tickerIds[i] >= tickers.size())
+			BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid ticker id"));
+	}
+
+	// Runs of the same ticker go to clients as single frames
 	boost::unique_lock<boost::mutex> lock(m_impl->clientMutex);
+	size_t first = 0;
+	while(first < count)
+	{
+		size_t last = first + 1;
+		while((last < count) && (tickerIds[last] == tickerIds[first]))
+			last++;
+		publish(tickers[tickerIds[first]], ticks + first, last - first);
+		first = last;
+	}
+}
+
+void QuoteSource::publish(const std::string& ticker, const Tick* ticks, size_t count)
+{
+	if(count == 0)
+		return;
+
+	if(m_impl->shmWriter)
+	{
+		for(size_t i = 0; i < count; i++)
+			m_impl->shmWriter->write(ticker, ticks[i]);
+	}
+
+	uint64_t firstSequence = m_impl->nextSequence;
+	m_impl->nextSequence += count;
+	auto& ring = m_impl->retransmission;
+	if(ring.capacity() > 0)
+	{
+		uint32_t tickerId = m_impl->internTicker(ticker);
+		size_t retained = std::min(count, ring.capacity());
+		if(retained < count)
+			m_impl->lastEvicted[tickerId] = firstSequence + (count - retained) - 1;
+		m_impl->evict(ring.capacity() - retained);
+		for(size_t i = count - retained; i < count; i++)
+			ring.push_back(SequencedTick { firstSequence + i, tickerId, ticks[i] });
+	}
+
 	for(const auto& client : m_impl->clients)
 	{
-		client->incomingTick(ticker, tick);
+		client->incomingTicks(ticker, ticks, count, firstSequence);
+	}
+}
+
+void QuoteSource::setBusyPoll(const BusyPollPolicy& policy)
+{
+	if(!policy.valid())
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid busy-poll policy"));
+	m_impl->busyPoll = policy;
+}
+
+void QuoteSource::setRetransmissionCapacity(size_t capacity)
+{
+	boost::unique_lock<boost::mutex> lock(m_impl->clientMutex);
+	m_impl->retransmissionCapacity = capacity;
+	if(m_impl->retransmissionEnabled)
+	{
+		m_impl->evict(capacity);
+		m_impl->retransmission.set_capacity(capacity);
 	}
 }
 
@@ -6,6 +6,7 @@
 #define QUOTESOURCE_QUOTESOURCE_H_
 
 #include "goldmine/data.h"
+#include "goldmine/busypoll.h"
 
 #include "goldmine/exceptions.h"
 
@@ -16,6 +17,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace goldmine
 {
@@ -48,9 +50,31 @@ public:
 	void stop() noexcept;
 
 	void incomingTick(const std::string& ticker, const Tick& tick);
+	void incomingTicks(const std::string& ticker, const Tick* ticks, size_t count);
+
+	/*
+	 * Mixed batch: ticker of ticks[i] is tickers[tickerIds[i]].
+	 * Consecutive ticks of the same ticker are sent to clients in one frame.
+	 */
+	void incomingTicks(const std::vector<std::string>& tickers, const uint32_t* tickerIds, const Tick* ticks, size_t count);
+
+	/*
+	 * Number of last ticks kept for clients that reconnect and ask to resume the stream.
+	 * 0 disables retransmission. Ticks are kept only after the first client asks for sequence numbers.
+	 */
+	void setRetransmissionCapacity(size_t capacity);
+
+	static const size_t DefaultRetransmissionCapacity = 65536;
+
+	/*
+	 * Should be called before start. Client handler threads read their lines with busy-poll,
+	 * see BusyPollPolicy; every connected client then keeps a core busy.
+	 */
+	void setBusyPoll(const BusyPollPolicy& policy);
 
 private:
 	void eventLoop();
+	void publish(const std::string& ticker, const Tick* ticks, size_t count);
 
 private:
 	struct Impl;
@@ -1,23 +1,113 @@
 
 #include "quotesourceclient.h"
+#include "shmring.h"
+#include "tickcodec.h"
 #include "cppio/message.h"
 #include "cppio/errors.h"
 #include "goldmine/exceptions.h"
+#include "goldmine/busypoll.h"
+#include "goldmine/nonblockingread.h"
 
 #include "json/json.h"
 
 #include <boost/algorithm/string.hpp>
 
 #include <boost/thread.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <unordered_set>
 
 namespace goldmine
 {
 
+static const size_t MaxShmBatch = 256;
+static const size_t MaxWorkerBatch = 256;
+
+// Unless busy-poll is configured, an idle shm reader spins for a while and then sleeps
+static BusyPollPolicy shmIdlePolicy()
+{
+	BusyPollPolicy policy;
+	policy.spinRounds = 1000;
+	policy.yieldRounds = 0;
+	policy.sleepInterval = boost::chrono::microseconds(100);
+	return policy;
+}
+
+struct DispatchItem
+{
+	std::string ticker;
+	Tick tick;
+	boost::chrono::steady_clock::time_point enqueued;
+};
+
+struct DispatchWorker
+{
+	DispatchWorker(size_t capacity) : queue(capacity),
+		run(true),
+		sleeping(false),
+		enqueued(0),
+		dispatched(0),
+		lastLag(0),
+		maxLag(0)
+	{
+	}
+
+	boost::lockfree::spsc_queue<DispatchItem> queue;
+	boost::thread thread;
+	std::atomic<bool> run;
+	std::atomic<bool> sleeping;
+	boost::mutex mutex;
+	boost::condition_variable condition;
+
+	std::atomic<uint64_t> enqueued;
+	std::atomic<uint64_t> dispatched;
+	std::atomic<uint64_t> lastLag;
+	std::atomic<uint64_t> maxLag;
+
+	void wake()
+	{
+		if(sleeping.load())
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			condition.notify_one();
+		}
+	}
+};
+
 struct QuoteSourceClient::Impl
 {
+	enum class ReadResult
+	{
+		Message,
+		Timeout,
+		Disconnected
+	};
+
 	Impl(const std::shared_ptr<cppio::IoLineManager>& m, const std::string& a) : manager(m),
 		address(a),
-		run(false)
+		run(false),
+		polling(false),
+		protocolVersion(TickCodecProtocolVersion),
+		dispatchWorkers(0),
+		dispatchQueueCapacity(DefaultDispatchQueueCapacity),
+		haveSequence(false),
+		epoch(0),
+		nextSequence(0),
+		heartbeatPeriod(DefaultHeartbeatPeriod),
+		random(std::random_device()()),
+		tickersValue(Json::arrayValue),
+		allShmTickers(false),
+		streamVersion(2),
+		receiveTimeout(0),
+		nonBlockingReceiveTimeoutValue(-1),
+		serverHeartbeats(false),
+		heartbeatProto(nullptr),
+		pollAttempt(0)
 	{
 	}
 
@@ -26,89 +116,681 @@ struct QuoteSourceClient::Impl
 	std::vector<QuoteSourceClient::Sink*> rawSinks;
 	std::shared_ptr<cppio::IoLineManager> manager;
 	std::string address;
-	std::shared_ptr<cppio::IoLine> line;
 	boost::thread streamThread;
 	bool run;
+	bool polling;
+	int protocolVersion;
+
+	size_t dispatchWorkers;
+	size_t dispatchQueueCapacity;
+	// Replaced only while the network thread is stopped, so the network thread reads it without the lock
+	std::vector<std::unique_ptr<DispatchWorker>> workers;
+	boost::mutex workersMutex;
+
+	// Position in the stream, kept across reconnects
+	bool haveSequence;
+	uint64_t epoch;
+	uint64_t nextSequence;
+
+	ReconnectPolicy reconnectPolicy;
+	boost::chrono::milliseconds heartbeatPeriod;
+	BusyPollPolicy busyPoll;
+	std::mt19937 random;
+	boost::mutex runMutex;
+	boost::condition_variable runCondition;
+
+	// Requested tickers
+	Json::Value tickersValue;
+	std::unordered_set<std::string> shmTickers;
+	bool allShmTickers;
+
+	// Current connection, owned by the network thread or by the polling thread
+	std::shared_ptr<cppio::IoLine> line;
+	std::unique_ptr<cppio::MessageProtocol> proto;
+	std::unique_ptr<ShmRingReader> shmReader;
+	TickDecoder decoder;
+	int streamVersion;
+	int receiveTimeout;
+	int nonBlockingReceiveTimeoutValue;
+	bool serverHeartbeats;
+	boost::chrono::steady_clock::time_point lastReceived;
+	boost::chrono::steady_clock::time_point lastHeartbeat;
+
+	// In threaded mode heartbeats are sent from their own thread, so that slow sinks do not delay them
+	boost::thread heartbeatThread;
+	boost::mutex connectionMutex;
+	cppio::MessageProtocol* heartbeatProto; // guarded by connectionMutex, set while the stream is up
+
+	// Reconnect state of the polling mode, which can not wait
+	int pollAttempt;
+	boost::chrono::steady_clock::time_point nextPollAttempt;
+
+	std::string ticker;
+	std::vector<Tick> decoded;
+
+	void setStreamId(const std::string& streamId)
+	{
+		// Sequence numbers of the previous stream mean nothing for the new one, so it is not resumed
+		haveSequence = false;
+		epoch = 0;
+		nextSequence = 0;
+
+		std::vector<std::string> tickers;
+		boost::split(tickers, streamId, boost::is_any_of(","));
+		tickersValue = Json::Value(Json::arrayValue);
+		shmTickers.clear();
+		allShmTickers = false;
+		for(const auto& ticker : tickers)
+		{
+			tickersValue.append(ticker);
+
+			if(ticker.substr(0, 2) != "t:")
+				continue;
+			auto pureTicker = ticker.substr(2);
+			if(pureTicker == "*")
+				allShmTickers = true;
+			shmTickers.insert(pureTicker);
+		}
+	}
 
-	void eventLoop(const std::string& streamId)
+	void eventLoop()
 	{
-		run = true;
+		if(isShmEndpoint(address))
+		{
+			shmEventLoop();
+			return;
+		}
+
+		if(heartbeatPeriod.count() > 0)
+			heartbeatThread = boost::thread(std::bind(&Impl::heartbeatLoop, this));
+
+		// A connection counts as an attempt until something comes over it: a server that accepts
+		// and drops connections right away should not be reconnected to without a backoff
+		int attempt = 0;
 		while(run)
 		{
-			line = std::shared_ptr<cppio::IoLine>(manager->createClient(address));
-			if(line)
-			{
-				int timeout = 2000;
-				line->setOption(cppio::LineOption::ReceiveTimeout, &timeout);
-				cppio::MessageProtocol proto(line.get());
-				cppio::Message msg;
-				msg << (uint32_t)MessageType::Control;
-
-				Json::Value root;
-				root["command"] = "start-stream";
-				std::vector<std::string> tickers;
-				boost::split(tickers, streamId, boost::is_any_of(","));
-				Json::Value tickersValue(Json::arrayValue);
-				for(const auto& ticker : tickers)
+			waitBeforeReconnect(attempt++);
+			if(!run || !openConnection())
+				continue;
+			{
+				boost::unique_lock<boost::mutex> lock(connectionMutex);
+				heartbeatProto = proto.get();
+			}
+
+			BusyPollBackoff backoff(busyPoll);
+			if(busyPoll.enabled)
+				setReceiveTimeout(nonBlockingTimeout());
+
+			while(run)
+			{
+				decoded.clear();
+				auto result = readMessage(decoded, [this](const std::string& ticker, const Tick* ticks, size_t count)
+						{
+							deliverTicks(ticker, ticks, count);
+						});
+				if(result == ReadResult::Disconnected)
+					break;
+				if(result == ReadResult::Message)
+					attempt = 0;
+
+				if(busyPoll.enabled)
 				{
-					tickersValue.append(ticker);
+					if(result == ReadResult::Timeout)
+						backoff.idle();
+					else
+						backoff.reset();
 				}
-				root["tickers"] = tickersValue;
-				Json::FastWriter writer;
-				msg << writer.write(root);
+			}
+			closeConnection();
+		}
 
-				proto.sendMessage(msg);
+		if(heartbeatThread.joinable())
+			heartbeatThread.join();
+	}
 
-				cppio::Message response;
-				proto.readMessage(response);
+	void heartbeatLoop()
+	{
+		boost::unique_lock<boost::mutex> lock(runMutex);
+		while(run)
+		{
+			runCondition.wait_for(lock, heartbeatPeriod);
+			if(!run)
+				break;
 
-				// TODO check
-				while(run)
+			lock.unlock();
+			{
+				boost::unique_lock<boost::mutex> connectionLock(connectionMutex);
+				if(heartbeatProto)
+					sendHeartbeat(*heartbeatProto);
+			}
+			lock.lock();
+		}
+	}
+
+	void shmEventLoop()
+	{
+		int attempt = 0;
+		BusyPollBackoff backoff(busyPoll.enabled ? busyPoll : shmIdlePolicy());
+		while(run)
+		{
+			if(!shmReader)
+			{
+				if(!openShmReader())
 				{
-					try
+					waitBeforeReconnect(attempt++);
+					continue;
+				}
+				attempt = 0;
+			}
+
+			decoded.clear();
+			size_t count = readShm(MaxShmBatch, decoded, [this](const std::string& ticker, const Tick* ticks, size_t count)
 					{
-						cppio::Message incoming;
-						ssize_t rc = proto.readMessage(incoming);
-						if(rc > 0)
-						{
-							uint32_t messageType = incoming.get<uint32_t>(0);
-							if(messageType == (int)goldmine::MessageType::Data)
-							{
-								auto ticker = incoming.get<std::string>(1);
-								size_t size = incoming.frame(2).size();
-								const void* ticks = incoming.frame(2).data();
-								const Tick* tick = reinterpret_cast<const Tick*>(ticks);
-								for(const auto& sink : sinks)
-								{
-									sink->incomingTick(ticker, *tick);
-								}
-								for(const auto& sink : boostSinks)
-								{
-									sink->incomingTick(ticker, *tick);
-								}
-								for(const auto& sink : rawSinks)
-								{
-									sink->incomingTick(ticker, *tick);
-								}
-							}
-
-						}
-						else if(rc != cppio::eTimeout)
-						{
-							break;
-						}
-					}
-					catch(const LibGoldmineException& ex)
+						deliverTicks(ticker, ticks, count);
+					});
+
+			// Spin for a while before backing off, so that a busy stream costs no syscalls
+			if(count > 0)
+				backoff.reset();
+			else
+				backoff.idle();
+		}
+		shmReader.reset();
+	}
+
+	/*
+	 * Reads up to about maxTicks ticks from the current connection without blocking longer than
+	 * `timeout` per message, (re)connecting first if needed. Every run of consecutive ticks of one
+	 * ticker is reported as consume(ticker, ticks, count). Ticks that had to be decoded or copied are
+	 * appended to `out` and reported from there; v2 frames are reported from the message buffer,
+	 * valid only during the call. Returns the number of received ticks.
+	 */
+	template<typename Consumer>
+	size_t pollStream(size_t maxTicks, int timeout, std::vector<Tick>& out, Consumer consume)
+	{
+		if(isShmEndpoint(address))
+		{
+			if(!shmReader && !pollReconnect([this]() { return openShmReader(); }))
+				return 0;
+			return readShm(maxTicks, out, consume);
+		}
+
+		if(!proto && !pollReconnect([this]() { return openConnection(); }))
+			return 0;
+
+		setReceiveTimeout(timeout > 0 ? timeout : nonBlockingTimeout());
+
+		size_t total = 0;
+		while(total < maxTicks)
+		{
+			auto result = readMessage(out, [&](const std::string& ticker, const Tick* ticks, size_t count)
 					{
+						total += count;
+						consume(ticker, ticks, count);
+					});
+
+			if(result == ReadResult::Disconnected)
+			{
+				closeConnection();
+				break;
+			}
+			if(result == ReadResult::Timeout)
+				break;
+
+			// The connection is healthy, the next reconnect is not delayed
+			pollAttempt = 0;
+			nextPollAttempt = boost::chrono::steady_clock::time_point();
+		}
+		return total;
+	}
+
+	template<typename Open>
+	bool pollReconnect(Open open)
+	{
+		auto now = boost::chrono::steady_clock::now();
+		if(now < nextPollAttempt)
+			return false;
+
+		// As in eventLoop, the backoff is reset by pollStream once a message arrives, not by a successful open
+		nextPollAttempt = now + reconnectDelay(++pollAttempt);
+		return open();
+	}
+
+	bool openConnection()
+	{
+		line = std::shared_ptr<cppio::IoLine>(manager->createClient(address));
+		if(!line)
+			return false;
+
+		// Stream reads use the same timeout unless busy-poll or polling mode change it
+		receiveTimeout = -1;
+		setReceiveTimeout(heartbeatPeriod.count() > 0 ? heartbeatPeriod.count() : 2000);
+		proto.reset(new cppio::MessageProtocol(line.get()));
+
+		cppio::Message msg;
+		msg << (uint32_t)MessageType::Control;
+
+		Json::Value root;
+		root["command"] = "start-stream";
+		root["tickers"] = tickersValue;
+		if(protocolVersion >= TickCodecProtocolVersion)
+			root["protocol-version"] = protocolVersion;
+		root["sequence-numbers"] = true;
+		if(haveSequence)
+		{
+			root["resume-from"] = Json::Value((Json::UInt64)nextSequence);
+			root["resume-epoch"] = Json::Value((Json::UInt64)epoch);
+		}
+		Json::FastWriter writer;
+		msg << writer.write(root);
+
+		proto->sendMessage(msg);
+
+		cppio::Message response;
+		ssize_t responseRc = proto->readMessage(response);
+
+		if(responseRc <= 0)
+		{
+			closeConnection();
+			return false;
+		}
+
+		streamVersion = 2;
+		if(response.size() > 1)
+		{
+			Json::Value responseRoot;
+			Json::Reader reader;
+			if(reader.parse(response.get<std::string>(1), responseRoot))
+			{
+				if(responseRoot["protocol-version"].isInt())
+					streamVersion = responseRoot["protocol-version"].asInt();
+				if(responseRoot["sequence-numbers"].asBool())
+					startSequence(responseRoot["epoch"].asUInt64(), responseRoot["next-sequence"].asUInt64());
+			}
+		}
+
+		if(heartbeatPeriod.count() > 0)
+			sendHeartbeatRequest(*proto);
+
+		// Liveness is checked only once the server has shown that it sends heartbeats
+		serverHeartbeats = false;
+		lastReceived = boost::chrono::steady_clock::now();
+		lastHeartbeat = lastReceived;
+		decoder.reset();
+		return true;
+	}
+
+	// Probed once, see nonBlockingReceiveTimeout
+	int nonBlockingTimeout()
+	{
+		if(nonBlockingReceiveTimeoutValue < 0)
+			nonBlockingReceiveTimeoutValue = nonBlockingReceiveTimeout(*manager, address);
+		return nonBlockingReceiveTimeoutValue;
+	}
+
+	void setReceiveTimeout(int timeout)
+	{
+		if(timeout != receiveTimeout)
+		{
+			line->setOption(cppio::LineOption::ReceiveTimeout, &timeout);
+			receiveTimeout = timeout;
+		}
+	}
+
+	void closeConnection()
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(connectionMutex);
+			heartbeatProto = nullptr;
+		}
+		proto.reset();
+		line.reset();
+	}
+
+	bool openShmReader()
+	{
+		try
+		{
+			shmReader.reset(new ShmRingReader(address));
+			return true;
+		}
+		catch(const LibGoldmineException& ex)
+		{
+			return false;
+		}
+	}
+
+	/*
+	 * Reads one message from the server and reports ticks of a Data message as consume(ticker, ticks, count).
+	 * Frames of the tick codec are decoded into `out`; v2 frames are packed ticks, which are reported
+	 * straight from the message buffer without a copy.
+	 */
+	template<typename Consumer>
+	ReadResult readMessage(std::vector<Tick>& out, Consumer consume)
+	{
+		size_t first = out.size();
+		cppio::Message incoming;
+		const Tick* ticks = nullptr;
+		size_t count = 0;
+		try
+		{
+			ssize_t rc = proto->readMessage(incoming);
+
+			auto now = boost::chrono::steady_clock::now();
+			if(heartbeatPeriod.count() > 0)
+			{
+				// There is no heartbeat thread in polling mode
+				if(polling && (now - lastHeartbeat >= heartbeatPeriod))
+				{
+					sendHeartbeat(*proto);
+					lastHeartbeat = now;
+				}
+				if(serverHeartbeats && (rc <= 0) && (now - lastReceived > heartbeatPeriod * 3))
+					return ReadResult::Disconnected;
+			}
+
+			if(rc <= 0)
+				return (rc == cppio::eTimeout) ? ReadResult::Timeout : ReadResult::Disconnected;
+
+			lastReceived = now;
+			uint32_t messageType = incoming.get<uint32_t>(0);
+			if(messageType == (int)goldmine::MessageType::Service)
+			{
+				if(incoming.get<uint32_t>(1) == (uint32_t)ServiceDataType::Heartbeat)
+					serverHeartbeats = true;
+			}
+			else if(messageType == (int)goldmine::MessageType::Data)
+			{
+				ticker = incoming.get<std::string>(1);
+				const auto& frame = incoming.frame(2);
+				if(streamVersion >= TickCodecProtocolVersion)
+				{
+					decoder.decode(ticker, frame.data(), frame.size(), out);
+					ticks = out.data() + first;
+					count = out.size() - first;
+				}
+				else
+				{
+					// Tick is packed, so v2 frame contents are ticks as is
+					ticks = reinterpret_cast<const Tick*>(frame.data());
+					count = frame.size() / sizeof(Tick);
+				}
+
+				if(incoming.size() > 3)
+					nextSequence = incoming.get<uint64_t>(3) + count;
+			}
+			else if(messageType == (int)goldmine::MessageType::Event)
+			{
+				if(incoming.get<uint32_t>(1) == (uint32_t)EventId::StreamGap)
+				{
+					uint64_t toSequence = incoming.get<uint64_t>(3);
+					dispatchGap(incoming.get<uint64_t>(2), toSequence);
+					if(toSequence > nextSequence)
+						nextSequence = toSequence;
+				}
+			}
+		}
+		catch(const ProtocolError& ex)
+		{
+			// Decoder state is lost, start over with a new connection
+			out.resize(first);
+			return ReadResult::Disconnected;
+		}
+		catch(const LibGoldmineException& ex)
+		{
+			out.resize(first);
+			return ReadResult::Message;
+		}
+
+		if(count > 0)
+			consume(ticker, ticks, count);
+		return ReadResult::Message;
+	}
+
+	/*
+	 * Reads up to maxTicks ticks of the requested tickers from the shm ring, stops when the ring is empty.
+	 * Ticks are appended to `out` and reported from there to `consume` in the same way as in pollStream.
+	 */
+	template<typename Consumer>
+	size_t readShm(size_t maxTicks, std::vector<Tick>& out, Consumer consume)
+	{
+		std::string shmTicker;
+		Tick tick;
+		uint64_t lost;
+
+		// Consecutive ticks of the same ticker are reported as one range
+		size_t first = out.size();
+		size_t total = 0;
+		auto flush = [&]()
+		{
+			if(out.size() > first)
+			{
+				consume(ticker, out.data() + first, out.size() - first);
+				first = out.size();
+			}
+		};
+
+		while(total < maxTicks)
+		{
+			uint64_t cursor = shmReader->cursor();
+			auto result = shmReader->read(shmTicker, tick, lost);
+			if(result == ShmRingReader::Result::Ok)
+			{
+				if(allShmTickers || (shmTickers.find(shmTicker) != shmTickers.end()))
+				{
+					if(shmTicker != ticker)
+					{
+						flush();
+						ticker = shmTicker;
 					}
-					sendHeartbeat(proto);
+					out.push_back(tick);
+					total++;
 				}
 			}
 			else
 			{
-				boost::this_thread::sleep_for(boost::chrono::seconds(5));
+				flush();
+				if(result == ShmRingReader::Result::Overrun)
+					dispatchGap(shmReader->cursor() - lost, shmReader->cursor());
+				else if(result == ShmRingReader::Result::Restarted)
+					dispatchGap(cursor, 0); // Nothing can be said about what was lost
+				else
+					break;
+			}
+		}
+		flush();
+		return total;
+	}
+
+	boost::chrono::milliseconds reconnectDelay(int attempt)
+	{
+		if(attempt == 0)
+			return boost::chrono::milliseconds(0);
+
+		double delay = reconnectPolicy.initialDelay.count() * std::pow(reconnectPolicy.multiplier, attempt - 1);
+		delay = std::min(delay, (double)reconnectPolicy.maxDelay.count());
+		std::uniform_real_distribution<double> jitter(1. - reconnectPolicy.jitter, 1.);
+		return boost::chrono::milliseconds((int64_t)(delay * jitter(random)));
+	}
+
+	void waitBeforeReconnect(int attempt)
+	{
+		auto delay = reconnectDelay(attempt);
+		boost::unique_lock<boost::mutex> lock(runMutex);
+		if(run && (delay.count() > 0))
+			runCondition.wait_for(lock, delay);
+	}
+
+	void startSequence(uint64_t newEpoch, uint64_t newNextSequence)
+	{
+		if(haveSequence && (newEpoch != epoch))
+		{
+			// Source has been restarted, nothing can be said about what was lost
+			dispatchGap(nextSequence, 0);
+			nextSequence = newNextSequence;
+		}
+		else if(!haveSequence)
+		{
+			nextSequence = newNextSequence;
+		}
+		epoch = newEpoch;
+		haveSequence = true;
+	}
+
+	void dispatchGap(uint64_t fromSequence, uint64_t toSequence)
+	{
+		for(const auto& sink : sinks)
+		{
+			sink->streamGap(fromSequence, toSequence);
+		}
+		for(const auto& sink : boostSinks)
+		{
+			sink->streamGap(fromSequence, toSequence);
+		}
+		for(const auto& sink : rawSinks)
+		{
+			sink->streamGap(fromSequence, toSequence);
+		}
+	}
+
+	void startWorkers()
+	{
+		// Threads of the previous workers use them until they are joined
+		stopWorkers();
+
+		boost::unique_lock<boost::mutex> lock(workersMutex);
+		workers.clear();
+		for(size_t i = 0; i < dispatchWorkers; i++)
+		{
+			workers.emplace_back(new DispatchWorker(dispatchQueueCapacity));
+			auto worker = workers.back().get();
+			worker->thread = boost::thread(std::bind(&Impl::workerLoop, this, worker));
+		}
+	}
+
+	void stopWorkers()
+	{
+		// Workers drain their queues before exiting
+		for(const auto& worker : workers)
+		{
+			worker->run = false;
+			worker->wake();
+		}
+		for(const auto& worker : workers)
+		{
+			if(worker->thread.joinable())
+				worker->thread.join();
+		}
+	}
+
+	void deliverTicks(const std::string& ticker, const Tick* ticks, size_t count)
+	{
+		if(workers.empty())
+		{
+			dispatchTicks(ticker, ticks, count);
+			return;
+		}
+
+		auto& worker = *workers[std::hash<std::string>()(ticker) % workers.size()];
+		DispatchItem item;
+		item.ticker = ticker;
+		item.enqueued = boost::chrono::steady_clock::now();
+		for(size_t i = 0; i < count; i++)
+		{
+			item.tick = ticks[i];
+			worker.enqueued.fetch_add(1);
+			while(!worker.queue.push(item))
+			{
+				worker.wake();
+				boost::this_thread::yield();
 			}
 		}
+		worker.wake();
+	}
+
+	void workerLoop(DispatchWorker* worker)
+	{
+		std::vector<DispatchItem> items(MaxWorkerBatch);
+		std::vector<Tick> ticks;
+		int idleRounds = 0;
+		while(true)
+		{
+			bool running = worker->run.load();
+			size_t count = worker->queue.pop(items.data(), items.size());
+			if(count == 0)
+			{
+				if(!running)
+					break;
+
+				if(++idleRounds > 1000)
+				{
+					// Producer may miss the sleeping flag, so the wait is bounded
+					boost::unique_lock<boost::mutex> lock(worker->mutex);
+					worker->sleeping = true;
+					if(worker->run && !worker->queue.read_available())
+						worker->condition.wait_for(lock, boost::chrono::milliseconds(10));
+					worker->sleeping = false;
+				}
+				continue;
+			}
+			idleRounds = 0;
+
+			// Consecutive items of the same ticker are handed to sinks as one span
+			size_t first = 0;
+			while(first < count)
+			{
+				size_t last = first;
+				ticks.clear();
+				while((last < count) && (items[last].ticker == items[first].ticker))
+				{
+					ticks.push_back(items[last].tick);
+					last++;
+				}
+
+				uint64_t lag = boost::chrono::duration_cast<boost::chrono::microseconds>(
+						boost::chrono::steady_clock::now() - items[first].enqueued).count();
+				worker->lastLag = lag;
+				if(lag > worker->maxLag)
+					worker->maxLag = lag;
+
+				dispatchTicks(items[first].ticker, ticks.data(), ticks.size());
+				worker->dispatched.fetch_add(ticks.size());
+				first = last;
+			}
+		}
+	}
+
+	void dispatchTicks(const std::string& ticker, const Tick* ticks, size_t count)
+	{
+		if(count == 0)
+			return;
+
+		for(const auto& sink : sinks)
+		{
+			sink->incomingTicks(ticker, ticks, count);
+		}
+		for(const auto& sink : boostSinks)
+		{
+			sink->incomingTicks(ticker, ticks, count);
+		}
+		for(const auto& sink : rawSinks)
+		{
+			sink->incomingTicks(ticker, ticks, count);
+		}
+	}
+
+	void sendHeartbeatRequest(cppio::MessageProtocol& proto)
+	{
+		Json::Value root;
+		root["command"] = "heartbeat-request";
+		root["period"] = heartbeatPeriod.count() / 1000.;
+		Json::FastWriter writer;
+
+		cppio::Message msg;
+		msg << (uint32_t)MessageType::Control;
+		msg << writer.write(root);
+
+		proto.sendMessage(msg);
 	}
 
 	void sendHeartbeat(cppio::MessageProtocol& proto)
@@ -125,6 +807,41 @@ QuoteSourceClient::Sink::~Sink()
 {
 }
 
+QuoteSourceClient::ReconnectPolicy::ReconnectPolicy() : initialDelay(100),
+	maxDelay(5000),
+	multiplier(2.),
+	jitter(0.5)
+{
+}
+
+void QuoteSourceClient::Sink::streamGap(uint64_t fromSequence, uint64_t toSequence)
+{
+}
+
+void QuoteSourceClient::PollBuffer::clear()
+{
+	ticks.clear();
+	tickerIds.clear();
+}
+
+uint32_t QuoteSourceClient::PollBuffer::tickerId(const std::string& ticker)
+{
+	auto it = m_tickerIds.find(ticker);
+	if(it != m_tickerIds.end())
+		return it->second;
+
+	uint32_t id = tickers.size();
+	tickers.push_back(ticker);
+	m_tickerIds.emplace(ticker, id);
+	return id;
+}
+
+void QuoteSourceClient::Sink::incomingTicks(const std::string& ticker, const Tick* ticks, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+		incomingTick(ticker, ticks[i]);
+}
+
 QuoteSourceClient::QuoteSourceClient(const std::shared_ptr<cppio::IoLineManager>& manager, const std::string& address) :
 	m_impl(new Impl(manager, address))
 {
@@ -136,14 +853,122 @@ QuoteSourceClient::~QuoteSourceClient()
 
 void QuoteSourceClient::startStream(const std::string& streamId)
 {
-	m_impl->streamThread = boost::thread(std::bind(&Impl::eventLoop, m_impl.get(), streamId));
+	// The previous stream, if any, should be gone before its state is reset
+	stop();
+
+	m_impl->setStreamId(streamId);
+	m_impl->startWorkers();
+	m_impl->run = true;
+	m_impl->streamThread = boost::thread(std::bind(&Impl::eventLoop, m_impl.get()));
+}
+
+void QuoteSourceClient::startPolling(const std::string& streamId)
+{
+	// A connection of the previous stream has requested other tickers
+	m_impl->closeConnection();
+	m_impl->shmReader.reset();
+
+	m_impl->setStreamId(streamId);
+	m_impl->polling = true;
+	m_impl->pollAttempt = 0;
+	m_impl->nextPollAttempt = boost::chrono::steady_clock::time_point();
+}
+
+size_t QuoteSourceClient::poll(size_t maxTicks, const boost::chrono::milliseconds& timeout)
+{
+	if(!m_impl->polling)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Client is not in polling mode"));
+
+	auto& decoded = m_impl->decoded;
+	decoded.clear();
+	return m_impl->pollStream(maxTicks, timeout.count(), decoded, [&](const std::string& ticker, const Tick* ticks, size_t count)
+			{
+				m_impl->dispatchTicks(ticker, ticks, count);
+			});
+}
+
+size_t QuoteSourceClient::pollBatch(PollBuffer& out, size_t maxTicks, const boost::chrono::milliseconds& timeout)
+{
+	if(!m_impl->polling)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Client is not in polling mode"));
+
+	return m_impl->pollStream(maxTicks, timeout.count(), out.ticks, [&](const std::string& ticker, const Tick* ticks, size_t count)
+			{
+				// Decoded ticks are already in the buffer, v2 frames are reported from the message
+				if(out.ticks.size() == out.tickerIds.size())
+					out.ticks.insert(out.ticks.end(), ticks, ticks + count);
+				out.tickerIds.resize(out.ticks.size(), out.tickerId(ticker));
+			});
 }
 
 void QuoteSourceClient::stop()
 {
-	m_impl->run = false;
+	{
+		boost::unique_lock<boost::mutex> lock(m_impl->runMutex);
+		m_impl->run = false;
+		m_impl->runCondition.notify_all();
+	}
 	if(m_impl->streamThread.joinable())
 		m_impl->streamThread.join();
+	m_impl->stopWorkers();
+
+	if(m_impl->polling)
+	{
+		m_impl->closeConnection();
+		m_impl->shmReader.reset();
+		m_impl->polling = false;
+	}
+}
+
+void QuoteSourceClient::setProtocolVersion(int version)
+{
+	m_impl->protocolVersion = version;
+}
+
+void QuoteSourceClient::setHeartbeatPeriod(const boost::chrono::milliseconds& period)
+{
+	if(period.count() < 0)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid heartbeat period"));
+	m_impl->heartbeatPeriod = period;
+}
+
+void QuoteSourceClient::setBusyPoll(const BusyPollPolicy& policy)
+{
+	if(!policy.valid())
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid busy-poll policy"));
+	m_impl->busyPoll = policy;
+}
+
+void QuoteSourceClient::setReconnectPolicy(const ReconnectPolicy& policy)
+{
+	if(policy.initialDelay.count() < 0 || policy.maxDelay < policy.initialDelay || policy.multiplier < 1. ||
+			policy.jitter < 0. || policy.jitter > 1.)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid reconnect policy"));
+	m_impl->reconnectPolicy = policy;
+}
+
+void QuoteSourceClient::setDispatchWorkers(size_t workers, size_t queueCapacity)
+{
+	if(queueCapacity == 0)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Dispatch queue capacity should be positive"));
+	m_impl->dispatchWorkers = workers;
+	m_impl->dispatchQueueCapacity = queueCapacity;
+}
+
+std::vector<QuoteSourceClient::DispatchStats> QuoteSourceClient::dispatchStats() const
+{
+	std::vector<DispatchStats> result;
+	boost::unique_lock<boost::mutex> lock(m_impl->workersMutex);
+	for(const auto& worker : m_impl->workers)
+	{
+		DispatchStats stats;
+		stats.dispatchedTicks = worker->dispatched.load();
+		stats.queueDepth = worker->enqueued.load() - stats.dispatchedTicks;
+		stats.lastLagMicroseconds = worker->lastLag.load();
+		stats.maxLagMicroseconds = worker->maxLag.load();
+		result.push_back(stats);
+	}
+	return result;
 }
 
 void QuoteSourceClient::registerSink(const std::shared_ptr<Sink>& sink)
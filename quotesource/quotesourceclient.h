@@ -4,10 +4,14 @@
 
 #include "cppio/iolinemanager.h"
 #include "goldmine/data.h"
+#include "goldmine/busypoll.h"
 
 #include <boost/shared_ptr.hpp>
+#include <boost/chrono.hpp>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace goldmine
 {
@@ -20,6 +24,63 @@ public:
 		virtual ~Sink();
 
 		virtual void incomingTick(const std::string& ticker, const Tick& tick) = 0;
+
+		/*
+		 * Called with consecutive ticks of one ticker, e.g. a whole decoded data frame.
+		 * `ticks` is valid only during the call. Default implementation calls incomingTick for every tick.
+		 */
+		virtual void incomingTicks(const std::string& ticker, const Tick* ticks, size_t count);
+
+		/*
+		 * Ticks with sequence numbers in [fromSequence, toSequence) were lost and will not be delivered.
+		 * toSequence is 0 if the extent is unknown, e.g. the quotesource has been restarted.
+		 * Called from the network thread. Default implementation does nothing.
+		 */
+		virtual void streamGap(uint64_t fromSequence, uint64_t toSequence);
+	};
+
+	struct DispatchStats
+	{
+		size_t queueDepth;
+		uint64_t dispatchedTicks;
+		uint64_t lastLagMicroseconds; // time from hand-off by the network thread to the sink call
+		uint64_t maxLagMicroseconds;
+	};
+
+	static const size_t DefaultDispatchQueueCapacity = 65536;
+	static constexpr int DefaultHeartbeatPeriod = 1000; // ms
+
+	/*
+	 * Delay before the n-th consecutive reconnect attempt: none for the first one, then
+	 * initialDelay * multiplier^(n - 2) capped at maxDelay, reduced by a random fraction of up to `jitter`.
+	 * Attempts stop being consecutive once a message is received over the connection; a connection
+	 * that is dropped before that counts as a failed attempt.
+	 */
+	struct ReconnectPolicy
+	{
+		ReconnectPolicy();
+
+		boost::chrono::milliseconds initialDelay;
+		boost::chrono::milliseconds maxDelay;
+		double multiplier;
+		double jitter;
+	};
+
+	/*
+	 * Caller-owned destination of pollBatch. tickerIds[i] is the index of the ticker of ticks[i]
+	 * in `tickers`; ids stay the same for the lifetime of the buffer, clear() keeps them.
+	 */
+	struct PollBuffer
+	{
+		std::vector<Tick> ticks;
+		std::vector<uint32_t> tickerIds;
+		std::vector<std::string> tickers;
+
+		void clear();
+		uint32_t tickerId(const std::string& ticker);
+
+	private:
+		std::unordered_map<std::string, uint32_t> m_tickerIds;
 	};
 
 	QuoteSourceClient(const std::shared_ptr<cppio::IoLineManager>& manager, const std::string& address);
@@ -28,6 +89,66 @@ public:
 	void startStream(const std::string& streamId);
 	void stop();
 
+	/*
+	 * Polling mode: no thread is started, the stream is read by poll/pollBatch on the caller's thread.
+	 * The connection is made by the first poll; reconnects, resume and heartbeats work as with
+	 * startStream, but only while the caller polls, so it should poll at least once per heartbeat period.
+	 * Connecting may block the poll call for up to a heartbeat period.
+	 */
+	void startPolling(const std::string& streamId);
+
+	/*
+	 * Reads messages until at least maxTicks ticks are received or nothing comes within `timeout`
+	 * (0 makes poll non-blocking), and hands the ticks to the sinks before returning. Frames are
+	 * not split, so the result may exceed maxTicks by less than one frame. Dispatch workers are not used.
+	 * Returns the number of received ticks.
+	 */
+	size_t poll(size_t maxTicks, const boost::chrono::milliseconds& timeout = boost::chrono::milliseconds(1));
+
+	/*
+	 * Same as poll, but ticks are decoded straight into `out` (appended to it) instead of being
+	 * handed to the sinks. Stream gaps are still reported to the sinks.
+	 */
+	size_t pollBatch(PollBuffer& out, size_t maxTicks, const boost::chrono::milliseconds& timeout = boost::chrono::milliseconds(1));
+
+	/*
+	 * Highest protocol version to request from the server, 3 by default.
+	 * The server may answer with a lower one.
+	 */
+	void setProtocolVersion(int version);
+
+	/*
+	 * Should be called before startStream. After reconnect the client requests the same tickers
+	 * and resumes the stream from the last received tick if the server supports it.
+	 */
+	void setReconnectPolicy(const ReconnectPolicy& policy);
+
+	/*
+	 * Should be called before startStream. Both sides send heartbeats with this period, and the
+	 * connection is re-established if nothing comes from the server for three periods.
+	 * With startStream heartbeats are sent from a separate thread, so slow sinks do not delay them.
+	 * 0 disables heartbeats.
+	 */
+	void setHeartbeatPeriod(const boost::chrono::milliseconds& period);
+
+	/*
+	 * Should be called before startStream. The network thread reads the stream with busy-poll,
+	 * see BusyPollPolicy. For shm endpoints the policy replaces the default spin-then-sleep
+	 * backoff of an idle reader. Has no effect in polling mode, where the caller drives reads.
+	 */
+	void setBusyPoll(const BusyPollPolicy& policy);
+
+	/*
+	 * Should be called before startStream. With non-zero `workers` sinks are called from a pool
+	 * of worker threads instead of the network thread. Every ticker is bound to one worker, so ticks
+	 * of a ticker arrive in order, but sinks should tolerate concurrent calls for different tickers.
+	 * When a worker queue is full the network thread waits for it.
+	 */
+	void setDispatchWorkers(size_t workers, size_t queueCapacity = DefaultDispatchQueueCapacity);
+
+	// One entry per worker, empty if sinks are called from the network thread
+	std::vector<DispatchStats> dispatchStats() const;
+
 	void registerSink(const std::shared_ptr<Sink>& sink);
 	void registerBoostSink(const boost::shared_ptr<Sink>& sink);
 	void registerRawSink(Sink* sink);
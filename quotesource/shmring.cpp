@@ -0,0 +1,394 @@
+/*
+ * shmring.cpp
+ */
+
+#include "shmring.h"
+
+#include "goldmine/exceptions.h"
+
+#include <atomic>
+#include <cstring>
+
+#include <boost/chrono.hpp>
+
+#ifndef WIN32
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace goldmine
+{
+
+static const uint64_t RingMagic = 0x474d53484d524e47ull; // "GMSHMRNG"
+static const uint32_t RingVersion = 2;
+
+// An idle reader checks this often whether the writer has replaced the shared memory object
+static const uint32_t ReopenCheckInterval = 4096;
+
+struct RingHeader
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t slotSize;
+	uint64_t capacity;
+	uint64_t generation; // differs between writer instances
+	alignas(64) std::atomic<uint64_t> writeSequence; // sequence of the next slot to be written
+};
+
+struct alignas(64) RingSlot
+{
+	std::atomic<uint64_t> sequence; // sequence + 1 when complete, 0 while being written
+	uint32_t tickerLength;
+	char ticker[ShmRingWriter::MaxTickerLength + 1];
+	Tick tick;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+		"Ring sequence counters must be lock-free 64-bit words to be shared between processes");
+
+bool isShmEndpoint(const std::string& endpoint)
+{
+	return endpoint.compare(0, 6, "shm://") == 0;
+}
+
+static std::string shmName(const std::string& endpoint)
+{
+	if(!isShmEndpoint(endpoint) || endpoint.size() == 6)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Invalid shared memory endpoint: " + endpoint));
+
+	auto name = endpoint.substr(6);
+	if(name.find('/') != std::string::npos)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Shared memory endpoint name should not contain '/': " + endpoint));
+	return "/goldmine-" + name;
+}
+
+static size_t mappingSize(size_t capacity)
+{
+	return sizeof(RingHeader) + capacity * sizeof(RingSlot);
+}
+
+static RingSlot* slotsOf(void* mapping)
+{
+	return reinterpret_cast<RingSlot*>(reinterpret_cast<char*>(mapping) + sizeof(RingHeader));
+}
+
+#ifndef WIN32
+static uint64_t newGeneration()
+{
+	auto now = boost::chrono::system_clock::now().time_since_epoch();
+	return (uint64_t)boost::chrono::duration_cast<boost::chrono::nanoseconds>(now).count() ^ ((uint64_t)getpid() << 32);
+}
+#endif
+
+struct ShmRingWriter::Impl
+{
+	Impl() : lockFd(-1), header(nullptr), slots(nullptr), mask(0), size(0)
+	{
+	}
+
+	std::string name;
+	int lockFd; // flock'ed for the lifetime of the writer
+	RingHeader* header;
+	RingSlot* slots;
+	uint64_t mask;
+	size_t size;
+};
+
+ShmRingWriter::ShmRingWriter(const std::string& endpoint, size_t capacity) : m_impl(new Impl)
+{
+	if(capacity == 0 || (capacity & (capacity - 1)) != 0)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Shared memory ring capacity should be a power of two"));
+
+#ifndef WIN32
+	m_impl->name = shmName(endpoint);
+	m_impl->size = mappingSize(capacity);
+	m_impl->mask = capacity - 1;
+
+	// Only one writer per endpoint: the lock is released by the kernel even if the writer is killed
+	auto lockName = m_impl->name + ".lock";
+	m_impl->lockFd = shm_open(lockName.c_str(), O_CREAT | O_RDWR, 0644);
+	if(m_impl->lockFd < 0)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unable to create shared memory object: " + lockName));
+	if(flock(m_impl->lockFd, LOCK_EX | LOCK_NB) < 0)
+	{
+		close(m_impl->lockFd);
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Shared memory ring already has a writer: " + m_impl->name));
+	}
+
+	/*
+	 * An object left by a previous writer may still be mapped by readers, and shrinking it would make them
+	 * fault, so it is unlinked rather than reused. Readers keep their mapping until they notice the new object.
+	 */
+	shm_unlink(m_impl->name.c_str());
+	int fd = shm_open(m_impl->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if(fd < 0)
+	{
+		close(m_impl->lockFd);
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unable to create shared memory object: " + m_impl->name));
+	}
+
+	if(ftruncate(fd, m_impl->size) < 0)
+	{
+		close(fd);
+		shm_unlink(m_impl->name.c_str());
+		close(m_impl->lockFd);
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unable to resize shared memory object: " + m_impl->name));
+	}
+
+	void* mapping = mmap(nullptr, m_impl->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED)
+	{
+		shm_unlink(m_impl->name.c_str());
+		close(m_impl->lockFd);
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Unable to map shared memory object: " + m_impl->name));
+	}
+
+	m_impl->header = reinterpret_cast<RingHeader*>(mapping);
+	m_impl->slots = slotsOf(mapping);
+
+	// The new object is zero-filled. Readers validate the header before looking at anything else, so publish it last.
+	m_impl->header->version = RingVersion;
+	m_impl->header->slotSize = sizeof(RingSlot);
+	m_impl->header->capacity = capacity;
+	m_impl->header->generation = newGeneration();
+	std::atomic_thread_fence(std::memory_order_release);
+	m_impl->header->magic = RingMagic;
+#else
+	BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Shared memory transport is not supported on this platform"));
+#endif
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+#ifndef WIN32
+	if(m_impl->header)
+	{
+		munmap(m_impl->header, m_impl->size);
+		shm_unlink(m_impl->name.c_str());
+	}
+	// The lock object stays linked, removing it would let two writers lock different objects
+	if(m_impl->lockFd >= 0)
+		close(m_impl->lockFd);
+#endif
+}
+
+void ShmRingWriter::write(const std::string& ticker, const Tick& tick)
+{
+	if(ticker.size() > MaxTickerLength)
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Ticker is too long for shared memory transport: " + ticker));
+
+	uint64_t seq = m_impl->header->writeSequence.load(std::memory_order_relaxed);
+	RingSlot& slot = m_impl->slots[seq & m_impl->mask];
+
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.tickerLength = ticker.size();
+	memcpy(slot.ticker, ticker.data(), ticker.size());
+	slot.tick = tick;
+
+	slot.sequence.store(seq + 1, std::memory_order_release);
+	m_impl->header->writeSequence.store(seq + 1, std::memory_order_release);
+}
+
+uint64_t ShmRingWriter::sequence() const
+{
+	return m_impl->header->writeSequence.load(std::memory_order_relaxed);
+}
+
+struct ShmRingReader::Impl
+{
+	Impl() : header(nullptr), slots(nullptr), mask(0), capacity(0), size(0), cursor(0),
+		generation(0), device(0), inode(0), idleReads(0)
+	{
+	}
+
+#ifndef WIN32
+	/*
+	 * Maps the shared memory object which is currently linked under `name`.
+	 * Returns false if there is no valid ring, leaving the current mapping intact.
+	 */
+	bool map(std::string& error)
+	{
+		int fd = shm_open(name.c_str(), O_RDONLY, 0);
+		if(fd < 0)
+		{
+			error = "Shared memory object does not exist: " + name;
+			return false;
+		}
+
+		struct stat st;
+		if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(RingHeader))
+		{
+			close(fd);
+			error = "Shared memory object is not initialized: " + name;
+			return false;
+		}
+
+		void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if(mapping == MAP_FAILED)
+		{
+			error = "Unable to map shared memory object: " + name;
+			return false;
+		}
+
+		auto newHeader = reinterpret_cast<RingHeader*>(mapping);
+		bool valid = (newHeader->magic == RingMagic);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		valid = valid && (newHeader->version == RingVersion) &&
+			(newHeader->slotSize == sizeof(RingSlot)) &&
+			(mappingSize(newHeader->capacity) <= (size_t)st.st_size);
+		if(!valid)
+		{
+			munmap(mapping, st.st_size);
+			error = "Shared memory object has incompatible layout: " + name;
+			return false;
+		}
+
+		unmap();
+		header = newHeader;
+		size = st.st_size;
+		slots = slotsOf(mapping);
+		capacity = header->capacity;
+		mask = capacity - 1;
+		generation = header->generation;
+		device = st.st_dev;
+		inode = st.st_ino;
+		return true;
+	}
+
+	void unmap()
+	{
+		if(header)
+			munmap(header, size);
+		header = nullptr;
+	}
+
+	/*
+	 * A restarted writer unlinks the old object and creates a new one under the same name,
+	 * which a reader would never see through its old mapping.
+	 */
+	bool replaced()
+	{
+		struct stat st;
+		int fd = shm_open(name.c_str(), O_RDONLY, 0);
+		if(fd < 0)
+			return false;
+		bool result = (fstat(fd, &st) == 0) && ((st.st_dev != device) || (st.st_ino != inode));
+		close(fd);
+		return result;
+	}
+#endif
+
+	std::string name;
+	RingHeader* header;
+	RingSlot* slots;
+	uint64_t mask;
+	uint64_t capacity;
+	size_t size;
+	uint64_t cursor;
+	uint64_t generation;
+	uint64_t device;
+	uint64_t inode;
+	uint32_t idleReads;
+};
+
+ShmRingReader::ShmRingReader(const std::string& endpoint) : m_impl(new Impl)
+{
+#ifndef WIN32
+	m_impl->name = shmName(endpoint);
+	std::string error;
+	if(!m_impl->map(error))
+		BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str(error));
+
+	m_impl->cursor = m_impl->header->writeSequence.load(std::memory_order_acquire);
+#else
+	BOOST_THROW_EXCEPTION(ParameterError() << errinfo_str("Shared memory transport is not supported on this platform"));
+#endif
+}
+
+ShmRingReader::~ShmRingReader()
+{
+#ifndef WIN32
+	m_impl->unmap();
+#endif
+}
+
+ShmRingReader::Result ShmRingReader::read(std::string& ticker, Tick& tick, uint64_t& lost)
+{
+	lost = 0;
+	uint64_t head = m_impl->header->writeSequence.load(std::memory_order_acquire);
+	if((head < m_impl->cursor) || (m_impl->header->generation != m_impl->generation))
+	{
+		// Writer of an older version has been restarted over the same object
+		m_impl->generation = m_impl->header->generation;
+#ifndef WIN32
+		std::string error;
+		m_impl->map(error);
+#endif
+		m_impl->cursor = 0;
+		m_impl->idleReads = 0;
+		return Result::Restarted;
+	}
+
+	if(head == m_impl->cursor)
+	{
+#ifndef WIN32
+		if(++m_impl->idleReads >= ReopenCheckInterval)
+		{
+			m_impl->idleReads = 0;
+			std::string error;
+			if(m_impl->replaced() && m_impl->map(error))
+			{
+				m_impl->cursor = 0;
+				return Result::Restarted;
+			}
+		}
+#endif
+		return Result::Empty;
+	}
+	m_impl->idleReads = 0;
+
+	if(head - m_impl->cursor > m_impl->capacity)
+	{
+		lost = head - m_impl->capacity - m_impl->cursor;
+		m_impl->cursor = head - m_impl->capacity;
+		return Result::Overrun;
+	}
+
+	const RingSlot& slot = m_impl->slots[m_impl->cursor & m_impl->mask];
+	uint64_t before = slot.sequence.load(std::memory_order_acquire);
+	if(before == m_impl->cursor + 1)
+	{
+		size_t length = slot.tickerLength;
+		if(length > ShmRingWriter::MaxTickerLength)
+			length = ShmRingWriter::MaxTickerLength;
+		ticker.assign(slot.ticker, length);
+		tick = slot.tick;
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+		if(after == before)
+		{
+			m_impl->cursor++;
+			return Result::Ok;
+		}
+	}
+
+	// The writer has lapped us while we were copying, so the slot already belongs to a newer sequence
+	lost = 1;
+	m_impl->cursor++;
+	return Result::Overrun;
+}
+
+uint64_t ShmRingReader::cursor() const
+{
+	return m_impl->cursor;
+}
+
+} /* namespace goldmine */
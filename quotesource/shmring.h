@@ -0,0 +1,84 @@
+/*
+ * shmring.h
+ */
+
+#ifndef QUOTESOURCE_SHMRING_H_
+#define QUOTESOURCE_SHMRING_H_
+
+#include "goldmine/data.h"
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+namespace goldmine
+{
+
+/*
+ * Single-writer, multi-reader broadcast ring in /dev/shm.
+ * The writer never waits for readers: every reader keeps its own cursor and
+ * notices when it has been lapped. Neither side makes syscalls per tick.
+ */
+
+bool isShmEndpoint(const std::string& endpoint);
+
+class ShmRingWriter
+{
+public:
+	static const size_t DefaultCapacity = 65536;
+	static const size_t MaxTickerLength = 47;
+
+	/*
+	 * Creates a new shared memory object for the ring, replacing the one left by a previous writer.
+	 * Fails with ParameterError if another writer of the endpoint is alive.
+	 */
+	ShmRingWriter(const std::string& endpoint, size_t capacity = DefaultCapacity);
+	virtual ~ShmRingWriter();
+
+	void write(const std::string& ticker, const Tick& tick);
+
+	uint64_t sequence() const;
+
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_impl;
+};
+
+class ShmRingReader
+{
+public:
+	enum class Result
+	{
+		Ok,
+		Empty,
+		Overrun,
+		Restarted
+	};
+
+	/*
+	 * Fails with ParameterError if the writer has not created the ring yet.
+	 * New readers start at the current write position.
+	 */
+	ShmRingReader(const std::string& endpoint);
+	virtual ~ShmRingReader();
+
+	/*
+	 * On Overrun no tick is returned: `lost` is set to the number of ticks that
+	 * were overwritten before this reader got to them and the cursor is moved
+	 * past them, so the next call continues with the oldest tick still in the ring.
+	 * On Restarted no tick is returned either: the writer has been restarted, the reader has
+	 * switched to its ring and continues from the beginning of it. An idle reader looks for
+	 * a new shared memory object under the endpoint name every few thousand reads.
+	 */
+	Result read(std::string& ticker, Tick& tick, uint64_t& lost);
+
+	uint64_t cursor() const;
+
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_impl;
+};
+
+} /* namespace goldmine */
+
+#endif /* QUOTESOURCE_SHMRING_H_ */
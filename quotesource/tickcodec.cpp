@@ -0,0 +1,181 @@
+/*
+ * tickcodec.cpp
+ */
+
+#include "tickcodec.h"
+
+#include "goldmine/exceptions.h"
+
+namespace goldmine
+{
+
+static const int64_t MicrosPerSecond = 1000000ll;
+static const int MaxPriceScale = 9;
+static const uint32_t EscapedDatatype = 0x0f;
+
+static const int64_t Pow10[] = {
+	1ll, 10ll, 100ll, 1000ll, 10000ll, 100000ll, 1000000ll, 10000000ll, 100000000ll, 1000000000ll
+};
+
+static uint64_t zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void putVarint(uint64_t v, std::vector<char>& out)
+{
+	while(v >= 0x80)
+	{
+		out.push_back((char)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((char)v);
+}
+
+static uint64_t getVarint(const unsigned char*& p, const unsigned char* end)
+{
+	uint64_t result = 0;
+	for(int shift = 0; shift < 64; shift += 7)
+	{
+		if(p == end)
+			BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Truncated v3 data frame"));
+		unsigned char b = *p++;
+		result |= (uint64_t)(b & 0x7f) << shift;
+		if((b & 0x80) == 0)
+			return result;
+	}
+	BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid varint in v3 data frame"));
+}
+
+static int64_t tickTime(const Tick& tick)
+{
+	return (int64_t)tick.timestamp * MicrosPerSecond + tick.useconds;
+}
+
+
+void TickEncoder::encode(const std::string& ticker, const Tick* ticks, size_t count, std::vector<char>& out)
+{
+	auto& state = m_state[ticker];
+	for(size_t i = 0; i < count; i++)
+	{
+		const Tick& tick = ticks[i];
+		encodeOne(state, tick.datatype, tickTime(tick), tick.value.toScaled(), tick.volume, out);
+	}
+}
+
+void TickEncoder::encode(const std::string& ticker, const TickBatch& ticks, std::vector<char>& out)
+{
+	auto& state = m_state[ticker];
+	for(size_t i = 0; i < ticks.size(); i++)
+	{
+		int64_t time = (int64_t)ticks.timestamps[i] * MicrosPerSecond + ticks.useconds[i];
+		int64_t price = decimal_fixed(ticks.priceValues[i], ticks.priceFractionals[i]).toScaled();
+		encodeOne(state, ticks.datatypes[i], time, price, ticks.volumes[i], out);
+	}
+}
+
+void TickEncoder::encodeOne(State& state, uint32_t datatype, int64_t time, int64_t price, int32_t volume, std::vector<char>& out)
+{
+	// Deltas are computed modulo 2^64, so that the decoder restores exact values even on overflow
+	int64_t priceDelta = (int64_t)((uint64_t)price - (uint64_t)state.price);
+	int scale = 0;
+	if(priceDelta != 0)
+	{
+		while((scale < MaxPriceScale) && (priceDelta % 10 == 0))
+		{
+			priceDelta /= 10;
+			scale++;
+		}
+	}
+
+	if(datatype < EscapedDatatype)
+	{
+		out.push_back((char)((datatype << 4) | scale));
+	}
+	else
+	{
+		out.push_back((char)((EscapedDatatype << 4) | scale));
+		putVarint(datatype, out);
+	}
+	putVarint(zigzag((int64_t)((uint64_t)time - (uint64_t)state.time)), out);
+	putVarint(zigzag(priceDelta), out);
+	putVarint(zigzag(volume), out);
+
+	state.time = time;
+	state.price = price;
+}
+
+void TickEncoder::reset()
+{
+	m_state.clear();
+}
+
+template<typename Consumer>
+size_t TickDecoder::decodeRecords(const std::string& ticker, const void* data, size_t size, Consumer consume)
+{
+	auto& state = m_state[ticker];
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char* end = p + size;
+	size_t decoded = 0;
+	while(p < end)
+	{
+		unsigned char header = *p++;
+		int scale = header & 0x0f;
+		uint32_t datatype = header >> 4;
+		if(scale > MaxPriceScale)
+			BOOST_THROW_EXCEPTION(ProtocolError() << errinfo_str("Invalid price scale in v3 data frame"));
+		if(datatype == EscapedDatatype)
+			datatype = getVarint(p, end);
+
+		int64_t timeDelta = unzigzag(getVarint(p, end));
+		int64_t priceDelta = unzigzag(getVarint(p, end)) * Pow10[scale];
+		int32_t volume = unzigzag(getVarint(p, end));
+
+		state.time = (int64_t)((uint64_t)state.time + (uint64_t)timeDelta);
+		state.price = (int64_t)((uint64_t)state.price + (uint64_t)priceDelta);
+
+		consume(datatype, state.time, state.price, volume);
+		decoded++;
+	}
+	return decoded;
+}
+
+size_t TickDecoder::decode(const std::string& ticker, const void* data, size_t size, std::vector<Tick>& out)
+{
+	return decodeRecords(ticker, data, size, [&](uint32_t datatype, int64_t time, int64_t price, int32_t volume)
+			{
+				Tick tick;
+				tick.timestamp = time / MicrosPerSecond;
+				tick.useconds = time % MicrosPerSecond;
+				tick.datatype = datatype;
+				tick.value = decimal_fixed::fromScaled(price);
+				tick.volume = volume;
+				out.push_back(tick);
+			});
+}
+
+size_t TickDecoder::decode(const std::string& ticker, const void* data, size_t size, TickBatch& out)
+{
+	return decodeRecords(ticker, data, size, [&](uint32_t datatype, int64_t time, int64_t price, int32_t volume)
+			{
+				auto value = decimal_fixed::fromScaled(price);
+				out.timestamps.push_back(time / MicrosPerSecond);
+				out.useconds.push_back(time % MicrosPerSecond);
+				out.datatypes.push_back(datatype);
+				out.priceValues.push_back(value.value);
+				out.priceFractionals.push_back(value.fractional);
+				out.volumes.push_back(volume);
+			});
+}
+
+void TickDecoder::reset()
+{
+	m_state.clear();
+}
+
+} /* namespace goldmine */
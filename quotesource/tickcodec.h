@@ -0,0 +1,75 @@
+/*
+ * tickcodec.h
+ */
+
+#ifndef QUOTESOURCE_TICKCODEC_H_
+#define QUOTESOURCE_TICKCODEC_H_
+
+#include "goldmine/data.h"
+#include "goldmine/tickbatch.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace goldmine
+{
+
+/*
+ * Protocol v3 encoding of Data frames.
+ *
+ * Every tick is encoded relative to the previous tick of the same ticker on the
+ * same connection, so encoder and decoder should see the same sequence of frames.
+ * See doc/goldmine-protocol.md for the record layout.
+ */
+
+static const int TickCodecProtocolVersion = 3;
+
+class TickEncoder
+{
+public:
+	void encode(const std::string& ticker, const Tick* ticks, size_t count, std::vector<char>& out);
+	void encode(const std::string& ticker, const TickBatch& ticks, std::vector<char>& out);
+	void reset();
+
+private:
+	struct State
+	{
+		State() : time(0), price(0) {}
+		int64_t time;
+		int64_t price;
+	};
+
+	void encodeOne(State& state, uint32_t datatype, int64_t time, int64_t price, int32_t volume, std::vector<char>& out);
+
+	std::unordered_map<std::string, State> m_state;
+};
+
+class TickDecoder
+{
+public:
+	/*
+	 * Appends decoded ticks to `out`, returns the number of decoded ticks.
+	 * Throws ProtocolError on malformed input.
+	 */
+	size_t decode(const std::string& ticker, const void* data, size_t size, std::vector<Tick>& out);
+	size_t decode(const std::string& ticker, const void* data, size_t size, TickBatch& out);
+	void reset();
+
+private:
+	struct State
+	{
+		State() : time(0), price(0) {}
+		int64_t time;
+		int64_t price;
+	};
+
+	template<typename Consumer>
+	size_t decodeRecords(const std::string& ticker, const void* data, size_t size, Consumer consume);
+
+	std::unordered_map<std::string, State> m_state;
+};
+
+} /* namespace goldmine */
+
+#endif /* QUOTESOURCE_TICKCODEC_H_ */
@@ -0,0 +1,115 @@
+
+#include "goldmine/data.h"
+#include "goldmine/conversion.h"
+
+#include <boost/chrono.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+using namespace goldmine;
+
+template<typename F>
+static double measure(const char* name, size_t count, int rounds, F f)
+{
+	auto start = boost::chrono::steady_clock::now();
+	for(int i = 0; i < rounds; i++)
+		f();
+	auto elapsed = boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::steady_clock::now() - start).count();
+	double perValue = (double)elapsed / (count * rounds);
+	std::cout << name << ": " << perValue << " ns/value" << '\n';
+	return perValue;
+}
+
+// Measures the batch conversion with every kernel this CPU supports
+template<typename F>
+static void measureKernels(const char* name, size_t count, int rounds, double scalar, F f)
+{
+	for(const auto& kernel : supportedConversionKernels())
+	{
+		selectConversionKernel(kernel);
+		double batch = measure((std::string(name) + ", " + kernel).c_str(), count, rounds, f);
+		std::cout << "speedup: " << scalar / batch << '\n';
+	}
+	selectConversionKernel(supportedConversionKernels().front());
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = argc > 1 ? atol(argv[1]) : 1000000;
+	int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+	boost::random::mt19937 gen;
+	boost::random::uniform_real_distribution<> dist(-100000., 100000.);
+
+	std::vector<double> doubles(count);
+	std::vector<decimal_fixed> decimals(count);
+	std::vector<int64_t> scaled(count);
+	for(size_t i = 0; i < count; i++)
+		decimals[i] = decimal_fixed(dist(gen));
+
+	std::cout << "Default kernel: " << conversionKernelName() << ", " << count << " values x " << rounds << " rounds" << '\n';
+
+	double scalar = measure("decimal_fixed -> double, scalar", count, rounds, [&]()
+			{
+				for(size_t i = 0; i < count; i++)
+					doubles[i] = decimals[i].toDouble();
+			});
+	measureKernels("decimal_fixed -> double, batch", count, rounds, scalar, [&]()
+			{
+				decimalsToDoubles(decimals.data(), doubles.data(), count);
+			});
+
+	scalar = measure("double -> decimal_fixed, scalar", count, rounds, [&]()
+			{
+				for(size_t i = 0; i < count; i++)
+					decimals[i] = decimal_fixed(doubles[i]);
+			});
+	measureKernels("double -> decimal_fixed, batch", count, rounds, scalar, [&]()
+			{
+				doublesToDecimals(doubles.data(), decimals.data(), count);
+			});
+
+	scalar = measure("decimal_fixed -> scaled, scalar", count, rounds, [&]()
+			{
+				for(size_t i = 0; i < count; i++)
+					scaled[i] = decimals[i].toScaled();
+			});
+	measureKernels("decimal_fixed -> scaled, batch", count, rounds, scalar, [&]()
+			{
+				decimalsToScaled(decimals.data(), scaled.data(), count);
+			});
+
+	scalar = measure("scaled -> decimal_fixed, scalar", count, rounds, [&]()
+			{
+				for(size_t i = 0; i < count; i++)
+					decimals[i] = decimal_fixed::fromScaled(scaled[i]);
+			});
+	measureKernels("scaled -> decimal_fixed, batch", count, rounds, scalar, [&]()
+			{
+				scaledToDecimals(scaled.data(), decimals.data(), count);
+			});
+
+	std::vector<int64_t> values(count);
+	std::vector<int32_t> fractionals(count);
+	for(size_t i = 0; i < count; i++)
+	{
+		values[i] = decimals[i].value;
+		fractionals[i] = decimals[i].fractional;
+	}
+	scalar = measure("price columns -> double, scalar", count, rounds, [&]()
+			{
+				for(size_t i = 0; i < count; i++)
+					doubles[i] = decimal_fixed(values[i], fractionals[i]).toDouble();
+			});
+	measureKernels("price columns -> double, batch", count, rounds, scalar, [&]()
+			{
+				priceColumnsToDoubles(values.data(), fractionals.data(), doubles.data(), count);
+			});
+
+	return 0;
+}
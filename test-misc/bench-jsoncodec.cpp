@@ -0,0 +1,169 @@
+
+#include "broker/jsoncodec.h"
+
+#include "json/json.h"
+
+#include <boost/chrono.hpp>
+
+#include <iostream>
+#include <cstdlib>
+
+using namespace goldmine;
+
+/*
+ * Streaming JSON codec against jsoncpp on the broker messages. jsoncpp versions follow
+ * the code the codec replaced in BrokerServer and BrokerClient.
+ */
+
+template<typename F>
+static double measure(const char* name, int count, F f)
+{
+	auto start = boost::chrono::steady_clock::now();
+	for(int i = 0; i < count; i++)
+		f(i);
+	auto elapsed = boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::steady_clock::now() - start).count();
+	double perMessage = (double)elapsed / count;
+	std::cout << name << ": " << perMessage << " ns/message" << '\n';
+	return perMessage;
+}
+
+static Trade makeTrade()
+{
+	Trade trade;
+	trade.orderId = 1;
+	trade.price = 19.73;
+	trade.quantity = 2;
+	trade.volume = 123.45;
+	trade.volumeCurrency = "RUB";
+	trade.operation = Order::Operation::Buy;
+	trade.account = "NL0080000043#467";
+	trade.security = "SPBFUT#RIU6";
+	trade.timestamp = 1467331210;
+	trade.useconds = 345000;
+	trade.signalId = SignalId("test_strategy", "my_signal", "Yo dawg");
+	return trade;
+}
+
+static std::string jsoncppTrade(const Trade& trade)
+{
+	Json::Value tradeJson;
+	tradeJson["order-id"] = trade.orderId;
+	tradeJson["price"] = trade.price;
+	tradeJson["quantity"] = trade.quantity;
+	tradeJson["operation"] = trade.operation == Order::Operation::Buy ? "buy" : "sell";
+	tradeJson["volume"] = trade.volume;
+	tradeJson["volume-currency"] = trade.volumeCurrency;
+	tradeJson["account"] = trade.account;
+	tradeJson["security"] = trade.security;
+	tradeJson["execution-time"] = "2016-07-01 00:00:10.345";
+	tradeJson["strategy"] = trade.signalId.strategyId;
+	tradeJson["signal-id"] = trade.signalId.signalId;
+	tradeJson["order-comment"] = trade.signalId.comment;
+	Json::Value root;
+	root["trade"] = tradeJson;
+
+	Json::FastWriter writer;
+	return writer.write(root);
+}
+
+int main(int argc, char** argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 1000000;
+
+	auto trade = makeTrade();
+	Order order(1, "NL0080000043#467", "SPBFUT#RIH6", 19.73, 2, Order::Operation::Buy, Order::OrderType::Limit);
+	order.setSignalId(SignalId("strategy #1", "signal #2", "Yo dawg"));
+
+	JsonWriter writer;
+	writeOrder(writer, order);
+	const std::string orderJson = writer.str();
+	writeTrade(writer, trade);
+	const std::string tradeJson = writer.str();
+
+	size_t sink = 0;
+
+	double jsoncpp = measure("trade serialization, jsoncpp", count, [&](int i)
+			{
+				trade.orderId = i;
+				sink += jsoncppTrade(trade).size();
+			});
+	double codec = measure("trade serialization, codec", count, [&](int i)
+			{
+				trade.orderId = i;
+				writeTrade(writer, trade);
+				sink += writer.str().size();
+			});
+	std::cout << "speedup: " << jsoncpp / codec << '\n';
+
+	jsoncpp = measure("order state serialization, jsoncpp", count, [&](int i)
+			{
+				Json::Value orderState;
+				orderState["id"] = i;
+				orderState["new-state"] = "submitted";
+				Json::Value root;
+				root["order"] = orderState;
+				Json::FastWriter fastWriter;
+				sink += fastWriter.write(root).size();
+			});
+	codec = measure("order state serialization, codec", count, [&](int i)
+			{
+				writeOrderState(writer, i, Order::State::Submitted);
+				sink += writer.str().size();
+			});
+	std::cout << "speedup: " << jsoncpp / codec << '\n';
+
+	jsoncpp = measure("order deserialization, jsoncpp", count, [&](int)
+			{
+				Json::Value root;
+				Json::Reader reader;
+				reader.parse(orderJson, root);
+				auto json = root["order"];
+				auto decoded = std::make_shared<Order>(json["id"].asInt(), json["account"].asString(), json["security"].asString(),
+						json["price"].asDouble(), json["quantity"].asInt(),
+						json["operation"].asString() == "buy" ? Order::Operation::Buy : Order::Operation::Sell,
+						json["type"].asString() == "limit" ? Order::OrderType::Limit : Order::OrderType::Market);
+				decoded->setSignalId(SignalId(json["strategy"].asString(), json["signal-id"].asString(), json["comment"].asString()));
+				sink += decoded->quantity();
+			});
+	codec = measure("order deserialization, codec", count, [&](int)
+			{
+				JsonReader reader(orderJson);
+				reader.next();
+				reader.next();
+				sink += readOrder(reader)->quantity();
+			});
+	std::cout << "speedup: " << jsoncpp / codec << '\n';
+
+	Trade decoded;
+	jsoncpp = measure("trade deserialization, jsoncpp", count, [&](int)
+			{
+				Json::Value root;
+				Json::Reader reader;
+				reader.parse(tradeJson, root);
+				auto json = root["trade"];
+				decoded.orderId = json["order-id"].asInt();
+				decoded.price = json["price"].asDouble();
+				decoded.quantity = json["quantity"].asInt();
+				decoded.signalId.strategyId = json["strategy"].asString();
+				decoded.signalId.signalId = json["signal-id"].asString();
+				decoded.signalId.comment = json["order-comment"].asString();
+				decoded.operation = json["operation"].asString() == "buy" ? Order::Operation::Buy : Order::Operation::Sell;
+				decoded.account = json["account"].asString();
+				decoded.security = json["security"].asString();
+				int year, month, day, hour, minute, second, msec;
+				sscanf(json["execution-time"].asString().c_str(), "%d-%d-%d %d:%d:%d.%d",
+						&year, &month, &day, &hour, &minute, &second, &msec);
+				sink += decoded.quantity + second;
+			});
+	codec = measure("trade deserialization, codec", count, [&](int)
+			{
+				JsonReader reader(tradeJson);
+				reader.next();
+				reader.next();
+				readTrade(reader, decoded);
+				sink += decoded.quantity;
+			});
+	std::cout << "speedup: " << jsoncpp / codec << '\n';
+
+	return sink == 0;
+}
@@ -0,0 +1,140 @@
+
+#include "quotesource/quotesource.h"
+#include "quotesource/quotesourceclient.h"
+#include "goldmine/busypoll.h"
+
+#include "cppio/iolinemanager.h"
+
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+
+using namespace goldmine;
+
+/*
+ * Tick-to-sink latency of QuoteSourceClient in blocking and busy-poll receive modes.
+ * Send time is carried in the tick price as nanoseconds of the steady clock.
+ */
+
+static int64_t nowNanoseconds()
+{
+	return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+			boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class LatencySink : public QuoteSourceClient::Sink
+{
+public:
+	LatencySink(size_t expected) : received(0)
+	{
+		latencies.reserve(expected);
+	}
+
+	void incomingTick(const std::string& ticker, const Tick& tick) override
+	{
+		latencies.push_back(nowNanoseconds() - tick.value.toScaled());
+		received++;
+	}
+
+	std::vector<int64_t> latencies;
+	std::atomic<size_t> received;
+};
+
+static void printHistogram(const char* name, std::vector<int64_t> latencies)
+{
+	if(latencies.empty())
+	{
+		std::cout << name << ": no ticks received" << '\n';
+		return;
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double p)
+	{
+		return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))] / 1000.;
+	};
+
+	std::cout << name << ", " << latencies.size() << " ticks, us: p50 " << percentile(0.5) <<
+		" p90 " << percentile(0.9) << " p99 " << percentile(0.99) << " p99.9 " << percentile(0.999) <<
+		" max " << latencies.back() / 1000. << '\n';
+
+	// Power of two buckets, in microseconds
+	std::vector<size_t> buckets;
+	for(auto latency : latencies)
+	{
+		size_t bucket = 0;
+		while((latency >> bucket) >= 1000)
+			bucket++;
+		if(bucket >= buckets.size())
+			buckets.resize(bucket + 1);
+		buckets[bucket]++;
+	}
+	for(size_t i = 0; i < buckets.size(); i++)
+	{
+		if(buckets[i] == 0)
+			continue;
+		double share = 100. * buckets[i] / latencies.size();
+		std::cout << "  < " << std::setw(6) << (1 << i) << " us: " << std::setw(8) << buckets[i] << ' ' <<
+			std::string((size_t)(share / 2), '#') << '\n';
+	}
+}
+
+static void run(const std::shared_ptr<cppio::IoLineManager>& manager, const std::string& endpoint, bool busyPoll,
+		size_t count, int intervalUs)
+{
+	BusyPollPolicy policy;
+	policy.enabled = busyPoll;
+
+	QuoteSource source(manager, endpoint);
+	source.setBusyPoll(policy);
+	source.start();
+
+	QuoteSourceClient client(manager, endpoint);
+	client.setBusyPoll(policy);
+	auto sink = std::make_shared<LatencySink>(count);
+	client.registerSink(sink);
+	client.startStream("t:BENCH");
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(200));
+
+	Tick tick;
+	tick.timestamp = 0;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.volume = 1;
+	for(size_t i = 0; i < count; i++)
+	{
+		tick.value = decimal_fixed::fromScaled(nowNanoseconds());
+		source.incomingTick("BENCH", tick);
+		boost::this_thread::sleep_for(boost::chrono::microseconds(intervalUs));
+	}
+
+	auto started = boost::chrono::steady_clock::now();
+	while((sink->received < count) && (boost::chrono::steady_clock::now() - started < boost::chrono::seconds(2)))
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+
+	client.stop();
+	source.stop();
+
+	printHistogram(busyPoll ? "busy-poll" : "blocking", sink->latencies);
+}
+
+int main(int argc, char** argv)
+{
+	std::string endpoint = argc > 1 ? argv[1] : "inproc://bench-latency";
+	size_t count = argc > 2 ? atol(argv[2]) : 20000;
+	int intervalUs = argc > 3 ? atoi(argv[3]) : 50;
+
+	auto manager = std::shared_ptr<cppio::IoLineManager>(cppio::createLineManager());
+
+	run(manager, endpoint, false, count, intervalUs);
+	run(manager, endpoint, true, count, intervalUs);
+
+	return 0;
+}
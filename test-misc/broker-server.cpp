@@ -233,6 +233,8 @@ int main(int argc, char** argv)
 
 	auto broker = std::make_shared<TestBroker>();
 	server.registerBroker(broker);
+	// Accounts of the test broker are created on first order
+	server.setDefaultBroker(broker);
 	server.start();
 
 	while(true)
@@ -0,0 +1,165 @@
+
+#include "catch.hpp"
+
+#include "broker/binaryprotocol.h"
+#include "goldmine/exceptions.h"
+
+using namespace goldmine;
+
+// Feeds symbol definitions to the decoder and returns the first message of other kind
+static const cppio::Message& decodeSymbols(BinaryDecoder& decoder, const std::vector<cppio::Message>& messages)
+{
+	for(const auto& msg : messages)
+	{
+		REQUIRE(msg.get<uint32_t>(0) == (uint32_t)MessageType::Binary);
+		if(BinaryDecoder::messageId(msg) != BinaryMessageId::DefineSymbol)
+			return msg;
+		decoder.defineSymbol(msg);
+	}
+	FAIL("No message besides symbol definitions");
+	return messages.front();
+}
+
+TEST_CASE("BinaryProtocol", "[broker]")
+{
+	BinaryEncoder encoder;
+	BinaryDecoder decoder;
+	std::vector<cppio::Message> messages;
+
+	SECTION("New order")
+	{
+		Order order(1, "TEST_ACCOUNT", "FOOBAR", 19.74, 2, Order::Operation::Sell, Order::OrderType::Limit);
+		order.setSignalId(SignalId("FOO_STRATEGY", "FOO_SIGNAL", "BLAHBLAH"));
+		encoder.newOrder(order, messages);
+
+		// account, security and strategy are defined first
+		REQUIRE(messages.size() == 4);
+
+		auto decoded = decoder.newOrder(decodeSymbols(decoder, messages));
+		REQUIRE(decoded->clientAssignedId() == 1);
+		REQUIRE(decoded->account() == "TEST_ACCOUNT");
+		REQUIRE(decoded->security() == "FOOBAR");
+		REQUIRE(decoded->price() == Approx(19.74));
+		REQUIRE(decoded->quantity() == 2);
+		REQUIRE(decoded->operation() == Order::Operation::Sell);
+		REQUIRE(decoded->type() == Order::OrderType::Limit);
+		REQUIRE(decoded->signalId().strategyId == "FOO_STRATEGY");
+		REQUIRE(decoded->signalId().signalId == "FOO_SIGNAL");
+		REQUIRE(decoded->signalId().comment == "BLAHBLAH");
+
+		SECTION("Symbols are defined once")
+		{
+			Order other(2, "TEST_ACCOUNT", "FOOBAR", 0, 1, Order::Operation::Buy, Order::OrderType::Market);
+			messages.clear();
+			encoder.newOrder(other, messages);
+
+			REQUIRE(messages.size() == 1);
+			decoded = decoder.newOrder(messages.front());
+			REQUIRE(decoded->clientAssignedId() == 2);
+			REQUIRE(decoded->account() == "TEST_ACCOUNT");
+			REQUIRE(decoded->type() == Order::OrderType::Market);
+			REQUIRE(decoded->signalId().strategyId.empty());
+			REQUIRE(decoded->signalId().signalId.empty());
+		}
+
+		SECTION("Cancellation")
+		{
+			messages.clear();
+			encoder.cancelOrder(order, messages);
+
+			REQUIRE(messages.size() == 1);
+			REQUIRE(BinaryDecoder::messageId(messages.front()) == BinaryMessageId::CancelOrder);
+			REQUIRE(decoder.cancelOrder(messages.front()) == 1);
+		}
+
+		SECTION("Unknown symbol after reset")
+		{
+			decoder.reset();
+			messages.clear();
+			encoder.newOrder(order, messages);
+
+			REQUIRE_THROWS_AS(decoder.newOrder(messages.front()), const ProtocolError&);
+		}
+	}
+
+	SECTION("Trade")
+	{
+		Trade trade;
+		trade.orderId = 1;
+		trade.price = 19.73;
+		trade.quantity = 2;
+		trade.volume = 123.45;
+		trade.volumeCurrency = "RUB";
+		trade.operation = Order::Operation::Buy;
+		trade.account = "TEST_ACCOUNT";
+		trade.security = "FOOBAR";
+		trade.timestamp = 10;
+		trade.useconds = 9000;
+		trade.signalId = SignalId("FOO_STRATEGY", "FOO_SIGNAL", "BLAHBLAH");
+		encoder.trade(trade, messages);
+
+		auto decoded = decoder.trade(decodeSymbols(decoder, messages));
+		REQUIRE(decoded.orderId == 1);
+		REQUIRE(decoded.price == Approx(19.73));
+		REQUIRE(decoded.quantity == 2);
+		REQUIRE(decoded.volume == Approx(123.45));
+		REQUIRE(decoded.volumeCurrency == "RUB");
+		REQUIRE(decoded.operation == Order::Operation::Buy);
+		REQUIRE(decoded.account == "TEST_ACCOUNT");
+		REQUIRE(decoded.security == "FOOBAR");
+		REQUIRE(decoded.timestamp == 10);
+		REQUIRE(decoded.useconds == 9000);
+		REQUIRE(decoded.signalId.strategyId == "FOO_STRATEGY");
+		REQUIRE(decoded.signalId.signalId == "FOO_SIGNAL");
+		REQUIRE(decoded.signalId.comment == "BLAHBLAH");
+	}
+
+	SECTION("Result and order state")
+	{
+		encoder.result(false, "Order with given id already exists: 1", messages);
+		encoder.orderState(1, Order::State::PartiallyExecuted, messages);
+		REQUIRE(messages.size() == 2);
+
+		std::string reason;
+		REQUIRE(!decoder.result(messages[0], reason));
+		REQUIRE(reason == "Order with given id already exists: 1");
+
+		int id;
+		Order::State state;
+		decoder.orderState(messages[1], id, state);
+		REQUIRE(id == 1);
+		REQUIRE(state == Order::State::PartiallyExecuted);
+	}
+
+	SECTION("Malformed messages")
+	{
+		cppio::Message empty;
+		empty << (uint32_t)MessageType::Binary;
+		REQUIRE_THROWS_AS(BinaryDecoder::messageId(empty), const ProtocolError&);
+
+		cppio::Message truncated;
+		truncated << (uint32_t)MessageType::Binary;
+		truncated << (uint32_t)BinaryMessageId::OrderState;
+		int id;
+		Order::State state;
+		REQUIRE_THROWS_AS(decoder.orderState(truncated, id, state), const ProtocolError&);
+
+		BinaryOrderState packet;
+		packet.messageId = (uint32_t)BinaryMessageId::OrderState;
+		packet.id = 1;
+		packet.state = 100;
+		cppio::Message invalidState;
+		invalidState << (uint32_t)MessageType::Binary;
+		invalidState << packet;
+		REQUIRE_THROWS_AS(decoder.orderState(invalidState, id, state), const ProtocolError&);
+
+		BinaryDefineSymbol definition;
+		definition.messageId = (uint32_t)BinaryMessageId::DefineSymbol;
+		definition.symbol = 2;
+		cppio::Message outOfOrder;
+		outOfOrder << (uint32_t)MessageType::Binary;
+		outOfOrder << definition;
+		outOfOrder << std::string("FOOBAR");
+		REQUIRE_THROWS_AS(decoder.defineSymbol(outOfOrder), const ProtocolError&);
+	}
+}
@@ -2,6 +2,7 @@
 #include "catch.hpp"
 
 #include "broker/brokerclient.h"
+#include "broker/binaryprotocol.h"
 
 #include "json/json.h"
 #include "cppio/message.h"
@@ -223,6 +224,69 @@ TEST_CASE("BrokerClient", "[broker]")
 		}
 	}
 
+	SECTION("Binary encoding is used if the server supports it")
+	{
+		Json::Value root;
+		receiveControlMessage(root, proto);
+
+		REQUIRE(root["command"] == "get-identity");
+		REQUIRE(root["encodings"][0] == "binary");
+
+		root.clear();
+		root["identity"] = "foo";
+		root["encoding"] = "binary";
+		sendControlMessage(root, proto);
+
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+
+		auto order = std::make_shared<Order>(1, "TEST_ACCOUNT", "FOOBAR", 19.74, 2, Order::Operation::Buy, Order::OrderType::Limit);
+		client->submitOrder(order);
+
+		BinaryDecoder decoder;
+		Order::Ptr decoded;
+		while(!decoded)
+		{
+			Message msg;
+			REQUIRE(proto.readMessage(msg) > 0);
+			REQUIRE(msg.get<uint32_t>(0) == (int)MessageType::Binary);
+			if(BinaryDecoder::messageId(msg) == BinaryMessageId::DefineSymbol)
+				decoder.defineSymbol(msg);
+			else
+				decoded = decoder.newOrder(msg);
+		}
+		REQUIRE(decoded->clientAssignedId() == 1);
+		REQUIRE(decoded->account() == "TEST_ACCOUNT");
+		REQUIRE(decoded->security() == "FOOBAR");
+
+		BinaryEncoder encoder;
+		std::vector<Message> messages;
+		encoder.orderState(1, Order::State::Submitted, messages);
+		{
+			Trade trade;
+			trade.orderId = 1;
+			trade.price = 19.74;
+			trade.quantity = 2;
+			trade.operation = Order::Operation::Buy;
+			trade.account = "TEST_ACCOUNT";
+			trade.security = "FOOBAR";
+			trade.timestamp = 10;
+			trade.useconds = 9000;
+			encoder.trade(trade, messages);
+		}
+		for(const auto& msg : messages)
+			proto.sendMessage(msg);
+
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+
+		REQUIRE(reactor->orders.front()->state() == Order::State::Submitted);
+		auto trade = reactor->trades.front();
+		REQUIRE(trade.orderId == 1);
+		REQUIRE(trade.account == "TEST_ACCOUNT");
+		REQUIRE(trade.security == "FOOBAR");
+		REQUIRE(trade.timestamp == 10);
+		REQUIRE(trade.useconds == 9000);
+	}
+
 	client->stop();
 }
 
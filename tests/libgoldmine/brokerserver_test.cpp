@@ -2,12 +2,16 @@
 #include "catch.hpp"
 
 #include "broker/brokerserver.h"
+#include "broker/binaryprotocol.h"
+#include "goldmine/exceptions.h"
 
 #include "json/json.h"
 #include "cppio/message.h"
 #include "cppio/ioline.h"
 #include "cppio/iolinemanager.h"
 
+#include <boost/thread.hpp>
+
 using namespace goldmine;
 using namespace cppio;
 
@@ -37,12 +41,12 @@ public:
 		auto it = std::find_if(submittedOrders.begin(), submittedOrders.end(), [&](const Order::Ptr& other) { return order->localId() == other->localId(); });
 		if(it != submittedOrders.end())
 		{
+			submittedOrders.erase(it);
 			order->updateState(Order::State::Cancelled);
 			for(const auto& reactor : reactors)
 			{
 				reactor->orderCallback(order);
 			}
-			submittedOrders.erase(it);
 		}
 	}
 
@@ -85,11 +89,73 @@ public:
 		}
 	}
 
+	void provokeOrderCallback(const Order::Ptr& order, Order::State state)
+	{
+		order->updateState(state);
+		for(const auto& reactor : reactors)
+		{
+			reactor->orderCallback(order);
+		}
+	}
+
 	std::vector<Order::Ptr> submittedOrders;
 	std::vector<std::shared_ptr<Reactor>> reactors;
 	std::string account;
 };
 
+// Holds order submission until opened, so that requests pile up in the dispatch queue
+class GatedBroker : public TestBroker
+{
+public:
+	GatedBroker(const std::string& acct) : TestBroker(acct),
+		open(false),
+		entered(false)
+	{
+	}
+
+	void submitOrder(const Order::Ptr& order)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			calls.push_back("submit " + std::to_string(order->clientAssignedId()));
+			entered = true;
+			cv.notify_all();
+			while(!open)
+				cv.wait(lock);
+		}
+		TestBroker::submitOrder(order);
+	}
+
+	void cancelOrder(const Order::Ptr& order)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			calls.push_back("cancel " + std::to_string(order->clientAssignedId()));
+		}
+		TestBroker::cancelOrder(order);
+	}
+
+	void waitEntered()
+	{
+		boost::unique_lock<boost::mutex> lock(mutex);
+		while(!entered)
+			cv.wait(lock);
+	}
+
+	void setOpen()
+	{
+		boost::unique_lock<boost::mutex> lock(mutex);
+		open = true;
+		cv.notify_all();
+	}
+
+	boost::mutex mutex;
+	boost::condition_variable cv;
+	bool open;
+	bool entered;
+	std::vector<std::string> calls;
+};
+
 static void sendControlMessage(const Json::Value& root, MessageProtocol& line)
 {
 	Json::FastWriter writer;
@@ -131,6 +197,21 @@ static void doIdentityRequest(MessageProtocol& client)
 	receiveControlMessage(response, client);
 }
 
+// Symbol definitions are fed to the decoder, the first message of other kind is returned
+static Message receiveBinaryMessage(BinaryDecoder& decoder, MessageProtocol& line)
+{
+	while(true)
+	{
+		Message recvd;
+		REQUIRE(line.readMessage(recvd) > 0);
+		REQUIRE(recvd.get<uint32_t>(0) == (int)goldmine::MessageType::Binary);
+
+		if(BinaryDecoder::messageId(recvd) != BinaryMessageId::DefineSymbol)
+			return recvd;
+		decoder.defineSymbol(recvd);
+	}
+}
+
 TEST_CASE("BrokerServer", "[broker]")
 {
 	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
@@ -140,7 +221,7 @@ TEST_CASE("BrokerServer", "[broker]")
 	auto broker = std::make_shared<TestBroker>("TEST_ACCOUNT");
 	server->registerBroker(broker);
 
-	server->setTradeSink("inproc://stats");
+	server->setTradeSink("inproc://stats", boost::chrono::milliseconds(100));
 	server->start();
 
 	auto clientLine = std::unique_ptr<IoLine>(manager->createClient("inproc://brokerserver"));
@@ -400,6 +481,16 @@ TEST_CASE("BrokerServer", "[broker]")
 			receiveControlMessage(response, client);
 
 			REQUIRE(response["order"]["new-state"] == "cancelled");
+
+			SECTION("Cancelled order is retired")
+			{
+				sendControlMessage(root, client);
+
+				response.clear();
+				receiveControlMessage(response, client);
+
+				REQUIRE(response["result"] == "error");
+			}
 		}
 
 		SECTION("Not existing order")
@@ -492,6 +583,28 @@ TEST_CASE("BrokerServer", "[broker]")
 			receiveControlMessage(response, client);
 
 			REQUIRE(response["order"]["new-state"] == "executed");
+
+			SECTION("Id of executed order can not be reused")
+			{
+				sendControlMessage(root, client);
+
+				response.clear();
+				receiveControlMessage(response, client);
+
+				REQUIRE(response["result"] == "error");
+			}
+
+			SECTION("Executed order can not be cancelled")
+			{
+				Json::Value cancel;
+				cancel["cancel-order"]["id"] = 1;
+				sendControlMessage(cancel, client);
+
+				response.clear();
+				receiveControlMessage(response, client);
+
+				REQUIRE(response["result"] == "error");
+			}
 		}
 
 		SECTION("Partial execution")
@@ -522,6 +635,70 @@ TEST_CASE("BrokerServer", "[broker]")
 			REQUIRE(response["order"]["new-state"] == "partially-executed");
 		}
 
+		SECTION("Executed state before trade")
+		{
+			auto submitted = broker->submittedOrders.front();
+			broker->provokeOrderCallback(submitted, Order::State::Executed);
+
+			response.clear();
+			receiveControlMessage(response, client);
+			REQUIRE(response["order"]["new-state"] == "executed");
+
+			{
+				Trade trade;
+				trade.orderId = submitted->localId();
+				trade.price = 19.73;
+				trade.quantity = 2;
+				trade.operation = Order::Operation::Buy;
+				trade.account = "TEST_ACCOUNT";
+				trade.security = "FOOBAR";
+				trade.timestamp = 0;
+				trade.useconds = 0;
+				broker->provokeTradeCallback(trade);
+			}
+
+			response.clear();
+			receiveControlMessage(response, client);
+			REQUIRE(response["trade"]["order-id"] == 1);
+			REQUIRE(response["trade"]["quantity"] == 2);
+		}
+
+		SECTION("Trade after Cancelled")
+		{
+			int localId = broker->submittedOrders.front()->localId();
+
+			Json::Value cancel;
+			cancel["cancel-order"]["id"] = 1;
+			cancel["cancel-order"]["account"] = "TEST_ACCOUNT";
+			sendControlMessage(cancel, client);
+
+			response.clear();
+			receiveControlMessage(response, client);
+			REQUIRE(response["result"] == "success");
+
+			response.clear();
+			receiveControlMessage(response, client);
+			REQUIRE(response["order"]["new-state"] == "cancelled");
+
+			{
+				Trade trade;
+				trade.orderId = localId;
+				trade.price = 19.73;
+				trade.quantity = 1;
+				trade.operation = Order::Operation::Buy;
+				trade.account = "TEST_ACCOUNT";
+				trade.security = "FOOBAR";
+				trade.timestamp = 0;
+				trade.useconds = 0;
+				broker->provokeTradeCallback(trade);
+			}
+
+			response.clear();
+			receiveControlMessage(response, client);
+			REQUIRE(response["trade"]["order-id"] == 1);
+			REQUIRE(response["trade"]["quantity"] == 1);
+		}
+
 		SECTION("Overexecution")
 		{
 			{
@@ -549,12 +726,563 @@ TEST_CASE("BrokerServer", "[broker]")
 
 			REQUIRE(response["order"]["new-state"] == "error");
 		}
+
+		SECTION("Trades are routed to the owning client")
+		{
+			auto otherLine = std::unique_ptr<IoLine>(manager->createClient("inproc://brokerserver"));
+			otherLine->setOption(LineOption::ReceiveTimeout, &timeout);
+			MessageProtocol otherClient(otherLine.get());
+			doIdentityRequest(otherClient);
+
+			// Same client-assigned id as the order of the first client
+			order["quantity"] = 5;
+			root["order"] = order;
+			sendControlMessage(root, otherClient);
+
+			response.clear();
+			receiveControlMessage(response, otherClient);
+			REQUIRE(response["result"] == "success");
+
+			response.clear();
+			receiveControlMessage(response, otherClient);
+			REQUIRE(response["order"]["new-state"] == "submitted");
+
+			{
+				Trade trade;
+				trade.orderId = broker->submittedOrders.back()->localId();
+				trade.price = 19.73;
+				trade.quantity = 5;
+				trade.operation = Order::Operation::Buy;
+				trade.account = "TEST_ACCOUNT";
+				trade.security = "FOOBAR";
+				broker->provokeTradeCallback(trade);
+			}
+
+			response.clear();
+			receiveControlMessage(response, otherClient);
+			REQUIRE(response["trade"]["order-id"] == 1);
+			REQUIRE(response["trade"]["quantity"] == 5);
+
+			response.clear();
+			receiveControlMessage(response, otherClient);
+			REQUIRE(response["order"]["new-state"] == "executed");
+
+			Message nothing;
+			REQUIRE(client.readMessage(nothing) == eTimeout);
+		}
+	}
+
+	SECTION("Binary encoding")
+	{
+		Json::Value command;
+		command["command"] = "get-identity";
+		command["encodings"].append("binary");
+		sendControlMessage(command, client);
+
+		Json::Value response;
+		receiveControlMessage(response, client);
+		REQUIRE(!response["identity"].asString().empty());
+		REQUIRE(response["encoding"] == "binary");
+
+		BinaryEncoder encoder;
+		BinaryDecoder decoder;
+		std::vector<Message> messages;
+
+		Order order(1, "TEST_ACCOUNT", "FOOBAR", 19.73, 2, Order::Operation::Buy, Order::OrderType::Limit);
+		order.setSignalId(SignalId("FOO_STRATEGY", "FOO_SIGNAL", "BLAHBLAH"));
+		encoder.newOrder(order, messages);
+		for(const auto& msg : messages)
+			client.sendMessage(msg);
+
+		std::string reason;
+		REQUIRE(decoder.result(receiveBinaryMessage(decoder, client), reason));
+
+		int id;
+		Order::State state;
+		decoder.orderState(receiveBinaryMessage(decoder, client), id, state);
+		REQUIRE(id == 1);
+		REQUIRE(state == Order::State::Submitted);
+
+		REQUIRE(broker->submittedOrders.front()->account() == "TEST_ACCOUNT");
+		REQUIRE(broker->submittedOrders.front()->signalId().comment == "BLAHBLAH");
+
+		SECTION("Trade")
+		{
+			{
+				Trade trade;
+				trade.orderId = broker->submittedOrders.front()->localId();
+				trade.price = 19.73;
+				trade.quantity = 2;
+				trade.volume = 123.45;
+				trade.volumeCurrency = "RUB";
+				trade.operation = Order::Operation::Buy;
+				trade.account = "TEST_ACCOUNT";
+				trade.security = "FOOBAR";
+				trade.timestamp = 0;
+				trade.useconds = 0;
+				broker->provokeTradeCallback(trade);
+			}
+
+			auto trade = decoder.trade(receiveBinaryMessage(decoder, client));
+			REQUIRE(trade.orderId == 1);
+			REQUIRE(trade.quantity == 2);
+			REQUIRE(trade.volumeCurrency == "RUB");
+			REQUIRE(trade.account == "TEST_ACCOUNT");
+			REQUIRE(trade.signalId.strategyId == "FOO_STRATEGY");
+
+			decoder.orderState(receiveBinaryMessage(decoder, client), id, state);
+			REQUIRE(state == Order::State::Executed);
+		}
+
+		SECTION("Cancellation")
+		{
+			messages.clear();
+			encoder.cancelOrder(order, messages);
+			for(const auto& msg : messages)
+				client.sendMessage(msg);
+
+			REQUIRE(decoder.result(receiveBinaryMessage(decoder, client), reason));
+
+			decoder.orderState(receiveBinaryMessage(decoder, client), id, state);
+			REQUIRE(state == Order::State::Cancelled);
+		}
+
+		SECTION("Errors are reported in binary")
+		{
+			messages.clear();
+			encoder.newOrder(order, messages);
+			for(const auto& msg : messages)
+				client.sendMessage(msg);
+
+			REQUIRE(!decoder.result(receiveBinaryMessage(decoder, client), reason));
+			REQUIRE(reason == "Order with given id already exists: 1");
+		}
+	}
+
+	SECTION("Binary message without negotiation")
+	{
+		doIdentityRequest(client);
+
+		BinaryEncoder encoder;
+		std::vector<Message> messages;
+		encoder.newOrder(Order(1, "TEST_ACCOUNT", "FOOBAR", 19.73, 2, Order::Operation::Buy, Order::OrderType::Limit), messages);
+		client.sendMessage(messages.back());
+
+		Json::Value response;
+		receiveControlMessage(response, client);
+		REQUIRE(response["result"] == "error");
+	}
+
+	SECTION("Orders are routed by account")
+	{
+		auto otherBroker = std::make_shared<TestBroker>("OTHER_ACCOUNT");
+		server->registerBroker(otherBroker);
+
+		doIdentityRequest(client);
+
+		auto submit = [&](int id, const std::string& account)
+		{
+			Json::Value order;
+			order["id"] = id;
+			order["account"] = account;
+			order["security"] = "FOOBAR";
+			order["type"] = "market";
+			order["quantity"] = 1;
+			order["operation"] = "buy";
+			Json::Value root;
+			root["order"] = order;
+			sendControlMessage(root, client);
+
+			Json::Value response;
+			receiveControlMessage(response, client);
+			if(response["result"] != "success")
+				return false;
+
+			receiveControlMessage(response, client);
+			REQUIRE(response["order"]["new-state"] == "submitted");
+			return true;
+		};
+
+		REQUIRE(submit(1, "OTHER_ACCOUNT"));
+		REQUIRE(broker->submittedOrders.empty());
+		REQUIRE(otherBroker->submittedOrders.size() == 1);
+
+		REQUIRE(submit(2, "TEST_ACCOUNT"));
+		REQUIRE(broker->submittedOrders.size() == 1);
+		REQUIRE(otherBroker->submittedOrders.size() == 1);
+
+		SECTION("Unknown account is rejected")
+		{
+			REQUIRE(!submit(3, "UNKNOWN_ACCOUNT"));
+		}
+
+		SECTION("Unknown account goes to the default broker")
+		{
+			server->setDefaultBroker(otherBroker);
+			REQUIRE(submit(3, "UNKNOWN_ACCOUNT"));
+			REQUIRE(otherBroker->submittedOrders.size() == 2);
+		}
+
+		SECTION("Routes are refreshed")
+		{
+			otherBroker->account = "NEW_ACCOUNT";
+			server->refreshRoutes();
+
+			REQUIRE(submit(3, "NEW_ACCOUNT"));
+			REQUIRE(otherBroker->submittedOrders.size() == 2);
+			REQUIRE(!submit(4, "OTHER_ACCOUNT"));
+		}
+
+		SECTION("Cancel goes to the broker of the order")
+		{
+			Json::Value cancel;
+			cancel["cancel-order"]["id"] = 1;
+			sendControlMessage(cancel, client);
+
+			Json::Value response;
+			receiveControlMessage(response, client);
+			REQUIRE(response["result"] == "success");
+
+			receiveControlMessage(response, client);
+			REQUIRE(response["order"]["new-state"] == "cancelled");
+			REQUIRE(otherBroker->submittedOrders.empty());
+			REQUIRE(broker->submittedOrders.size() == 1);
+		}
+	}
+
+	SECTION("Cancels are dispatched ahead of new orders")
+	{
+		auto gatedBroker = std::make_shared<GatedBroker>("GATED_ACCOUNT");
+		server->registerBroker(gatedBroker);
+
+		doIdentityRequest(client);
+
+		auto request = [&](const std::string& command, int id)
+		{
+			Json::Value root;
+			root[command]["id"] = id;
+			root[command]["account"] = "GATED_ACCOUNT";
+			root[command]["security"] = "FOOBAR";
+			root[command]["type"] = "market";
+			root[command]["quantity"] = 1;
+			root[command]["operation"] = "buy";
+			sendControlMessage(root, client);
+
+			Json::Value response;
+			receiveControlMessage(response, client);
+			REQUIRE(response["result"] == "success");
+		};
+
+		request("order", 1);
+		gatedBroker->waitEntered();
+		request("order", 2);
+		request("order", 3);
+
+		// Order that is still queued is cancelled without reaching the broker
+		request("cancel-order", 2);
+		Json::Value response;
+		receiveControlMessage(response, client);
+		REQUIRE(response["order"]["id"] == 2);
+		REQUIRE(response["order"]["new-state"] == "cancelled");
+
+		request("cancel-order", 1);
+
+		// Result of the cancel is sent before it is queued
+		auto stats = server->dispatchStats();
+		for(int i = 0; (i < 100) && (stats[1].pendingCancels == 0); i++)
+		{
+			boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+			stats = server->dispatchStats();
+		}
+		gatedBroker->setOpen();
+
+		REQUIRE(stats.size() == 2);
+		REQUIRE(stats[1].broker == gatedBroker);
+		REQUIRE(stats[1].pendingOrders == 1);
+		REQUIRE(stats[1].pendingCancels == 1);
+		REQUIRE(stats[1].dispatchedOrders == 1);
+		REQUIRE(stats[1].dispatchedCancels == 1);
+
+		// Submission of order 1 may be merged into its cancellation
+		receiveControlMessage(response, client);
+		REQUIRE(response["order"]["id"] == 1);
+		if(response["order"]["new-state"] == "submitted")
+			receiveControlMessage(response, client);
+		REQUIRE(response["order"]["id"] == 1);
+		REQUIRE(response["order"]["new-state"] == "cancelled");
+		receiveControlMessage(response, client);
+		REQUIRE(response["order"]["id"] == 3);
+		REQUIRE(response["order"]["new-state"] == "submitted");
+
+		REQUIRE(gatedBroker->calls == std::vector<std::string>({ "submit 1", "cancel 1", "submit 3" }));
+
+		stats = server->dispatchStats();
+		REQUIRE(stats[1].pendingOrders == 0);
+		REQUIRE(stats[1].pendingCancels == 0);
+		REQUIRE(stats[1].dispatchedOrders == 2);
+		REQUIRE(stats[1].dispatchedCancels == 2);
+		REQUIRE(stats[1].maxLagMicroseconds >= stats[1].lastLagMicroseconds);
+	}
+
+	SECTION("State changes of an order are merged while the client is behind")
+	{
+		doIdentityRequest(client);
+
+		Json::Value root;
+		root["order"]["id"] = 1;
+		root["order"]["account"] = "TEST_ACCOUNT";
+		root["order"]["security"] = "FOOBAR";
+		root["order"]["type"] = "market";
+		root["order"]["quantity"] = 1;
+		root["order"]["operation"] = "buy";
+		sendControlMessage(root, client);
+
+		Json::Value response;
+		receiveControlMessage(response, client);
+		REQUIRE(response["result"] == "success");
+		receiveControlMessage(response, client);
+		REQUIRE(response["order"]["new-state"] == "submitted");
+
+		auto order = broker->submittedOrders.front();
+		const int updates = 10000;
+		for(int i = 0; i < updates; i++)
+		{
+			order->updateState(i % 2 == 0 ? Order::State::PartiallyExecuted : Order::State::Submitted);
+			broker->reactors.front()->orderCallback(order);
+		}
+		order->updateState(Order::State::Cancelled);
+		broker->reactors.front()->orderCallback(order);
+
+		int received = 0;
+		do
+		{
+			receiveControlMessage(response, client);
+			REQUIRE(response["order"]["id"] == 1);
+			received++;
+		} while(response["order"]["new-state"] != "cancelled");
+		// The writer sends a message while the broker thread reports many
+		REQUIRE(received < updates / 4);
+	}
+
+	SECTION("Trades are sent one by one while the client is behind")
+	{
+		doIdentityRequest(client);
+
+		const int trades = 1000;
+		Json::Value root;
+		root["order"]["id"] = 1;
+		root["order"]["account"] = "TEST_ACCOUNT";
+		root["order"]["security"] = "FOOBAR";
+		root["order"]["type"] = "market";
+		root["order"]["quantity"] = trades;
+		root["order"]["operation"] = "buy";
+		sendControlMessage(root, client);
+
+		Json::Value response;
+		receiveControlMessage(response, client);
+		REQUIRE(response["result"] == "success");
+		receiveControlMessage(response, client);
+		REQUIRE(response["order"]["new-state"] == "submitted");
+
+		auto order = broker->submittedOrders.front();
+		for(int i = 0; i < trades; i++)
+		{
+			Trade trade;
+			trade.orderId = order->localId();
+			trade.price = 19.73 + i;
+			trade.quantity = 1;
+			trade.operation = Order::Operation::Buy;
+			trade.account = "TEST_ACCOUNT";
+			trade.security = "FOOBAR";
+			trade.timestamp = i;
+			trade.useconds = 0;
+			broker->provokeTradeCallback(trade);
+		}
+
+		int received = 0;
+		while(received < trades)
+		{
+			response.clear();
+			receiveControlMessage(response, client);
+			if(response["trade"].isNull())
+			{
+				REQUIRE(response["order"]["id"] == 1);
+				continue;
+			}
+			REQUIRE(response["trade"]["quantity"] == 1);
+			REQUIRE(response["trade"]["price"].asDouble() == Approx(19.73 + received));
+			received++;
+		}
+	}
+
+	SECTION("Default broker should be registered")
+	{
+		REQUIRE_THROWS_AS(server->setDefaultBroker(std::make_shared<TestBroker>("OTHER_ACCOUNT")), const ParameterError&);
+	}
+
+	SECTION("Disconnected clients are removed")
+	{
+		doIdentityRequest(client);
+
+		auto waitClientCount = [&](size_t count)
+		{
+			for(int i = 0; (i < 100) && (server->clientCount() != count); i++)
+				boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+			return server->clientCount();
+		};
+
+		{
+			std::vector<std::unique_ptr<IoLine>> others;
+			for(int i = 0; i < 10; i++)
+			{
+				others.emplace_back(manager->createClient("inproc://brokerserver"));
+				MessageProtocol other(others.back().get());
+				doIdentityRequest(other);
+			}
+			REQUIRE(waitClientCount(11) == 11);
+		}
+
+		REQUIRE(waitClientCount(1) == 1);
+
+		// Remaining client is still served
+		doIdentityRequest(client);
 	}
 
 	SECTION("Trades are forwarded to stats server")
 	{
 		std::unique_ptr<IoLine> statsLine(statsServer->waitConnection(100));
 		REQUIRE(statsLine);
+		int statsTimeout = 2000;
+		statsLine->setOption(LineOption::ReceiveTimeout, &statsTimeout);
+		MessageProtocol stats(statsLine.get());
+
+		auto sendJson = [&](const Json::Value& root)
+		{
+			Json::FastWriter writer;
+			Message msg;
+			msg << writer.write(root);
+			stats.sendMessage(msg);
+		};
+
+		auto receiveJson = [&](Json::Value& root)
+		{
+			Message msg;
+			REQUIRE(stats.readMessage(msg) == 1);
+			Json::Reader reader;
+			REQUIRE(reader.parse(msg.get<std::string>(0), root));
+		};
+
+		const int tradeCount = 100;
+		for(int i = 1; i <= tradeCount; i++)
+		{
+			Trade trade;
+			trade.orderId = i;
+			trade.price = 19.73;
+			trade.quantity = 1;
+			trade.operation = Order::Operation::Buy;
+			trade.account = "TEST_ACCOUNT";
+			trade.security = "FOOBAR";
+			broker->provokeTradeCallback(trade);
+		}
+
+		SECTION("Trades are sent in batches")
+		{
+			std::vector<int> orderIds;
+			std::vector<int> batchIds;
+			while(orderIds.size() < tradeCount)
+			{
+				Json::Value root;
+				receiveJson(root);
+				REQUIRE(root["trade-batch"].isObject());
+				REQUIRE(!root["trade-batch"]["session"].asString().empty());
+				batchIds.push_back(root["trade-batch"]["id"].asInt());
+				for(const auto& trade : root["trade-batch"]["trades"])
+				{
+					orderIds.push_back(trade["order-id"].asInt());
+					REQUIRE(trade["security"] == "FOOBAR");
+				}
+
+				Json::Value ack;
+				ack["ack"] = batchIds.back();
+				sendJson(ack);
+			}
+
+			REQUIRE(batchIds.size() < tradeCount);
+			for(size_t i = 0; i < batchIds.size(); i++)
+				REQUIRE(batchIds[i] == (int)i + 1);
+			for(int i = 0; i < tradeCount; i++)
+				REQUIRE(orderIds[i] == i + 1);
+
+			// Heartbeats come only when there is nothing to send
+			Json::Value root;
+			receiveJson(root);
+			REQUIRE(root["command"] == "heartbeat");
+		}
+
+		SECTION("Unacknowledged batches are sent again after reconnect")
+		{
+			Json::Value root;
+			receiveJson(root);
+			int firstBatch = root["trade-batch"]["id"].asInt();
+			auto session = root["trade-batch"]["session"].asString();
+			statsLine.reset();
+
+			statsLine.reset(statsServer->waitConnection(1000));
+			REQUIRE(statsLine);
+			statsLine->setOption(LineOption::ReceiveTimeout, &statsTimeout);
+			MessageProtocol reconnected(statsLine.get());
+
+			Message msg;
+			REQUIRE(reconnected.readMessage(msg) == 1);
+			Json::Reader reader;
+			REQUIRE(reader.parse(msg.get<std::string>(0), root));
+			REQUIRE(root["trade-batch"]["id"] == firstBatch);
+			REQUIRE(root["trade-batch"]["session"] == session);
+		}
+
+		SECTION("Unacknowledged trades are kept on stop")
+		{
+			Json::Value root;
+			receiveJson(root);
+			server->stop();
+
+			auto trades = server->undeliveredTrades();
+			REQUIRE(trades.size() == tradeCount);
+			for(int i = 0; i < tradeCount; i++)
+				REQUIRE(trades[i].orderId == i + 1);
+		}
+
+		SECTION("Heartbeat does not hold up batches")
+		{
+			std::vector<int> orderIds;
+			while(orderIds.size() < tradeCount)
+			{
+				Json::Value root;
+				receiveJson(root);
+				for(const auto& trade : root["trade-batch"]["trades"])
+					orderIds.push_back(trade["order-id"].asInt());
+				Json::Value ack;
+				ack["ack"] = root["trade-batch"]["id"];
+				sendJson(ack);
+			}
+
+			// Heartbeat is left unanswered while more trades come
+			Json::Value root;
+			receiveJson(root);
+			REQUIRE(root["command"] == "heartbeat");
+
+			Trade trade;
+			trade.orderId = tradeCount + 1;
+			trade.quantity = 1;
+			trade.account = "TEST_ACCOUNT";
+			trade.security = "FOOBAR";
+			broker->provokeTradeCallback(trade);
+
+			auto started = boost::chrono::steady_clock::now();
+			receiveJson(root);
+			REQUIRE(root["trade-batch"]["trades"][0]["order-id"] == tradeCount + 1);
+			REQUIRE(boost::chrono::steady_clock::now() - started < boost::chrono::milliseconds(1000));
+		}
 	}
 
 	server->stop();
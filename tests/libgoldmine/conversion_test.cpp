@@ -0,0 +1,115 @@
+
+#include "catch.hpp"
+
+#include "goldmine/conversion.h"
+#include "goldmine/tickbatch.h"
+#include "goldmine/exceptions.h"
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+using namespace goldmine;
+
+TEST_CASE("Batch conversion", "[conversion]")
+{
+	boost::random::mt19937 gen;
+	boost::random::uniform_real_distribution<> dist(-100000., 100000.);
+
+	// Not a multiple of any vector width, so that loop tails are exercised
+	const size_t count = 1027;
+	std::vector<double> doubles(count);
+	for(size_t i = 0; i < count; i++)
+		doubles[i] = dist(gen);
+	doubles[0] = 0.3;
+	doubles[1] = -0.1;
+	doubles[2] = 0.9999999999;
+	doubles[3] = -0.9999999999;
+	doubles[4] = -0.;
+	// Integer parts beyond 2^51 are out of range of the vector conversions
+	doubles[8] = 4503599627370497.;
+	doubles[13] = -2251799813685249.;
+
+	// Scalar reference
+	std::vector<decimal_fixed> decimals(count);
+	for(size_t i = 0; i < count; i++)
+		decimals[i] = decimal_fixed(doubles[i]);
+	// Values whose scaled representation fits in int64
+	std::vector<decimal_fixed> scalable(decimals);
+	decimals[20] = decimal_fixed((1ll << 52) + 1, 1);
+	decimals[25] = decimal_fixed(-(1ll << 51) - 1, 999999999);
+	decimals[26] = decimal_fixed(-(1ll << 51), 0);
+	decimals[27] = decimal_fixed(INT64_MAX, 500000000);
+
+	std::vector<int64_t> scaled(count);
+	for(size_t i = 0; i < count; i++)
+		scaled[i] = scalable[i].toScaled();
+	// Quotients close to integers, where the estimate in doubles may be off by one
+	scaled[30] = -1;
+	scaled[31] = -1000000000;
+	scaled[32] = -1000000001;
+	scaled[33] = 999999999;
+	scaled[34] = 2251799813685247ll;
+	scaled[35] = -2251799813685248ll;
+	scaled[36] = INT64_MIN;
+	scaled[37] = INT64_MAX;
+
+	auto kernels = supportedConversionKernels();
+	REQUIRE(!kernels.empty());
+	REQUIRE(kernels.back() == "generic");
+	REQUIRE(conversionKernelName() == kernels.front());
+
+	for(const auto& kernel : kernels)
+	{
+		selectConversionKernel(kernel);
+		INFO("Kernel: " << conversionKernelName());
+
+		SECTION("double -> decimal_fixed matches scalar conversion, " + kernel)
+		{
+			std::vector<decimal_fixed> converted(count);
+			doublesToDecimals(doubles.data(), converted.data(), count);
+			for(size_t i = 0; i < count; i++)
+				REQUIRE(converted[i] == decimal_fixed(doubles[i]));
+		}
+
+		SECTION("decimal_fixed -> double matches scalar conversion, " + kernel)
+		{
+			std::vector<double> converted(count);
+			decimalsToDoubles(decimals.data(), converted.data(), count);
+			for(size_t i = 0; i < count; i++)
+				REQUIRE(converted[i] == decimals[i].toDouble());
+		}
+
+		SECTION("decimal_fixed -> scaled matches scalar conversion, " + kernel)
+		{
+			std::vector<int64_t> converted(count);
+			decimalsToScaled(scalable.data(), converted.data(), count);
+			for(size_t i = 0; i < count; i++)
+				REQUIRE(converted[i] == scalable[i].toScaled());
+		}
+
+		SECTION("scaled -> decimal_fixed matches scalar conversion, " + kernel)
+		{
+			std::vector<decimal_fixed> converted(count);
+			scaledToDecimals(scaled.data(), converted.data(), count);
+			for(size_t i = 0; i < count; i++)
+				REQUIRE(converted[i] == decimal_fixed::fromScaled(scaled[i]));
+		}
+
+		SECTION("TickBatch price columns, " + kernel)
+		{
+			std::vector<Tick> ticks(count);
+			for(size_t i = 0; i < count; i++)
+				ticks[i].value = decimals[i];
+			TickBatch batch;
+			batch.append(ticks.data(), ticks.size());
+
+			std::vector<double> converted(count);
+			priceColumnsToDoubles(batch.priceValues.data(), batch.priceFractionals.data(), converted.data(), count);
+			for(size_t i = 0; i < count; i++)
+				REQUIRE(converted[i] == ticks[i].value.toDouble());
+		}
+	}
+	selectConversionKernel(kernels.front());
+
+	REQUIRE_THROWS_AS(selectConversionKernel("unknown"), const ParameterError&);
+}
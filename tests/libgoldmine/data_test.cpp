@@ -0,0 +1,113 @@
+
+#include "catch.hpp"
+
+#include "goldmine/data.h"
+
+#include <cstring>
+
+using namespace goldmine;
+
+static std::string format(const decimal_fixed& d)
+{
+	char buf[32];
+	d.format(buf, sizeof(buf));
+	return std::string(buf);
+}
+
+static decimal_fixed parse(const char* str)
+{
+	decimal_fixed result;
+	REQUIRE(decimal_fixed::parse(str, strlen(str), result));
+	return result;
+}
+
+TEST_CASE("decimal_fixed", "[data]")
+{
+	SECTION("Compile-time arithmetic")
+	{
+		constexpr decimal_fixed a(1, 750000000);
+		constexpr decimal_fixed b(2, 500000000);
+		static_assert((a + b) == decimal_fixed(4, 250000000), "addition");
+		static_assert((a - b) == decimal_fixed(-1, 250000000), "subtraction");
+		static_assert((-a) == decimal_fixed(-2, 250000000), "negation");
+		static_assert((a * 3) == decimal_fixed(5, 250000000), "multiplication");
+		static_assert((a * -2) == decimal_fixed(-4, 500000000), "multiplication by negative quantity");
+		static_assert(decimal_fixed(12, 345000000).roundToTick(decimal_fixed(0, 10000000)) == decimal_fixed(12, 350000000), "rounding");
+		static_assert(decimal_fixed::fromScaled(-1250000000).toScaled() == -1250000000, "scaled round trip");
+		static_assert(decimal_fixed::fromScaled(-1250000000) == decimal_fixed(-2, 750000000), "scaled normalization");
+	}
+
+	SECTION("Compound assignment")
+	{
+		decimal_fixed pnl;
+		pnl += decimal_fixed(0, 100000000) * 10;
+		pnl -= decimal_fixed(0, 300000000);
+		pnl *= 2;
+		REQUIRE(pnl == decimal_fixed(1, 400000000));
+	}
+
+	SECTION("Conversion from double is rounded")
+	{
+		REQUIRE(decimal_fixed(0.3) == decimal_fixed(0, 300000000));
+		REQUIRE(decimal_fixed(19.73) == decimal_fixed(19, 730000000));
+		REQUIRE(decimal_fixed(-1.5) == decimal_fixed(-2, 500000000));
+		REQUIRE(decimal_fixed(-0.1) == decimal_fixed(-1, 900000000));
+		REQUIRE(decimal_fixed(0.9999999999) == decimal_fixed(1, 0));
+	}
+
+	SECTION("Rounding to tick size")
+	{
+		REQUIRE(decimal_fixed(92503, 0).roundToTick(decimal_fixed(10, 0)) == decimal_fixed(92500, 0));
+		REQUIRE(decimal_fixed(92505, 0).roundToTick(decimal_fixed(10, 0)) == decimal_fixed(92510, 0));
+		REQUIRE(decimal_fixed(-2, 990000000).roundToTick(decimal_fixed(0, 250000000)) == decimal_fixed(-1, 0));
+		REQUIRE(decimal_fixed(-1, 990000000).roundToTick(decimal_fixed(0, 250000000)) == decimal_fixed(0, 0));
+	}
+
+	SECTION("Parsing")
+	{
+		REQUIRE(parse("19.73") == decimal_fixed(19, 730000000));
+		REQUIRE(parse("-1.25") == decimal_fixed(-2, 750000000));
+		REQUIRE(parse("+42") == decimal_fixed(42, 0));
+		REQUIRE(parse(".5") == decimal_fixed(0, 500000000));
+		REQUIRE(parse("0.123456789000") == decimal_fixed(0, 123456789));
+
+		decimal_fixed untouched(7, 0);
+		REQUIRE(!decimal_fixed::parse("", 0, untouched));
+		REQUIRE(!decimal_fixed::parse("-", 1, untouched));
+		REQUIRE(!decimal_fixed::parse("1.2.3", 5, untouched));
+		REQUIRE(!decimal_fixed::parse("0.1234567891", 12, untouched));
+		REQUIRE(!decimal_fixed::parse("99999999999999999999", 20, untouched));
+		REQUIRE(untouched == decimal_fixed(7, 0));
+	}
+
+	SECTION("Formatting")
+	{
+		REQUIRE(format(decimal_fixed(19, 730000000)) == "19.73");
+		REQUIRE(format(decimal_fixed(-2, 750000000)) == "-1.25");
+		REQUIRE(format(decimal_fixed(-1, 500000000)) == "-0.5");
+		REQUIRE(format(decimal_fixed(0, 0)) == "0");
+		REQUIRE(format(decimal_fixed(0, 1)) == "0.000000001");
+		REQUIRE(format(decimal_fixed(-42, 0)) == "-42");
+		REQUIRE(format(decimal_fixed(1, -5)) == "0.999999995");
+		REQUIRE(format(decimal_fixed(0, -500000000)) == "-0.5");
+		REQUIRE(format(decimal_fixed(1, 1500000000)) == "2.5");
+		REQUIRE(format(decimal_fixed(INT64_MIN, 0)) == "-9223372036854775808");
+		REQUIRE(format(decimal_fixed(INT64_MIN, 1)) == "-9223372036854775807.999999999");
+		REQUIRE(format(decimal_fixed(INT64_MAX, 999999999)) == "9223372036854775807.999999999");
+
+		char small[4];
+		REQUIRE(decimal_fixed(19, 730000000).format(small, sizeof(small)) == 5);
+	}
+
+	SECTION("Format and parse round trip")
+	{
+		for(const auto& value : { decimal_fixed(123456, 987654321), decimal_fixed(-123456, 1), decimal_fixed(0, 999999999) })
+		{
+			char buf[32];
+			size_t length = value.format(buf, sizeof(buf));
+			decimal_fixed parsed;
+			REQUIRE(decimal_fixed::parse(buf, length, parsed));
+			REQUIRE(parsed == value);
+		}
+	}
+}
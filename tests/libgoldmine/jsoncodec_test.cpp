@@ -0,0 +1,244 @@
+
+#include "catch.hpp"
+
+#include "broker/jsoncodec.h"
+#include "goldmine/exceptions.h"
+
+#include "json/json.h"
+
+using namespace goldmine;
+
+// Positions the reader after the top-level key of the message
+static void enterMessage(JsonReader& reader, const std::string& key)
+{
+	REQUIRE(reader.next() == JsonReader::Token::BeginObject);
+	REQUIRE(reader.next() == JsonReader::Token::Key);
+	REQUIRE(reader.string() == key);
+}
+
+static Trade makeTrade()
+{
+	Trade trade;
+	trade.orderId = 1;
+	trade.price = 19.73;
+	trade.quantity = 2;
+	trade.volume = 123.45;
+	trade.volumeCurrency = "RUB";
+	trade.operation = Order::Operation::Sell;
+	trade.account = "TEST_ACCOUNT";
+	trade.security = "FOOBAR";
+	trade.timestamp = 1467331210;
+	trade.useconds = 9000;
+	trade.signalId = SignalId("FOO_STRATEGY", "FOO_SIGNAL", "BLAH \"BLAH\"\n");
+	return trade;
+}
+
+TEST_CASE("JsonCodec", "[broker]")
+{
+	JsonWriter writer;
+
+	SECTION("Trade is readable by jsoncpp")
+	{
+		writeTrade(writer, makeTrade());
+
+		Json::Value root;
+		Json::Reader reader;
+		REQUIRE(reader.parse(writer.str(), root));
+
+		auto trade = root["trade"];
+		REQUIRE(trade["order-id"] == 1);
+		REQUIRE(trade["price"].asDouble() == 19.73);
+		REQUIRE(trade["quantity"] == 2);
+		REQUIRE(trade["volume"].asDouble() == 123.45);
+		REQUIRE(trade["volume-currency"] == "RUB");
+		REQUIRE(trade["operation"] == "sell");
+		REQUIRE(trade["account"] == "TEST_ACCOUNT");
+		REQUIRE(trade["security"] == "FOOBAR");
+		REQUIRE(trade["execution-time"] == "2016-07-01 00:00:10.009");
+		REQUIRE(trade["strategy"] == "FOO_STRATEGY");
+		REQUIRE(trade["signal-id"] == "FOO_SIGNAL");
+		REQUIRE(trade["order-comment"] == "BLAH \"BLAH\"\n");
+	}
+
+	SECTION("Trade round trip")
+	{
+		auto original = makeTrade();
+		writeTrade(writer, original);
+
+		JsonReader reader(writer.str());
+		enterMessage(reader, "trade");
+		Trade trade;
+		trade.account = "garbage";
+		readTrade(reader, trade);
+
+		REQUIRE(trade.orderId == original.orderId);
+		REQUIRE(trade.price == original.price);
+		REQUIRE(trade.quantity == original.quantity);
+		REQUIRE(trade.volume == original.volume);
+		REQUIRE(trade.volumeCurrency == original.volumeCurrency);
+		REQUIRE(trade.operation == original.operation);
+		REQUIRE(trade.account == original.account);
+		REQUIRE(trade.security == original.security);
+		REQUIRE(trade.timestamp == original.timestamp);
+		REQUIRE(trade.useconds == original.useconds);
+		REQUIRE(trade.signalId.strategyId == original.signalId.strategyId);
+		REQUIRE(trade.signalId.signalId == original.signalId.signalId);
+		REQUIRE(trade.signalId.comment == original.signalId.comment);
+
+		REQUIRE(reader.next() == JsonReader::Token::EndObject);
+		REQUIRE(reader.next() == JsonReader::Token::End);
+	}
+
+	SECTION("Order written by jsoncpp")
+	{
+		Json::Value order;
+		order["id"] = 1;
+		order["account"] = "TEST_ACCOUNT";
+		order["security"] = "FOOBAR";
+		order["type"] = "limit";
+		order["price"] = 19.74;
+		order["quantity"] = 2;
+		order["operation"] = "buy";
+		order["comment"] = "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82"; // UTF-8 is passed as is
+		order["extra"]["nested"][0] = "skipped";
+		Json::Value root;
+		root["order"] = order;
+
+		Json::StyledWriter styled;
+		auto json = styled.write(root);
+		JsonReader reader(json);
+		enterMessage(reader, "order");
+		auto decoded = readOrder(reader);
+
+		REQUIRE(decoded->clientAssignedId() == 1);
+		REQUIRE(decoded->account() == "TEST_ACCOUNT");
+		REQUIRE(decoded->security() == "FOOBAR");
+		REQUIRE(decoded->type() == Order::OrderType::Limit);
+		REQUIRE(decoded->price() == 19.74);
+		REQUIRE(decoded->quantity() == 2);
+		REQUIRE(decoded->operation() == Order::Operation::Buy);
+		REQUIRE(decoded->signalId().comment == order["comment"].asString());
+		REQUIRE(decoded->signalId().strategyId.empty());
+	}
+
+	SECTION("Order round trip")
+	{
+		Order order(3, "TEST_ACCOUNT", "FOOBAR", 0, 5, Order::Operation::Sell, Order::OrderType::Market);
+		order.setSignalId(SignalId("FOO_STRATEGY", "FOO_SIGNAL", ""));
+		writeOrder(writer, order);
+
+		JsonReader reader(writer.str());
+		enterMessage(reader, "order");
+		auto decoded = readOrder(reader);
+
+		REQUIRE(decoded->clientAssignedId() == 3);
+		REQUIRE(decoded->type() == Order::OrderType::Market);
+		REQUIRE(decoded->operation() == Order::Operation::Sell);
+		REQUIRE(decoded->quantity() == 5);
+		REQUIRE(decoded->signalId().strategyId == "FOO_STRATEGY");
+		REQUIRE(decoded->signalId().signalId == "FOO_SIGNAL");
+
+		writeCancelOrder(writer, order);
+		JsonReader cancelReader(writer.str());
+		enterMessage(cancelReader, "cancel-order");
+		REQUIRE(readCancelOrder(cancelReader) == 3);
+	}
+
+	SECTION("Invalid orders")
+	{
+		auto readInvalid = [](const std::string& json)
+		{
+			JsonReader reader(json);
+			enterMessage(reader, "order");
+			readOrder(reader);
+		};
+
+		REQUIRE_THROWS_AS(readInvalid(R"({"order":{"id":1,"type":"limit","operation":"buy","quantity":1}})"), const ParameterError&);
+		REQUIRE_THROWS_AS(readInvalid(R"({"order":{"id":1,"type":"market","operation":"hold"}})"), const ParameterError&);
+		REQUIRE_THROWS_AS(readInvalid(R"({"order":{"id":"one","type":"market","operation":"buy"}})"), const ParameterError&);
+		REQUIRE_THROWS_AS(readInvalid(R"({"order":{"id":1e10,"type":"market","operation":"buy"}})"), const ParameterError&);
+		REQUIRE_THROWS_AS(readInvalid(R"({"order":{"id":1,"type":"market","operation":"buy","quantity":1.5}})"), const ParameterError&);
+	}
+
+	SECTION("Invalid order states")
+	{
+		auto readInvalid = [](const std::string& json)
+		{
+			JsonReader reader(json);
+			enterMessage(reader, "order");
+			int id;
+			Order::State state;
+			std::string message;
+			readOrderState(reader, id, state, message);
+		};
+
+		REQUIRE_THROWS_AS(readInvalid(R"({"order":{"id":1}})"), const ParameterError&);
+		REQUIRE_THROWS_AS(readInvalid(R"({"order":{"id":1,"new-state":null}})"), const ParameterError&);
+		REQUIRE_THROWS_AS(readInvalid(R"({"order":{"id":1,"new-state":"lost"}})"), const ParameterError&);
+		REQUIRE_THROWS_AS(readInvalid(R"({"order":{"id":-3e9,"new-state":"executed"}})"), const ParameterError&);
+	}
+
+	SECTION("Order state and result")
+	{
+		writeOrderState(writer, 7, Order::State::PartiallyExecuted);
+		REQUIRE(writer.str() == R"({"order":{"id":7,"new-state":"partially-executed"}})");
+
+		std::string json(R"({ "order" : { "id" : 2, "new-state" : "rejected", "message" : "Not enough money" } })");
+		JsonReader reader(json);
+		enterMessage(reader, "order");
+		int id;
+		Order::State state;
+		std::string message;
+		readOrderState(reader, id, state, message);
+		REQUIRE(id == 2);
+		REQUIRE(state == Order::State::Rejected);
+		REQUIRE(message == "Not enough money");
+
+		writeResult(writer, false, "No identity is set");
+		REQUIRE(writer.str() == R"({"result":"error","reason":"No identity is set"})");
+	}
+
+	SECTION("Escapes")
+	{
+		writer.beginArray();
+		writer.value(std::string("quote \" backslash \\ tab \t bell \x07"));
+		writer.value("\\u00e9");
+		writer.endArray();
+
+		JsonReader reader(writer.str());
+		REQUIRE(reader.next() == JsonReader::Token::BeginArray);
+		REQUIRE(reader.next() == JsonReader::Token::String);
+		REQUIRE(reader.string() == "quote \" backslash \\ tab \t bell \x07");
+		REQUIRE(reader.next() == JsonReader::Token::String);
+		REQUIRE(reader.string() == "\\u00e9");
+		REQUIRE(reader.next() == JsonReader::Token::EndArray);
+
+		std::string json(R"(["\u00e9\ud83d\ude00"])");
+		JsonReader unicode(json);
+		REQUIRE(unicode.next() == JsonReader::Token::BeginArray);
+		REQUIRE(unicode.next() == JsonReader::Token::String);
+		REQUIRE(unicode.string() == "\xc3\xa9\xf0\x9f\x98\x80");
+	}
+
+	SECTION("Malformed documents")
+	{
+		auto readAll = [](const std::string& json)
+		{
+			JsonReader reader(json);
+			while(reader.next() != JsonReader::Token::End)
+			{
+			}
+		};
+
+		REQUIRE_NOTHROW(readAll("{\"a\":[1,true,null,{}]}\n"));
+		REQUIRE_THROWS_AS(readAll("{\"a\":1,}"), const ProtocolError&);
+		REQUIRE_THROWS_AS(readAll("[1 2]"), const ProtocolError&);
+		REQUIRE_THROWS_AS(readAll("{\"a\" 1}"), const ProtocolError&);
+		REQUIRE_THROWS_AS(readAll("{\"a\":\"unterminated}"), const ProtocolError&);
+		REQUIRE_THROWS_AS(readAll("{\"a\":tru}"), const ProtocolError&);
+		REQUIRE_THROWS_AS(readAll("{\"a\":1}}"), const ProtocolError&);
+		REQUIRE_THROWS_AS(readAll("{\"a\":"), const ProtocolError&);
+		REQUIRE_THROWS_AS(readAll("{\"a\":\"\\x\"}"), const ProtocolError&);
+		REQUIRE_THROWS_AS(readAll(std::string(64, '[')), const ProtocolError&);
+	}
+}
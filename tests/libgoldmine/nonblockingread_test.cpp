@@ -0,0 +1,45 @@
+#include "catch.hpp"
+
+#include "goldmine/nonblockingread.h"
+
+#include "cppio/ioline.h"
+#include "cppio/iolinemanager.h"
+#include "cppio/errors.h"
+
+#include <boost/chrono.hpp>
+
+using namespace goldmine;
+using namespace cppio;
+
+TEST_CASE("Non-blocking reads", "[nonblockingread]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	int timeout = nonBlockingReceiveTimeout(*manager, "inproc://nonblockingread");
+	REQUIRE(((timeout == 0) || (timeout == MinReceiveTimeout)));
+
+	SECTION("Result is kept per endpoint type")
+	{
+		REQUIRE(nonBlockingReceiveTimeout(*manager, "inproc://nonblockingread-other") == timeout);
+	}
+
+	SECTION("Idle line is read without waiting")
+	{
+		auto acceptor = std::unique_ptr<IoAcceptor>(manager->createServer("inproc://nonblockingread"));
+		auto client = std::unique_ptr<IoLine>(manager->createClient("inproc://nonblockingread"));
+		auto server = std::unique_ptr<IoLine>(acceptor->waitConnection(100));
+		REQUIRE(server);
+		server->setOption(LineOption::ReceiveTimeout, &timeout);
+
+		char byte;
+		auto start = boost::chrono::steady_clock::now();
+		REQUIRE(server->read(&byte, 1) == eTimeout);
+		REQUIRE(boost::chrono::steady_clock::now() - start < boost::chrono::milliseconds(50));
+	}
+
+	SECTION("Endpoint types that can not be probed are not trusted")
+	{
+		REQUIRE_FALSE(zeroTimeoutReadsReturn(*manager, "no-such-endpoint"));
+		REQUIRE(nonBlockingReceiveTimeout(*manager, "no-such-endpoint") == MinReceiveTimeout);
+	}
+}
@@ -0,0 +1,153 @@
+
+#include "catch.hpp"
+
+#include "broker/orderarchive.h"
+#include "goldmine/exceptions.h"
+
+#include <boost/thread.hpp>
+
+#include <cstdio>
+#include <fstream>
+
+using namespace goldmine;
+
+static const char* ArchivePath = "goldmine-test-orderarchive.jsonl";
+
+static Order::Ptr makeOrder(int id)
+{
+	auto order = std::make_shared<Order>(id, "TEST_ACCOUNT", "FOOBAR", 19.73, 2, Order::Operation::Sell, Order::OrderType::Limit);
+	order->setExecutedQuantity(2);
+	order->updateState(Order::State::Executed);
+	return order;
+}
+
+TEST_CASE("OrderArchive", "[broker]")
+{
+	std::remove(ArchivePath);
+
+	SECTION("Records are read back")
+	{
+		auto order = makeOrder(1);
+		order->setSignalId(SignalId("FOO_STRATEGY", "FOO_SIGNAL", "BLAHBLAH"));
+		{
+			OrderArchive archive(ArchivePath);
+			archive.append(order, "client-1", 1000);
+			archive.append(makeOrder(2), "client-2", 1001);
+		}
+
+		auto records = OrderArchive::read(ArchivePath);
+		REQUIRE(records.size() == 2);
+
+		const auto& record = records.front();
+		REQUIRE(record.owner == "client-1");
+		REQUIRE(record.localId == order->localId());
+		REQUIRE(record.retiredAt == 1000);
+		REQUIRE(record.order->clientAssignedId() == 1);
+		REQUIRE(record.order->account() == "TEST_ACCOUNT");
+		REQUIRE(record.order->security() == "FOOBAR");
+		REQUIRE(record.order->price() == Approx(19.73));
+		REQUIRE(record.order->quantity() == 2);
+		REQUIRE(record.order->executedQuantity() == 2);
+		REQUIRE(record.order->operation() == Order::Operation::Sell);
+		REQUIRE(record.order->type() == Order::OrderType::Limit);
+		REQUIRE(record.order->state() == Order::State::Executed);
+		REQUIRE(record.order->signalId().strategyId == "FOO_STRATEGY");
+		REQUIRE(record.order->signalId().signalId == "FOO_SIGNAL");
+		REQUIRE(record.order->signalId().comment == "BLAHBLAH");
+
+		REQUIRE(records.back().owner == "client-2");
+	}
+
+	SECTION("Archive is appended to")
+	{
+		{
+			OrderArchive archive(ArchivePath);
+			archive.append(makeOrder(1), "client-1", 1000);
+		}
+		{
+			OrderArchive archive(ArchivePath);
+			archive.append(makeOrder(2), "client-1", 1001);
+		}
+
+		REQUIRE(OrderArchive::read(ArchivePath).size() == 2);
+	}
+
+	SECTION("Incomplete last record is skipped")
+	{
+		{
+			OrderArchive archive(ArchivePath);
+			archive.append(makeOrder(1), "client-1", 1000);
+		}
+		{
+			std::ofstream file(ArchivePath, std::ios::app);
+			file << "{\"owner\":\"client-1\",\"id\":";
+		}
+
+		REQUIRE(OrderArchive::read(ArchivePath).size() == 1);
+	}
+
+	SECTION("Malformed record")
+	{
+		{
+			std::ofstream file(ArchivePath);
+			file << "foo\n";
+		}
+		{
+			OrderArchive archive(ArchivePath);
+			archive.append(makeOrder(1), "client-1", 1000);
+		}
+
+		REQUIRE_THROWS_AS(OrderArchive::read(ArchivePath), const FormatError&);
+	}
+
+	SECTION("Retention by count")
+	{
+		{
+			RetiredOrders retired;
+			RetentionPolicy policy;
+			policy.maxOrders = 2;
+			retired.setPolicy(policy);
+			auto archive = std::make_shared<OrderArchive>(ArchivePath);
+			retired.setArchive(archive, "client-1");
+
+			for(int i = 1; i <= 3; i++)
+				retired.add(makeOrder(i));
+
+			REQUIRE(retired.size() == 2);
+			REQUIRE(!retired.contains(1));
+			REQUIRE(retired.contains(2));
+			REQUIRE(retired.contains(3));
+			archive->flush();
+			auto records = OrderArchive::read(ArchivePath);
+			REQUIRE(records.size() == 1);
+			REQUIRE(records.front().order->clientAssignedId() == 1);
+		}
+
+		// The rest is archived on destruction
+		REQUIRE(OrderArchive::read(ArchivePath).size() == 3);
+	}
+
+	SECTION("Retention by age")
+	{
+		RetiredOrders retired;
+		RetentionPolicy policy;
+		policy.maxOrders = 0;
+		policy.maxAge = boost::chrono::milliseconds(50);
+		retired.setPolicy(policy);
+
+		retired.add(makeOrder(1));
+		retired.add(makeOrder(2));
+		retired.expire();
+		REQUIRE(retired.size() == 2);
+
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+		retired.add(makeOrder(3));
+		REQUIRE(retired.size() == 1);
+
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+		retired.expire();
+		REQUIRE(retired.size() == 0);
+	}
+
+	std::remove(ArchivePath);
+}
@@ -5,6 +5,7 @@
 #include "catch.hpp"
 
 #include "quotesource/quotesource.h"
+#include "quotesource/tickcodec.h"
 #include "goldmine/data.h"
 
 #include "json/json.h"
@@ -91,6 +92,7 @@ TEST_CASE("QuoteSource", "[quotesource]")
 
 		REQUIRE(root["node-type"].asString() == "quotesource");
 		REQUIRE(root["protocol-version"].asInt() == 2);
+		REQUIRE(root["supported-protocol-versions"].size() == 2);
 	}
 
 	SECTION("Start stream request")
@@ -137,6 +139,47 @@ TEST_CASE("QuoteSource", "[quotesource]")
 			}
 		}
 
+		SECTION("Request ticks, protocol version 3")
+		{
+			Json::Value tickers(Json::arrayValue);
+			tickers.append("t:RIM6");
+			Json::Value root;
+			root["command"] = "start-stream";
+			root["tickers"] = tickers;
+			root["protocol-version"] = 3;
+			sendControlMessage(root, controlProto);
+
+			Json::Value okMessage;
+			REQUIRE(receiveControlMessage(okMessage, controlProto));
+			REQUIRE(okMessage["result"] == "success");
+			REQUIRE(okMessage["protocol-version"].asInt() == 3);
+
+			goldmine::Tick tick;
+			tick.timestamp = 12;
+			tick.useconds = 0;
+			tick.packet_type = (int)goldmine::PacketType::Tick;
+			tick.datatype = (int)goldmine::Datatype::Price;
+			tick.value = goldmine::decimal_fixed(42, 0);
+
+			source.incomingTick("RIM6", tick);
+
+			Message recvd;
+			controlProto.readMessage(recvd);
+
+			REQUIRE(recvd.size() == 3);
+			REQUIRE(recvd.get<uint32_t>(0) == (int)goldmine::MessageType::Data);
+			REQUIRE(recvd.get<std::string>(1) == "RIM6");
+
+			std::string encoded = recvd.get<std::string>(2);
+			REQUIRE(encoded.size() < sizeof(tick));
+
+			TickDecoder decoder;
+			std::vector<goldmine::Tick> decoded;
+			decoder.decode("RIM6", encoded.data(), encoded.size(), decoded);
+			REQUIRE(decoded.size() == 1);
+			REQUIRE(decoded.front() == tick);
+		}
+
 		SECTION("Request ticks, manual mode, without next tick message - timeout")
 		{
 			Json::Value tickers(Json::arrayValue);
@@ -292,3 +335,343 @@ TEST_CASE("QuoteSource", "[quotesource]")
 
 	source.stop();
 }
+
+static std::shared_ptr<IoLine> startSequencedStream(const std::shared_ptr<IoLineManager>& manager, const std::string& endpoint,
+		Json::Value& reply, uint64_t resumeFrom = 0, uint64_t resumeEpoch = 0, bool manualMode = false,
+		const std::string& ticker = "t:FOO")
+{
+	auto line = std::shared_ptr<IoLine>(manager->createClient(endpoint));
+	int timeout = 100;
+	line->setOption(LineOption::ReceiveTimeout, &timeout);
+	MessageProtocol proto(line.get());
+
+	Json::Value tickers(Json::arrayValue);
+	tickers.append(ticker);
+	Json::Value root;
+	root["command"] = "start-stream";
+	root["tickers"] = tickers;
+	root["sequence-numbers"] = true;
+	root["manual-mode"] = manualMode;
+	if(resumeFrom > 0)
+	{
+		root["resume-from"] = Json::Value((Json::UInt64)resumeFrom);
+		root["resume-epoch"] = Json::Value((Json::UInt64)resumeEpoch);
+	}
+	sendControlMessage(root, proto);
+	receiveControlMessage(reply, proto);
+	return line;
+}
+
+static uint64_t receiveSequencedTick(MessageProtocol& proto, goldmine::Tick& tick)
+{
+	Message recvd;
+	REQUIRE(proto.readMessage(recvd) > 0);
+	REQUIRE(recvd.size() == 4);
+	REQUIRE(recvd.get<uint32_t>(0) == (int)goldmine::MessageType::Data);
+	REQUIRE(recvd.get<std::string>(1) == "FOO");
+	tick = recvd.get<goldmine::Tick>(2);
+	return recvd.get<uint64_t>(3);
+}
+
+static uint64_t receiveSequencedTicks(MessageProtocol& proto, std::vector<goldmine::Tick>& ticks)
+{
+	Message recvd;
+	REQUIRE(proto.readMessage(recvd) > 0);
+	REQUIRE(recvd.size() == 4);
+	REQUIRE(recvd.get<uint32_t>(0) == (int)goldmine::MessageType::Data);
+	REQUIRE(recvd.get<std::string>(1) == "FOO");
+	auto frameTicks = reinterpret_cast<const goldmine::Tick*>(recvd.frame(2).data());
+	ticks.assign(frameTicks, frameTicks + recvd.frame(2).size() / sizeof(goldmine::Tick));
+	return recvd.get<uint64_t>(3);
+}
+
+TEST_CASE("QuoteSource - stream resume", "[quotesource]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSource source(manager, "inproc://resume-quotesource");
+	source.setRetransmissionCapacity(4);
+	source.start();
+
+	goldmine::Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.packet_type = (int)goldmine::PacketType::Tick;
+	tick.datatype = (int)goldmine::Datatype::Price;
+	tick.value = goldmine::decimal_fixed(42, 0);
+	tick.volume = 1;
+
+	Json::Value reply;
+	auto first = startSequencedStream(manager, "inproc://resume-quotesource", reply);
+	REQUIRE(reply["result"] == "success");
+	REQUIRE(reply["sequence-numbers"].asBool());
+	REQUIRE(reply["next-sequence"].asUInt64() == 1);
+	uint64_t epoch = reply["epoch"].asUInt64();
+
+	source.incomingTick("FOO", tick);
+	{
+		MessageProtocol proto(first.get());
+		goldmine::Tick received;
+		REQUIRE(receiveSequencedTick(proto, received) == 1);
+		REQUIRE(received == tick);
+	}
+	first.reset();
+
+	for(int i = 2; i <= 4; i++)
+	{
+		tick.volume = i;
+		source.incomingTick(i == 3 ? "BAR" : "FOO", tick);
+	}
+
+	SECTION("Missed ticks are retransmitted")
+	{
+		auto second = startSequencedStream(manager, "inproc://resume-quotesource", reply, 2, epoch);
+		REQUIRE(reply["next-sequence"].asUInt64() == 5);
+
+		MessageProtocol proto(second.get());
+		goldmine::Tick received;
+		REQUIRE(receiveSequencedTick(proto, received) == 2);
+		REQUIRE(received.volume == 2);
+		REQUIRE(receiveSequencedTick(proto, received) == 4);
+		REQUIRE(received.volume == 4);
+
+		tick.volume = 5;
+		source.incomingTick("FOO", tick);
+		REQUIRE(receiveSequencedTick(proto, received) == 5);
+		REQUIRE(received.volume == 5);
+	}
+
+	SECTION("Gap is reported when retransmission buffer is exceeded")
+	{
+		for(int i = 5; i <= 8; i++)
+		{
+			tick.volume = i;
+			source.incomingTick("FOO", tick);
+		}
+
+		auto second = startSequencedStream(manager, "inproc://resume-quotesource", reply, 2, epoch);
+		MessageProtocol proto(second.get());
+
+		Message gap;
+		REQUIRE(proto.readMessage(gap) > 0);
+		REQUIRE(gap.get<uint32_t>(0) == (int)goldmine::MessageType::Event);
+		REQUIRE(gap.get<uint32_t>(1) == (int)goldmine::EventId::StreamGap);
+		REQUIRE(gap.get<uint64_t>(2) == 2);
+		REQUIRE(gap.get<uint64_t>(3) == 5);
+
+		// Consecutive ticks of one ticker are retransmitted in one frame
+		std::vector<goldmine::Tick> received;
+		REQUIRE(receiveSequencedTicks(proto, received) == 5);
+		REQUIRE(received.size() == 4);
+		for(int i = 0; i < 4; i++)
+			REQUIRE(received[i].volume == 5 + i);
+	}
+
+	SECTION("Evicted ticks of other tickers are not reported as a gap")
+	{
+		for(int i = 5; i <= 7; i++)
+		{
+			tick.volume = i;
+			source.incomingTick("BAR", tick);
+		}
+
+		auto second = startSequencedStream(manager, "inproc://resume-quotesource", reply, 3, epoch);
+		MessageProtocol proto(second.get());
+
+		goldmine::Tick received;
+		REQUIRE(receiveSequencedTick(proto, received) == 4);
+		REQUIRE(received.volume == 4);
+	}
+
+	SECTION("Client of all tickers is resumed without a gap")
+	{
+		auto second = startSequencedStream(manager, "inproc://resume-quotesource", reply, 2, epoch, false, "t:*");
+		MessageProtocol proto(second.get());
+
+		for(uint64_t sequence = 2; sequence <= 4; sequence++)
+		{
+			Message recvd;
+			REQUIRE(proto.readMessage(recvd) > 0);
+			REQUIRE(recvd.get<uint32_t>(0) == (int)goldmine::MessageType::Data);
+			REQUIRE(recvd.get<std::string>(1) == (sequence == 3 ? "BAR" : "FOO"));
+			REQUIRE(recvd.get<uint64_t>(3) == sequence);
+		}
+	}
+
+	SECTION("Nothing is retransmitted to a client of another source instance")
+	{
+		auto second = startSequencedStream(manager, "inproc://resume-quotesource", reply, 2, epoch + 1);
+		REQUIRE(reply["epoch"].asUInt64() == epoch);
+
+		MessageProtocol proto(second.get());
+		Message recvd;
+		REQUIRE(proto.readMessage(recvd) == eTimeout);
+	}
+
+	source.stop();
+}
+
+TEST_CASE("QuoteSource - stream resume, manual mode", "[quotesource]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSource source(manager, "inproc://resume-manual-quotesource");
+	source.setRetransmissionCapacity(4096);
+	source.start();
+
+	Json::Value reply;
+	auto first = startSequencedStream(manager, "inproc://resume-manual-quotesource", reply);
+	uint64_t epoch = reply["epoch"].asUInt64();
+	first.reset();
+
+	// More than the live tick queue of a manual-mode client holds
+	const int count = 2000;
+	goldmine::Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.packet_type = (int)goldmine::PacketType::Tick;
+	tick.datatype = (int)goldmine::Datatype::Price;
+	tick.value = goldmine::decimal_fixed(42, 0);
+	for(int i = 1; i <= count; i++)
+	{
+		tick.volume = i;
+		source.incomingTick("FOO", tick);
+	}
+
+	auto second = startSequencedStream(manager, "inproc://resume-manual-quotesource", reply, 1, epoch, true);
+	MessageProtocol proto(second.get());
+
+	Message nextTickMessage;
+	nextTickMessage << (uint32_t)goldmine::MessageType::Service;
+	nextTickMessage << (uint32_t)goldmine::ServiceDataType::NextTick;
+
+	goldmine::Tick received;
+	for(int i = 1; i <= count; i++)
+	{
+		proto.sendMessage(nextTickMessage);
+		REQUIRE(receiveSequencedTick(proto, received) == (uint64_t)i);
+		REQUIRE(received.volume == i);
+	}
+
+	source.stop();
+}
+
+TEST_CASE("QuoteSource - heartbeats", "[quotesource]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSource source(manager, "inproc://heartbeat-quotesource");
+	source.start();
+
+	auto control = std::shared_ptr<IoLine>(manager->createClient("inproc://heartbeat-quotesource"));
+	int timeout = 20;
+	control->setOption(LineOption::ReceiveTimeout, &timeout);
+	MessageProtocol controlProto(control.get());
+
+	Json::Value root;
+	root["command"] = "heartbeat-request";
+	root["period"] = 0.1;
+	sendControlMessage(root, controlProto);
+
+	Message heartbeat;
+	heartbeat << (uint32_t)goldmine::MessageType::Service;
+	heartbeat << (uint32_t)goldmine::ServiceDataType::Heartbeat;
+
+	int heartbeats = 0;
+	auto started = boost::chrono::steady_clock::now();
+	while(boost::chrono::steady_clock::now() - started < boost::chrono::milliseconds(550))
+	{
+		controlProto.sendMessage(heartbeat);
+		Message recvd;
+		if(controlProto.readMessage(recvd) > 0)
+		{
+			REQUIRE(recvd.get<uint32_t>(0) == (int)goldmine::MessageType::Service);
+			REQUIRE(recvd.get<uint32_t>(1) == (int)goldmine::ServiceDataType::Heartbeat);
+			heartbeats++;
+		}
+	}
+	REQUIRE(heartbeats >= 3);
+	REQUIRE(heartbeats <= 7);
+
+	SECTION("Silent client is disconnected")
+	{
+		ssize_t rc = eTimeout;
+		started = boost::chrono::steady_clock::now();
+		while((boost::chrono::steady_clock::now() - started < boost::chrono::seconds(1)))
+		{
+			Message recvd;
+			rc = controlProto.readMessage(recvd);
+			if((rc <= 0) && (rc != eTimeout))
+				break;
+		}
+		REQUIRE(rc != eTimeout);
+		REQUIRE(rc <= 0);
+	}
+
+	source.stop();
+}
+
+TEST_CASE("QuoteSource - bulk publishing", "[quotesource]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSource source(manager, "inproc://bulk-quotesource");
+	source.start();
+
+	Json::Value reply;
+	auto line = startSequencedStream(manager, "inproc://bulk-quotesource", reply);
+	REQUIRE(reply["result"] == "success");
+	MessageProtocol proto(line.get());
+
+	std::vector<goldmine::Tick> ticks(10);
+	for(size_t i = 0; i < ticks.size(); i++)
+	{
+		ticks[i].timestamp = 12 + i;
+		ticks[i].datatype = (int)goldmine::Datatype::Price;
+		ticks[i].value = goldmine::decimal_fixed(42, 0);
+		ticks[i].volume = i;
+	}
+
+	SECTION("Single ticker")
+	{
+		source.incomingTicks("FOO", ticks.data(), ticks.size());
+
+		Message recvd;
+		REQUIRE(proto.readMessage(recvd) > 0);
+		REQUIRE(recvd.size() == 4);
+		REQUIRE(recvd.get<std::string>(1) == "FOO");
+		REQUIRE(recvd.frame(2).size() == ticks.size() * sizeof(goldmine::Tick));
+		const goldmine::Tick* received = reinterpret_cast<const goldmine::Tick*>(recvd.frame(2).data());
+		REQUIRE(std::vector<goldmine::Tick>(received, received + ticks.size()) == ticks);
+		REQUIRE(recvd.get<uint64_t>(3) == 1);
+
+		source.incomingTick("FOO", ticks.front());
+		goldmine::Tick tick;
+		REQUIRE(receiveSequencedTick(proto, tick) == 11);
+	}
+
+	SECTION("Mixed batch")
+	{
+		std::vector<std::string> tickers = { "FOO", "BAR" };
+		std::vector<uint32_t> ids = { 0, 0, 1, 1, 1, 0, 0, 0, 1, 0 };
+		source.incomingTicks(tickers, ids.data(), ticks.data(), ticks.size());
+
+		// Only FOO runs are sent: [0, 2), [5, 8), [9, 10)
+		std::vector<std::pair<uint64_t, size_t>> runs = { { 1, 2 }, { 6, 3 }, { 10, 1 } };
+		for(const auto& run : runs)
+		{
+			Message recvd;
+			REQUIRE(proto.readMessage(recvd) > 0);
+			REQUIRE(recvd.get<std::string>(1) == "FOO");
+			REQUIRE(recvd.get<uint64_t>(3) == run.first);
+			REQUIRE(recvd.frame(2).size() == run.second * sizeof(goldmine::Tick));
+			const goldmine::Tick* received = reinterpret_cast<const goldmine::Tick*>(recvd.frame(2).data());
+			REQUIRE(*received == ticks[run.first - 1]);
+		}
+
+		ids[3] = 2;
+		REQUIRE_THROWS_AS(source.incomingTicks(tickers, ids.data(), ticks.data(), ticks.size()), const ParameterError&);
+	}
+
+	source.stop();
+}
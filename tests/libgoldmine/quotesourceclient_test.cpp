@@ -4,9 +4,13 @@
 #include "quotesource/quotesourceclient.h"
 #include "goldmine/data.h"
 #include "quotesource/quotesource.h"
+#include "quotesource/shmring.h"
 
 #include <boost/thread.hpp>
 
+#include <map>
+#include <set>
+
 using namespace goldmine;
 using namespace cppio;
 
@@ -25,6 +29,76 @@ public:
 	std::vector<std::pair<std::string, Tick>> ticks;
 };
 
+class BatchSink : public QuoteSourceClient::Sink
+{
+public:
+	virtual ~BatchSink()
+	{
+	}
+
+	void incomingTick(const std::string& ticker, const Tick& tick) override
+	{
+		singleCalls++;
+	}
+
+	void incomingTicks(const std::string& ticker, const Tick* ticks, size_t count) override
+	{
+		batches.push_back(std::make_pair(ticker, std::vector<Tick>(ticks, ticks + count)));
+	}
+
+	size_t tickCount() const
+	{
+		size_t result = 0;
+		for(const auto& batch : batches)
+			result += batch.second.size();
+		return result;
+	}
+
+	int singleCalls = 0;
+	std::vector<std::pair<std::string, std::vector<Tick>>> batches;
+};
+
+class LockingSink : public QuoteSourceClient::Sink
+{
+public:
+	virtual ~LockingSink()
+	{
+	}
+
+	void incomingTick(const std::string& ticker, const Tick& tick) override
+	{
+		boost::unique_lock<boost::mutex> lock(mutex);
+		ticks[ticker].push_back(tick);
+		threads[ticker].insert(boost::this_thread::get_id());
+	}
+
+	boost::mutex mutex;
+	std::map<std::string, std::vector<Tick>> ticks;
+	std::map<std::string, std::set<boost::thread::id>> threads;
+};
+
+class SlowSink : public QuoteSourceClient::Sink
+{
+public:
+	virtual ~SlowSink()
+	{
+	}
+
+	void incomingTick(const std::string& ticker, const Tick& tick) override
+	{
+		if(ticks++ == 0)
+			boost::this_thread::sleep_for(boost::chrono::milliseconds(200));
+	}
+
+	void streamGap(uint64_t fromSequence, uint64_t toSequence) override
+	{
+		gaps.push_back(std::make_pair(fromSequence, toSequence));
+	}
+
+	int ticks = 0;
+	std::vector<std::pair<uint64_t, uint64_t>> gaps;
+};
+
 TEST_CASE("QuotesourceClient", "[quotesourceclient]")
 {
 	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
@@ -56,3 +130,593 @@ TEST_CASE("QuotesourceClient", "[quotesourceclient]")
 
 }
 
+TEST_CASE("QuotesourceClient - protocol version 2", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSourceClient client(manager, "inproc://quotesource-v2");
+	client.setProtocolVersion(2);
+	auto sink = std::make_shared<TickSink>();
+	client.registerSink(sink);
+
+	QuoteSource source(manager, "inproc://quotesource-v2");
+	source.start();
+
+	client.startStream("t:FOO");
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 100;
+	source.incomingTick("FOO", tick);
+	source.incomingTick("FOO", tick);
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	client.stop();
+	source.stop();
+
+	REQUIRE(sink->ticks.size() == 2);
+	REQUIRE(sink->ticks.back().second == tick);
+}
+
+
+TEST_CASE("QuotesourceClient - shared memory transport", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSource source(manager, "shm://goldmine-test-quotesource");
+	source.start();
+
+	QuoteSourceClient client(manager, "shm://goldmine-test-quotesource");
+	auto sink = std::make_shared<TickSink>();
+	client.registerSink(sink);
+	client.startStream("t:FOO");
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 100;
+	source.incomingTick("BAR", tick);
+	source.incomingTick("FOO", tick);
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	client.stop();
+	source.stop();
+
+	REQUIRE(sink->ticks.size() == 1);
+	REQUIRE(sink->ticks.front().first == "FOO");
+	REQUIRE(sink->ticks.front().second == tick);
+}
+
+TEST_CASE("QuotesourceClient - batch sink", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSource source(manager, "shm://goldmine-test-quotesource-batch");
+	source.start();
+
+	QuoteSourceClient client(manager, "shm://goldmine-test-quotesource-batch");
+	auto sink = std::make_shared<BatchSink>();
+	auto tickSink = std::make_shared<TickSink>();
+	client.registerSink(sink);
+	client.registerSink(tickSink);
+	client.startStream("t:*");
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 100;
+	for(int i = 0; i < 10; i++)
+	{
+		tick.volume = i;
+		source.incomingTick(i < 5 ? "FOO" : "BAR", tick);
+	}
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	client.stop();
+	source.stop();
+
+	REQUIRE(sink->singleCalls == 0);
+	REQUIRE(sink->tickCount() == 10);
+	for(const auto& batch : sink->batches)
+	{
+		for(const auto& t : batch.second)
+			REQUIRE(batch.first == (t.volume < 5 ? "FOO" : "BAR"));
+	}
+
+	REQUIRE(tickSink->ticks.size() == 10);
+	REQUIRE(tickSink->ticks.back().second == tick);
+}
+
+TEST_CASE("QuotesourceClient - parallel dispatch", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSource source(manager, "shm://goldmine-test-quotesource-workers");
+	source.start();
+
+	QuoteSourceClient client(manager, "shm://goldmine-test-quotesource-workers");
+	client.setDispatchWorkers(4, 64);
+	auto sink = std::make_shared<LockingSink>();
+	client.registerSink(sink);
+	client.startStream("t:*");
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	const std::vector<std::string> tickers = { "FOO", "BAR", "BAZ", "QUUX", "SPAM", "EGGS" };
+	const int ticksPerTicker = 1000;
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	for(int i = 0; i < ticksPerTicker; i++)
+	{
+		tick.volume = i;
+		for(const auto& ticker : tickers)
+			source.incomingTick(ticker, tick);
+	}
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(200));
+
+	client.stop();
+	source.stop();
+
+	for(const auto& ticker : tickers)
+	{
+		const auto& received = sink->ticks[ticker];
+		REQUIRE(received.size() == ticksPerTicker);
+		for(int i = 0; i < ticksPerTicker; i++)
+			REQUIRE(received[i].volume == i);
+		REQUIRE(sink->threads[ticker].size() == 1);
+	}
+
+	auto stats = client.dispatchStats();
+	REQUIRE(stats.size() == 4);
+	uint64_t dispatched = 0;
+	for(const auto& s : stats)
+	{
+		REQUIRE(s.queueDepth == 0);
+		REQUIRE(s.maxLagMicroseconds >= s.lastLagMicroseconds);
+		dispatched += s.dispatchedTicks;
+	}
+	REQUIRE(dispatched == tickers.size() * ticksPerTicker);
+}
+
+TEST_CASE("QuotesourceClient - parallel dispatch, restarted stream", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSource source(manager, "shm://goldmine-test-quotesource-restart-workers");
+	source.start();
+
+	QuoteSourceClient client(manager, "shm://goldmine-test-quotesource-restart-workers");
+	client.setDispatchWorkers(2, 64);
+	auto sink = std::make_shared<LockingSink>();
+	client.registerSink(sink);
+	client.startStream("t:*");
+	client.startStream("t:*");
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 1;
+	for(int i = 0; i < 100; i++)
+		source.incomingTick("FOO", tick);
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(200));
+
+	client.stop();
+	source.stop();
+
+	REQUIRE(sink->ticks["FOO"].size() == 100);
+	REQUIRE(client.dispatchStats().size() == 2);
+}
+
+TEST_CASE("QuotesourceClient - gap event", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSource source(manager, "shm://goldmine-test-quotesource-gap");
+	source.start();
+
+	QuoteSourceClient client(manager, "shm://goldmine-test-quotesource-gap");
+	auto sink = std::make_shared<SlowSink>();
+	client.registerSink(sink);
+	client.startStream("t:FOO");
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 100;
+	source.incomingTick("FOO", tick);
+
+	// Lap the reader while the sink is busy with the first tick
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+	const int total = ShmRingWriter::DefaultCapacity + 100;
+	for(int i = 0; i < total; i++)
+		source.incomingTick("FOO", tick);
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(400));
+
+	client.stop();
+	source.stop();
+
+	REQUIRE(sink->gaps.size() == 1);
+	uint64_t lost = sink->gaps.front().second - sink->gaps.front().first;
+	REQUIRE(lost > 0);
+	REQUIRE(sink->ticks + lost == total + 1);
+}
+
+TEST_CASE("QuotesourceClient - reconnect", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	QuoteSourceClient client(manager, "inproc://quotesource-reconnect");
+	QuoteSourceClient::ReconnectPolicy policy;
+	policy.initialDelay = boost::chrono::milliseconds(10);
+	policy.maxDelay = boost::chrono::milliseconds(50);
+	client.setReconnectPolicy(policy);
+	auto sink = std::make_shared<LockingSink>();
+	client.registerSink(sink);
+	client.startStream("t:FOO");
+
+	// Let a few attempts fail
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(300));
+
+	QuoteSource source(manager, "inproc://quotesource-reconnect");
+	source.start();
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 100;
+
+	auto started = boost::chrono::steady_clock::now();
+	bool received = false;
+	while(!received && (boost::chrono::steady_clock::now() - started < boost::chrono::seconds(2)))
+	{
+		source.incomingTick("FOO", tick);
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+		boost::unique_lock<boost::mutex> lock(sink->mutex);
+		received = !sink->ticks["FOO"].empty();
+	}
+
+	client.stop();
+	source.stop();
+
+	REQUIRE(received);
+}
+
+TEST_CASE("QuotesourceClient - polling", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 100;
+
+	SECTION("Not in polling mode")
+	{
+		QuoteSourceClient client(manager, "inproc://quotesource-polling");
+		QuoteSourceClient::PollBuffer buffer;
+		REQUIRE_THROWS_AS(client.poll(10), const ParameterError&);
+		REQUIRE_THROWS_AS(client.pollBatch(buffer, 10), const ParameterError&);
+	}
+
+	SECTION("Sinks are called from poll")
+	{
+		QuoteSource source(manager, "inproc://quotesource-polling");
+		source.start();
+
+		QuoteSourceClient client(manager, "inproc://quotesource-polling");
+		auto sink = std::make_shared<BatchSink>();
+		client.registerSink(sink);
+		client.startPolling("t:FOO,t:BAR");
+
+		REQUIRE(client.poll(10) == 0);
+		source.incomingTick("FOO", tick);
+		source.incomingTick("FOO", tick);
+		source.incomingTick("BAR", tick);
+
+		size_t received = 0;
+		for(int i = 0; (i < 100) && (received < 3); i++)
+			received += client.poll(10, boost::chrono::milliseconds(10));
+
+		client.stop();
+		source.stop();
+
+		REQUIRE(received == 3);
+		REQUIRE(sink->tickCount() == 3);
+		REQUIRE(sink->batches.back().first == "BAR");
+		REQUIRE(sink->batches.back().second.front() == tick);
+	}
+
+	SECTION("Ticks are decoded into caller buffer")
+	{
+		QuoteSource source(manager, "inproc://quotesource-polling");
+		source.start();
+
+		QuoteSourceClient client(manager, "inproc://quotesource-polling");
+		auto sink = std::make_shared<BatchSink>();
+		client.registerSink(sink);
+		client.startPolling("t:FOO,t:BAR");
+
+		QuoteSourceClient::PollBuffer buffer;
+		REQUIRE(client.pollBatch(buffer, 10) == 0);
+		source.incomingTick("FOO", tick);
+		source.incomingTick("BAR", tick);
+		source.incomingTick("FOO", tick);
+
+		for(int i = 0; (i < 100) && (buffer.ticks.size() < 3); i++)
+			client.pollBatch(buffer, 10, boost::chrono::milliseconds(10));
+
+		client.stop();
+		source.stop();
+
+		REQUIRE(sink->tickCount() == 0);
+		REQUIRE(buffer.ticks.size() == 3);
+		REQUIRE(buffer.tickerIds.size() == 3);
+		REQUIRE(buffer.tickers.size() == 2);
+		REQUIRE(buffer.tickers[buffer.tickerIds[0]] == "FOO");
+		REQUIRE(buffer.tickers[buffer.tickerIds[1]] == "BAR");
+		REQUIRE(buffer.tickerIds[2] == buffer.tickerIds[0]);
+		REQUIRE(buffer.ticks[2] == tick);
+
+		uint32_t barId = buffer.tickerIds[1];
+		buffer.clear();
+		REQUIRE(buffer.ticks.empty());
+		REQUIRE(buffer.tickerId("BAR") == barId);
+	}
+
+	SECTION("Shared memory transport")
+	{
+		QuoteSource source(manager, "shm://goldmine-test-quotesource-polling");
+		source.start();
+
+		QuoteSourceClient client(manager, "shm://goldmine-test-quotesource-polling");
+		client.startPolling("t:FOO");
+
+		QuoteSourceClient::PollBuffer buffer;
+		REQUIRE(client.pollBatch(buffer, 10) == 0);
+		for(int i = 0; i < 5; i++)
+			source.incomingTick("FOO", tick);
+		source.incomingTick("BAR", tick);
+
+		REQUIRE(client.pollBatch(buffer, 3) == 3);
+		REQUIRE(client.pollBatch(buffer, 10) == 2);
+
+		client.stop();
+		source.stop();
+
+		REQUIRE(buffer.ticks.size() == 5);
+		REQUIRE(buffer.tickers.size() == 1);
+	}
+}
+
+TEST_CASE("QuotesourceClient - busy poll", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+
+	BusyPollPolicy policy;
+	policy.enabled = true;
+	policy.spinRounds = 100;
+	policy.yieldRounds = 100;
+
+	QuoteSource source(manager, "inproc://quotesource-busypoll");
+	source.setBusyPoll(policy);
+	source.start();
+
+	QuoteSourceClient client(manager, "inproc://quotesource-busypoll");
+	client.setBusyPoll(policy);
+	client.setHeartbeatPeriod(boost::chrono::milliseconds(50));
+	auto sink = std::make_shared<LockingSink>();
+	client.registerSink(sink);
+	client.startStream("t:FOO");
+
+	// Heartbeats keep both sides connected while the lines are idle
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(300));
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 100;
+	for(int i = 0; i < 100; i++)
+		source.incomingTick("FOO", tick);
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	client.stop();
+	source.stop();
+
+	REQUIRE(sink->ticks["FOO"].size() == 100);
+}
+
+TEST_CASE("QuotesourceClient - invalid busy poll policy", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+	QuoteSourceClient client(manager, "inproc://quotesource-busypoll");
+	QuoteSource source(manager, "inproc://quotesource-busypoll");
+
+	BusyPollPolicy policy;
+	policy.enabled = true;
+	policy.spinRounds = -1;
+	REQUIRE_THROWS_AS(client.setBusyPoll(policy), const ParameterError&);
+	REQUIRE_THROWS_AS(source.setBusyPoll(policy), const ParameterError&);
+}
+
+TEST_CASE("QuotesourceClient - invalid reconnect policy", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+	QuoteSourceClient client(manager, "inproc://quotesource-reconnect");
+
+	QuoteSourceClient::ReconnectPolicy policy;
+	policy.maxDelay = boost::chrono::milliseconds(10);
+	REQUIRE_THROWS_AS(client.setReconnectPolicy(policy), const ParameterError&);
+}
+
+TEST_CASE("QuotesourceClient - heartbeats", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+	auto acceptor = std::unique_ptr<IoAcceptor>(manager->createServer("inproc://quotesource-heartbeat"));
+
+	QuoteSourceClient client(manager, "inproc://quotesource-heartbeat");
+	client.setHeartbeatPeriod(boost::chrono::milliseconds(100));
+	auto sink = std::make_shared<LockingSink>();
+	client.registerSink(sink);
+	client.startStream("t:FOO");
+
+	auto line = std::shared_ptr<IoLine>(acceptor->waitConnection(1000));
+	REQUIRE(line);
+	int timeout = 20;
+	line->setOption(LineOption::ReceiveTimeout, &timeout);
+	MessageProtocol proto(line.get());
+
+	Message request;
+	REQUIRE(proto.readMessage(request) > 0);
+	REQUIRE(request.get<uint32_t>(0) == (int)MessageType::Control);
+
+	Message ok;
+	ok << (uint32_t)MessageType::Control;
+	ok << std::string("{\"result\" : \"success\"}");
+	proto.sendMessage(ok);
+
+	Message heartbeat;
+	heartbeat << (uint32_t)MessageType::Service;
+	heartbeat << (uint32_t)ServiceDataType::Heartbeat;
+	proto.sendMessage(heartbeat);
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 100;
+
+	// Heartbeat rate should not depend on data rate
+	int heartbeats = 0;
+	bool heartbeatRequested = false;
+	auto started = boost::chrono::steady_clock::now();
+	while(boost::chrono::steady_clock::now() - started < boost::chrono::milliseconds(550))
+	{
+		for(int i = 0; i < 100; i++)
+		{
+			Message data;
+			data << (uint32_t)MessageType::Data;
+			data << std::string("FOO");
+			data << tick;
+			proto.sendMessage(data);
+		}
+
+		Message recvd;
+		while(proto.readMessage(recvd) > 0)
+		{
+			if(recvd.get<uint32_t>(0) == (int)MessageType::Service)
+			{
+				REQUIRE(recvd.get<uint32_t>(1) == (int)ServiceDataType::Heartbeat);
+				heartbeats++;
+			}
+			else if(recvd.get<uint32_t>(0) == (int)MessageType::Control)
+			{
+				heartbeatRequested = recvd.get<std::string>(1).find("heartbeat-request") != std::string::npos;
+			}
+			recvd.clear();
+		}
+	}
+	REQUIRE(heartbeatRequested);
+	REQUIRE(heartbeats >= 3);
+	REQUIRE(heartbeats <= 7);
+
+	// Server goes silent, client should notice and reconnect
+	started = boost::chrono::steady_clock::now();
+	auto secondLine = std::shared_ptr<IoLine>(acceptor->waitConnection(1000));
+	REQUIRE(secondLine);
+	REQUIRE(boost::chrono::steady_clock::now() - started < boost::chrono::milliseconds(1000));
+
+	client.stop();
+
+	boost::unique_lock<boost::mutex> lock(sink->mutex);
+	REQUIRE(sink->ticks["FOO"].size() > 0);
+}
+
+TEST_CASE("QuotesourceClient - heartbeats with a slow sink", "[quotesourceclient]")
+{
+	auto manager = std::shared_ptr<IoLineManager>(createLineManager());
+	auto acceptor = std::unique_ptr<IoAcceptor>(manager->createServer("inproc://quotesource-heartbeat-slow"));
+
+	QuoteSourceClient client(manager, "inproc://quotesource-heartbeat-slow");
+	client.setHeartbeatPeriod(boost::chrono::milliseconds(100));
+	auto sink = std::make_shared<SlowSink>();
+	client.registerSink(sink);
+	client.startStream("t:FOO");
+
+	auto line = std::shared_ptr<IoLine>(acceptor->waitConnection(1000));
+	REQUIRE(line);
+	int timeout = 20;
+	line->setOption(LineOption::ReceiveTimeout, &timeout);
+	MessageProtocol proto(line.get());
+
+	Message request;
+	REQUIRE(proto.readMessage(request) > 0);
+
+	Message ok;
+	ok << (uint32_t)MessageType::Control;
+	ok << std::string("{\"result\" : \"success\"}");
+	proto.sendMessage(ok);
+
+	Tick tick;
+	tick.timestamp = 12;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 100;
+
+	// Sink blocks the network thread for 200 ms on the first tick
+	Message data;
+	data << (uint32_t)MessageType::Data;
+	data << std::string("FOO");
+	data << tick;
+	proto.sendMessage(data);
+
+	int heartbeats = 0;
+	auto started = boost::chrono::steady_clock::now();
+	while(boost::chrono::steady_clock::now() - started < boost::chrono::milliseconds(250))
+	{
+		Message recvd;
+		if((proto.readMessage(recvd) > 0) && (recvd.get<uint32_t>(0) == (int)MessageType::Service))
+			heartbeats++;
+	}
+	REQUIRE(heartbeats >= 2);
+
+	client.stop();
+}
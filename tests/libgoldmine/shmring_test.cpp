@@ -0,0 +1,116 @@
+
+#include "catch.hpp"
+
+#include "quotesource/shmring.h"
+#include "goldmine/data.h"
+#include "goldmine/exceptions.h"
+
+using namespace goldmine;
+
+static Tick makeTick(uint64_t timestamp)
+{
+	Tick tick;
+	tick.timestamp = timestamp;
+	tick.useconds = 0;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = decimal_fixed(42, 0);
+	tick.volume = 1;
+	return tick;
+}
+
+TEST_CASE("ShmRing", "[shmring]")
+{
+	ShmRingWriter writer("shm://goldmine-test-ring", 8);
+	ShmRingReader reader("shm://goldmine-test-ring");
+
+	std::string ticker;
+	Tick tick;
+	uint64_t lost;
+
+	SECTION("Empty ring")
+	{
+		REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Empty);
+	}
+
+	SECTION("Ticks are read in order")
+	{
+		writer.write("FOO", makeTick(1));
+		writer.write("BAR", makeTick(2));
+
+		REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Ok);
+		REQUIRE(ticker == "FOO");
+		REQUIRE(tick == makeTick(1));
+
+		REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Ok);
+		REQUIRE(ticker == "BAR");
+		REQUIRE(tick == makeTick(2));
+
+		REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Empty);
+	}
+
+	SECTION("Every reader has its own cursor")
+	{
+		ShmRingReader otherReader("shm://goldmine-test-ring");
+		writer.write("FOO", makeTick(1));
+
+		REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Ok);
+		REQUIRE(otherReader.read(ticker, tick, lost) == ShmRingReader::Result::Ok);
+		REQUIRE(tick == makeTick(1));
+	}
+
+	SECTION("Lapped reader reports lost ticks")
+	{
+		for(int i = 1; i <= 10; i++)
+			writer.write("FOO", makeTick(i));
+
+		REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Overrun);
+		REQUIRE(lost == 2);
+
+		REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Ok);
+		REQUIRE(tick == makeTick(3));
+	}
+
+	SECTION("Second writer is refused")
+	{
+		REQUIRE_THROWS_AS(ShmRingWriter("shm://goldmine-test-ring", 16), const ParameterError&);
+
+		writer.write("FOO", makeTick(1));
+		REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Ok);
+	}
+
+	SECTION("Too long ticker")
+	{
+		REQUIRE_THROWS_AS(writer.write(std::string(ShmRingWriter::MaxTickerLength + 1, 'X'), makeTick(1)), const ParameterError&);
+	}
+}
+
+TEST_CASE("ShmRing - no writer", "[shmring]")
+{
+	REQUIRE_THROWS_AS(ShmRingReader("shm://goldmine-test-absent"), const ParameterError&);
+}
+
+TEST_CASE("ShmRing - restarted writer", "[shmring]")
+{
+	std::unique_ptr<ShmRingWriter> writer(new ShmRingWriter("shm://goldmine-test-restart", 8));
+	ShmRingReader reader("shm://goldmine-test-restart");
+
+	std::string ticker;
+	Tick tick;
+	uint64_t lost;
+
+	writer->write("FOO", makeTick(1));
+	REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Ok);
+
+	writer.reset();
+	writer.reset(new ShmRingWriter("shm://goldmine-test-restart", 8));
+	writer->write("BAR", makeTick(2));
+
+	auto result = ShmRingReader::Result::Empty;
+	for(int i = 0; (i < 100000) && (result == ShmRingReader::Result::Empty); i++)
+		result = reader.read(ticker, tick, lost);
+	REQUIRE(result == ShmRingReader::Result::Restarted);
+
+	REQUIRE(reader.read(ticker, tick, lost) == ShmRingReader::Result::Ok);
+	REQUIRE(ticker == "BAR");
+	REQUIRE(tick == makeTick(2));
+}
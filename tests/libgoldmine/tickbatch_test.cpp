@@ -0,0 +1,70 @@
+
+#include "catch.hpp"
+
+#include "goldmine/tickbatch.h"
+#include "quotesource/tickcodec.h"
+
+using namespace goldmine;
+
+static std::vector<Tick> makeTicks(size_t count)
+{
+	std::vector<Tick> ticks;
+	for(size_t i = 0; i < count; i++)
+	{
+		Tick tick;
+		tick.timestamp = 1463652000 + i;
+		tick.useconds = i * 10;
+		tick.datatype = (int)Datatype::Price;
+		tick.value = decimal_fixed(92500 + i, i * 1000);
+		tick.volume = i + 1;
+		ticks.push_back(tick);
+	}
+	return ticks;
+}
+
+TEST_CASE("TickBatch", "[tickbatch]")
+{
+	auto ticks = makeTicks(37);
+	TickBatch batch;
+	batch.append(ticks.data(), ticks.size());
+
+	SECTION("Columns are aligned")
+	{
+		REQUIRE(batch.size() == ticks.size());
+		REQUIRE(reinterpret_cast<uintptr_t>(batch.timestamps.data()) % 64 == 0);
+		REQUIRE(reinterpret_cast<uintptr_t>(batch.priceValues.data()) % 64 == 0);
+		REQUIRE(reinterpret_cast<uintptr_t>(batch.volumes.data()) % 64 == 0);
+	}
+
+	SECTION("Scatter and gather")
+	{
+		REQUIRE(batch.timestamps[5] == ticks[5].timestamp);
+		REQUIRE(batch.priceFractionals[5] == ticks[5].value.fractional);
+
+		std::vector<Tick> gathered(batch.size());
+		batch.toTicks(gathered.data());
+		REQUIRE(gathered == ticks);
+		REQUIRE(batch.tick(10) == ticks[10]);
+	}
+
+	SECTION("Append to non-empty batch")
+	{
+		batch.append(ticks.front());
+		REQUIRE(batch.size() == ticks.size() + 1);
+		REQUIRE(batch.tick(ticks.size()) == ticks.front());
+	}
+
+	SECTION("Codec round trip")
+	{
+		TickEncoder encoder;
+		TickDecoder decoder;
+		std::vector<char> buffer;
+		encoder.encode("FOO", batch, buffer);
+
+		TickBatch decoded;
+		REQUIRE(decoder.decode("FOO", buffer.data(), buffer.size(), decoded) == ticks.size());
+		std::vector<Tick> gathered(decoded.size());
+		decoded.toTicks(gathered.data());
+		REQUIRE(gathered == ticks);
+	}
+}
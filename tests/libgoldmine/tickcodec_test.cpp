@@ -0,0 +1,88 @@
+
+#include "catch.hpp"
+
+#include "quotesource/tickcodec.h"
+#include "goldmine/data.h"
+#include "goldmine/exceptions.h"
+
+using namespace goldmine;
+
+static Tick makeTick(uint64_t timestamp, uint32_t useconds, const decimal_fixed& value, int32_t volume)
+{
+	Tick tick;
+	tick.timestamp = timestamp;
+	tick.useconds = useconds;
+	tick.datatype = (int)Datatype::Price;
+	tick.value = value;
+	tick.volume = volume;
+	return tick;
+}
+
+TEST_CASE("TickCodec", "[tickcodec]")
+{
+	TickEncoder encoder;
+	TickDecoder decoder;
+	std::vector<char> buffer;
+	std::vector<Tick> decoded;
+
+	SECTION("Round trip")
+	{
+		std::vector<Tick> ticks {
+			makeTick(1463652000, 0, decimal_fixed(92500, 0), 10),
+			makeTick(1463652000, 1500, decimal_fixed(92510, 0), 1),
+			makeTick(1463652001, 20, decimal_fixed(92490, 500000000), -3),
+			makeTick(1463651999, 999999, decimal_fixed(-2, 123456789), 0)
+		};
+		ticks.back().datatype = (int)Datatype::BestBid;
+
+		encoder.encode("RIM6", ticks.data(), ticks.size(), buffer);
+		REQUIRE(decoder.decode("RIM6", buffer.data(), buffer.size(), decoded) == ticks.size());
+		REQUIRE(decoded == ticks);
+	}
+
+	SECTION("State is kept per ticker and across frames")
+	{
+		auto foo1 = makeTick(100, 0, decimal_fixed(10, 0), 1);
+		auto bar1 = makeTick(200, 0, decimal_fixed(20, 0), 2);
+		auto foo2 = makeTick(101, 0, decimal_fixed(10, 10000000), 3);
+
+		for(const auto& p : std::vector<std::pair<std::string, Tick>> { {"FOO", foo1}, {"BAR", bar1}, {"FOO", foo2} })
+		{
+			buffer.clear();
+			decoded.clear();
+			encoder.encode(p.first, &p.second, 1, buffer);
+			decoder.decode(p.first, buffer.data(), buffer.size(), decoded);
+			REQUIRE(decoded.size() == 1);
+			REQUIRE(decoded.front() == p.second);
+		}
+	}
+
+	SECTION("Consecutive ticks are compact")
+	{
+		std::vector<Tick> ticks;
+		for(int i = 0; i < 100; i++)
+			ticks.push_back(makeTick(1463652000, i * 1000, decimal_fixed(92500 + (i % 3) * 10, 0), 1 + i % 5));
+
+		encoder.encode("RIM6", ticks.data(), ticks.size(), buffer);
+		REQUIRE(buffer.size() < ticks.size() * sizeof(Tick) / 4);
+
+		decoder.decode("RIM6", buffer.data(), buffer.size(), decoded);
+		REQUIRE(decoded == ticks);
+	}
+
+	SECTION("Extended datatype")
+	{
+		auto tick = makeTick(1, 0, decimal_fixed(1, 0), 1);
+		tick.datatype = 0x42;
+		encoder.encode("FOO", &tick, 1, buffer);
+		decoder.decode("FOO", buffer.data(), buffer.size(), decoded);
+		REQUIRE(decoded.front() == tick);
+	}
+
+	SECTION("Truncated frame")
+	{
+		auto tick = makeTick(1463652000, 0, decimal_fixed(92500, 0), 10);
+		encoder.encode("FOO", &tick, 1, buffer);
+		REQUIRE_THROWS_AS(decoder.decode("FOO", buffer.data(), buffer.size() - 1, decoded), const ProtocolError&);
+	}
+}